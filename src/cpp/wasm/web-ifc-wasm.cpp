@@ -6,11 +6,16 @@
 #include <algorithm>
 #include <vector>
 #include <stack>
+#include <unordered_set>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <emscripten/bind.h>
 #include <spdlog/spdlog.h>
 #include "../web-ifc/modelmanager/ModelManager.h"
+#include "../web-ifc/geometry/IfcClashDetector.h"
+#include "../web-ifc/geometry/IfcGltfExporter.h"
+#include "../web-ifc/geometry/IfcMeshBatcher.h"
 #include "../version.h"
 #include "../web-ifc/geometry/operations/bim-geometry/extrusion.h"
 #include "../web-ifc/geometry/operations/bim-geometry/sweep.h"
@@ -39,6 +44,51 @@ constexpr bool MT_ENABLED = false;
 
 webifc::manager::ModelManager manager = new webifc::manager::ModelManager(MT_ENABLED);
 
+// the JS progress callback, if any, hears from every model
+std::optional<emscripten::val> progressCallback;
+
+void SetProgressCallback(emscripten::val callback)
+{
+    if (callback.isNull() || callback.isUndefined())
+        progressCallback.reset();
+    else
+        progressCallback = callback;
+}
+
+void CancelOperation(uint32_t modelID)
+{
+    if (!manager.IsModelOpen(modelID))
+        return;
+    manager.GetCancellationToken(modelID)->Cancel();
+}
+
+// every operation that reports progress and can be cancelled starts here, a cancel left over from an earlier one is dropped
+void StartOperation(uint32_t modelID)
+{
+    if (!manager.IsModelOpen(modelID))
+        return;
+    auto cancellation = manager.GetCancellationToken(modelID);
+    cancellation->Reset();
+    if (!progressCallback)
+    {
+        cancellation->SetProgressCallback({});
+        return;
+    }
+    emscripten::val callback = *progressCallback;
+    cancellation->SetProgressCallback([modelID, callback](const webifc::parsing::IfcProgress &progress)
+                                      {
+        emscripten::val value = emscripten::val::object();
+        value.set("bytes", (double)progress.bytes);
+        value.set("elements", (double)progress.elements);
+        value.set("totalElements", (double)progress.totalElements);
+        callback(modelID, value); });
+}
+
+bool IsCancelled(uint32_t modelID)
+{
+    return manager.IsModelOpen(modelID) && manager.GetCancellationToken(modelID)->IsCancelled();
+}
+
 int CreateModel(webifc::manager::LoaderSettings settings)
 {
     return manager.CreateModel(settings);
@@ -59,7 +109,14 @@ int OpenModel(webifc::manager::LoaderSettings settings, emscripten::val callback
         return len;
     };
 
+    StartOperation(modelID);
     manager.GetIfcLoader(modelID)->LoadFile(loaderFunc);
+    if (IsCancelled(modelID))
+    {
+        // a partly parsed model is of no use to anyone
+        manager.CloseModel(modelID);
+        return -1;
+    }
     return modelID;
 }
 
@@ -67,6 +124,7 @@ void SaveModel(uint32_t modelID, emscripten::val callback)
 {
     if (!manager.IsModelOpen(modelID))
         return;
+    StartOperation(modelID);
     manager.GetIfcLoader(modelID)->SaveFile([&](char *src, size_t srcSize)
                                             { emscripten::val retVal = callback((uint32_t)src, srcSize); }, false);
 }
@@ -96,14 +154,10 @@ void StreamMeshes(uint32_t modelID, const std::vector<uint32_t> &expressIds, ems
     if (!manager.IsModelOpen(modelID))
         return;
     auto geomLoader = manager.GetGeometryProcessor(modelID);
-    int index = 0;
-    int total = expressIds.size();
-
-    for (const auto &id : expressIds)
-    {
-        // read the mesh from IFC
-        webifc::geometry::IfcFlatMesh mesh = geomLoader->GetFlatMesh(id);
 
+    // meshes are generated on the worker threads (if any) but always delivered here, in order
+    geomLoader->GetFlatMeshes(expressIds, manager.GetGeometryThreads(modelID), [&](webifc::geometry::IfcFlatMesh &mesh, size_t index, size_t total)
+                              {
         // prepare the geometry data
         for (auto &geom : mesh.geometries)
         {
@@ -114,14 +168,11 @@ void StreamMeshes(uint32_t modelID, const std::vector<uint32_t> &expressIds, ems
         if (!mesh.geometries.empty())
         {
             // transfer control to client, geometry data is alive for the time of the callback
-            callback(mesh, index, total);
+            callback(mesh, (int)index, (int)total);
         }
 
         // clear geometry, freeing memory, client is expected to have consumed the data
-        geomLoader->Clear();
-
-        index++;
-    }
+        geomLoader->Clear(); });
 }
 
 void StreamMeshesWithExpressID(uint32_t modelID, emscripten::val expressIdsVal, emscripten::val callback)
@@ -138,6 +189,7 @@ void StreamMeshesWithExpressID(uint32_t modelID, emscripten::val expressIdsVal,
         expressIds.push_back(expressId);
     }
 
+    StartOperation(modelID);
     StreamMeshes(modelID, expressIds, callback);
 }
 
@@ -149,6 +201,8 @@ void StreamAllMeshesWithTypes(uint32_t modelID, const std::vector<uint32_t> &typ
 
     for (auto &type : types)
     {
+        if (IsCancelled(modelID))
+            break;
         auto elements = loader->GetExpressIDsWithType(type);
         StreamMeshes(modelID, elements, callback);
     }
@@ -167,6 +221,7 @@ void StreamAllMeshesWithTypesVal(uint32_t modelID, emscripten::val typesVal, ems
         uint32_t type = typeVal.as<uint32_t>();
         types.push_back(type);
     }
+    StartOperation(modelID);
     StreamAllMeshesWithTypes(modelID, types, callback);
 }
 
@@ -185,9 +240,370 @@ void StreamAllMeshes(uint32_t modelID, emscripten::val callback)
 
         types.push_back(type);
     }
+    StartOperation(modelID);
     StreamAllMeshesWithTypes(modelID, types, callback);
 }
 
+void StreamInstancedMeshes(uint32_t modelID, const std::vector<uint32_t> &expressIds, emscripten::val geometryCallback, emscripten::val instancesCallback)
+{
+    if (!manager.IsModelOpen(modelID))
+        return;
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    std::unordered_set<uint32_t> deliveredGeometries;
+
+    geomLoader->GetFlatMeshes(expressIds, manager.GetGeometryThreads(modelID), [&](webifc::geometry::IfcFlatMesh &mesh, size_t index, size_t total)
+                              {
+        uint32_t id = mesh.expressID;
+        std::vector<webifc::geometry::IfcGeometryInstance> instances;
+        instances.reserve(mesh.geometries.size());
+        for (auto &geom : mesh.geometries)
+        {
+            // every geometry is handed out once per stream, the client keeps it and references it by express ID
+            if (deliveredGeometries.insert(geom.geometryExpressID).second)
+            {
+                auto &flatGeom = geomLoader->GetGeometry(geom.geometryExpressID);
+                flatGeom.GetVertexData();
+                geometryCallback(geom.geometryExpressID);
+            }
+            instances.push_back({id, geom.geometryExpressID, geom.flatTransformation, geom.color});
+        }
+
+        if (!instances.empty())
+        {
+            instancesCallback(instances, (int)index, (int)total);
+        }
+
+        geomLoader->Clear(); });
+}
+
+void StreamInstancedMeshesWithExpressID(uint32_t modelID, emscripten::val expressIdsVal, emscripten::val geometryCallback, emscripten::val instancesCallback)
+{
+    std::vector<uint32_t> expressIds;
+
+    uint32_t size = expressIdsVal["length"].as<uint32_t>();
+    for (size_t i = 0; i < size; i++)
+    {
+        expressIds.push_back(expressIdsVal[std::to_string(i)].as<uint32_t>());
+    }
+
+    StartOperation(modelID);
+    StreamInstancedMeshes(modelID, expressIds, geometryCallback, instancesCallback);
+}
+
+void StreamAllInstancedMeshes(uint32_t modelID, emscripten::val geometryCallback, emscripten::val instancesCallback)
+{
+    if (!manager.IsModelOpen(modelID))
+        return;
+    auto loader = manager.GetIfcLoader(modelID);
+    std::vector<uint32_t> expressIds;
+
+    for (auto &type : manager.GetSchemaManager().GetIfcElementList())
+    {
+        if (type == webifc::schema::IFCOPENINGELEMENT || type == webifc::schema::IFCSPACE || type == webifc::schema::IFCOPENINGSTANDARDCASE)
+        {
+            continue;
+        }
+
+        auto elements = loader->GetExpressIDsWithType(type);
+        expressIds.insert(expressIds.end(), elements.begin(), elements.end());
+    }
+
+    // a single pass, so geometry shared between element types is still only delivered once
+    StartOperation(modelID);
+    StreamInstancedMeshes(modelID, expressIds, geometryCallback, instancesCallback);
+}
+
+emscripten::val GetElementBounds(uint32_t modelID, const std::vector<uint32_t> &expressIds)
+{
+    // seven doubles per element with geometry: expressID, min x, y, z and max x, y, z
+    std::vector<double> flatBounds;
+    if (manager.IsModelOpen(modelID))
+    {
+        StartOperation(modelID);
+        auto geomLoader = manager.GetGeometryProcessor(modelID);
+        auto bounds = geomLoader->GetElementBounds(expressIds, manager.GetGeometryThreads(modelID));
+        geomLoader->Clear();
+
+        flatBounds.reserve(bounds.size() * 7);
+        for (auto &box : bounds)
+        {
+            if (box.IsEmpty())
+            {
+                continue;
+            }
+            flatBounds.insert(flatBounds.end(), {static_cast<double>(box.expressID), box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z});
+        }
+    }
+    return emscripten::val(emscripten::typed_memory_view(flatBounds.size(), flatBounds.data())).call<emscripten::val>("slice");
+}
+
+emscripten::val GetElementBoundsWithExpressID(uint32_t modelID, emscripten::val expressIdsVal)
+{
+    std::vector<uint32_t> expressIds;
+
+    uint32_t size = expressIdsVal["length"].as<uint32_t>();
+    for (size_t i = 0; i < size; i++)
+    {
+        expressIds.push_back(expressIdsVal[std::to_string(i)].as<uint32_t>());
+    }
+
+    return GetElementBounds(modelID, expressIds);
+}
+
+// the elements StreamAllMeshes would stream
+std::vector<uint32_t> GetAllElementIDs(uint32_t modelID)
+{
+    std::vector<uint32_t> expressIds;
+    if (!manager.IsModelOpen(modelID))
+        return expressIds;
+    auto loader = manager.GetIfcLoader(modelID);
+    for (auto &type : manager.GetSchemaManager().GetIfcElementList())
+    {
+        if (type == webifc::schema::IFCOPENINGELEMENT || type == webifc::schema::IFCSPACE || type == webifc::schema::IFCOPENINGSTANDARDCASE)
+        {
+            continue;
+        }
+
+        auto elements = loader->GetExpressIDsWithType(type);
+        expressIds.insert(expressIds.end(), elements.begin(), elements.end());
+    }
+    return expressIds;
+}
+
+emscripten::val GetAllElementBounds(uint32_t modelID)
+{
+    return GetElementBounds(modelID, GetAllElementIDs(modelID));
+}
+
+uint32_t BuildElementIndex(uint32_t modelID)
+{
+    if (!manager.IsModelOpen(modelID))
+        return 0;
+    StartOperation(modelID);
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    geomLoader->BuildElementIndex(GetAllElementIDs(modelID), manager.GetGeometryThreads(modelID));
+    geomLoader->Clear();
+    return geomLoader->GetElementIndex().Size();
+}
+
+// queries build the index over all elements the first time they are used
+webifc::geometry::IfcGeometryProcessor *GetIndexedGeometryProcessor(uint32_t modelID)
+{
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    if (geomLoader->GetElementIndex().Size() == 0)
+        BuildElementIndex(modelID);
+    return geomLoader;
+}
+
+std::vector<uint32_t> QueryElementsInBox(uint32_t modelID, glm::dvec3 min, glm::dvec3 max)
+{
+    if (!manager.IsModelOpen(modelID))
+        return std::vector<uint32_t>();
+    return GetIndexedGeometryProcessor(modelID)->GetElementIndex().QueryBox(min, max);
+}
+
+std::vector<uint32_t> QueryElementsInFrustum(uint32_t modelID, emscripten::val planesVal)
+{
+    if (!manager.IsModelOpen(modelID))
+        return std::vector<uint32_t>();
+    std::vector<glm::dvec4> planes;
+    uint32_t size = planesVal["length"].as<uint32_t>();
+    for (uint32_t i = 0; i + 3 < size; i += 4)
+    {
+        planes.emplace_back(planesVal[i].as<double>(), planesVal[i + 1].as<double>(), planesVal[i + 2].as<double>(), planesVal[i + 3].as<double>());
+    }
+    return GetIndexedGeometryProcessor(modelID)->GetElementIndex().QueryPlanes(planes);
+}
+
+emscripten::val RaycastElements(uint32_t modelID, glm::dvec3 origin, glm::dvec3 dir)
+{
+    if (!manager.IsModelOpen(modelID))
+        return emscripten::val::null();
+    auto geomLoader = GetIndexedGeometryProcessor(modelID);
+    auto hit = geomLoader->Raycast(origin, dir);
+    geomLoader->Clear();
+    if (!hit)
+        return emscripten::val::null();
+
+    auto retVal = emscripten::val::object();
+    retVal.set("expressID", hit->expressID);
+    retVal.set("geometryExpressID", hit->geometryExpressID);
+    retVal.set("triangle", hit->triangle);
+    retVal.set("distance", hit->distance);
+    retVal.set("point", hit->point);
+    return retVal;
+}
+
+// an empty list stands for every element StreamAllMeshes would stream
+emscripten::val DetectClashes(uint32_t modelID, emscripten::val expressIdsVal, uint32_t otherModelID, emscripten::val otherExpressIdsVal, double tolerance, double clearance)
+{
+    auto clashesVal = emscripten::val::array();
+    if (!manager.IsModelOpen(modelID) || !manager.IsModelOpen(otherModelID))
+        return clashesVal;
+    StartOperation(modelID);
+    if (otherModelID != modelID)
+        StartOperation(otherModelID);
+
+    auto toVector = [](uint32_t id, emscripten::val idsVal)
+    {
+        std::vector<uint32_t> expressIds;
+        uint32_t size = idsVal["length"].as<uint32_t>();
+        for (uint32_t i = 0; i < size; i++)
+        {
+            expressIds.push_back(idsVal[i].as<uint32_t>());
+        }
+        return expressIds.empty() ? GetAllElementIDs(id) : expressIds;
+    };
+
+    webifc::geometry::IfcClashSettings settings;
+    settings.tolerance = tolerance;
+    settings.clearance = clearance;
+    webifc::geometry::IfcClashDetector detector(settings, manager.GetGeometryThreads(modelID));
+
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    auto otherGeomLoader = manager.GetGeometryProcessor(otherModelID);
+    std::vector<webifc::geometry::IfcClash> clashes;
+    // one model with a single set checks its elements against each other
+    if (modelID == otherModelID && otherExpressIdsVal["length"].as<uint32_t>() == 0)
+        clashes = detector.Detect(*geomLoader, toVector(modelID, expressIdsVal));
+    else
+        clashes = detector.Detect(*geomLoader, toVector(modelID, expressIdsVal), *otherGeomLoader, toVector(otherModelID, otherExpressIdsVal));
+    geomLoader->Clear();
+    otherGeomLoader->Clear();
+
+    for (uint32_t i = 0; i < clashes.size(); i++)
+    {
+        auto &clash = clashes[i];
+        auto clashVal = emscripten::val::object();
+        clashVal.set("expressIDA", clash.expressIDA);
+        clashVal.set("expressIDB", clash.expressIDB);
+        clashVal.set("hard", clash.hard);
+        clashVal.set("penetration", clash.penetration);
+        clashVal.set("distance", clash.distance);
+        clashVal.set("point", clash.point);
+        clashesVal.set(i, clashVal);
+    }
+    return clashesVal;
+}
+
+// a Uint32Array, so it can be handed straight back to StreamMeshesBudgeted
+emscripten::val GetPrioritizedElementIDs(uint32_t modelID, uint32_t priority, glm::dvec3 point, uint32_t storeyID)
+{
+    std::vector<uint32_t> expressIds;
+    if (manager.IsModelOpen(modelID))
+    {
+        StartOperation(modelID);
+        auto geomLoader = manager.GetGeometryProcessor(modelID);
+        expressIds = geomLoader->PrioritizeElements(GetAllElementIDs(modelID), static_cast<webifc::geometry::IfcStreamPriority>(priority), point, storeyID, manager.GetGeometryThreads(modelID));
+        geomLoader->Clear();
+    }
+    return emscripten::val(emscripten::typed_memory_view(expressIds.size(), expressIds.data())).call<emscripten::val>("slice");
+}
+
+// streams from cursor until the budgets (0 for none) are used up or CancelOperation() is called, the returned cursor is
+// where the next call resumes
+uint32_t StreamMeshesBudgeted(uint32_t modelID, emscripten::val expressIdsVal, uint32_t cursor, double timeBudgetMs, double byteBudget, emscripten::val callback)
+{
+    std::vector<uint32_t> expressIds;
+    uint32_t size = expressIdsVal["length"].as<uint32_t>();
+    for (uint32_t i = 0; i < size; i++)
+    {
+        expressIds.push_back(expressIdsVal[i].as<uint32_t>());
+    }
+    if (!manager.IsModelOpen(modelID))
+        return size;
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+
+    StartOperation(modelID);
+    return geomLoader->GetFlatMeshesBudgeted(expressIds, cursor, manager.GetGeometryThreads(modelID), timeBudgetMs, static_cast<uint64_t>(byteBudget), [&](webifc::geometry::IfcFlatMesh &mesh, size_t index, size_t total)
+                                             {
+        for (auto &geom : mesh.geometries)
+        {
+            auto &flatGeom = geomLoader->GetGeometry(geom.geometryExpressID);
+            flatGeom.GetVertexData();
+        }
+
+        if (!mesh.geometries.empty())
+        {
+            callback(mesh, (int)index, (int)total);
+        }
+
+        geomLoader->Clear(); });
+}
+
+// the meshes of the elements (every element when the list is empty) as glTF: the .bin buffer goes to binaryCallback in
+// pieces while the elements are generated, then the .gltf file that refers to it by binaryUri goes to jsonCallback
+bool ExportGltf(uint32_t modelID, emscripten::val expressIdsVal, std::string binaryUri, emscripten::val jsonCallback, emscripten::val binaryCallback)
+{
+    if (!manager.IsModelOpen(modelID))
+        return false;
+    std::vector<uint32_t> expressIds;
+    uint32_t size = expressIdsVal["length"].as<uint32_t>();
+    for (uint32_t i = 0; i < size; i++)
+    {
+        expressIds.push_back(expressIdsVal[i].as<uint32_t>());
+    }
+    if (expressIds.empty())
+        expressIds = GetAllElementIDs(modelID);
+
+    webifc::geometry::IfcGltfExporter exporter([&](const char *src, size_t srcSize)
+                                               { binaryCallback((uint32_t)src, srcSize); });
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    StartOperation(modelID);
+    geomLoader->GetFlatMeshes(expressIds, manager.GetGeometryThreads(modelID), [&](webifc::geometry::IfcFlatMesh &mesh, size_t, size_t)
+                              {
+        // buffers are written out as soon as they are added, the geometry can go right away
+        exporter.AddMesh(*geomLoader, mesh);
+        geomLoader->Clear(); });
+    if (IsCancelled(modelID))
+        return false;
+    exporter.Finish([&](const char *src, size_t srcSize)
+                    { jsonCallback((uint32_t)src, srcSize); },
+                    binaryUri);
+    return true;
+}
+
+// the triangles of the elements (every element when the list is empty) merged by colour into batches of at most
+// maxVertices vertices, ranges holds expressID, first index and index count of each element in the batch
+void StreamMeshBatches(uint32_t modelID, emscripten::val expressIdsVal, uint32_t maxVertices, emscripten::val callback)
+{
+    if (!manager.IsModelOpen(modelID))
+        return;
+    std::vector<uint32_t> expressIds;
+    uint32_t size = expressIdsVal["length"].as<uint32_t>();
+    for (uint32_t i = 0; i < size; i++)
+    {
+        expressIds.push_back(expressIdsVal[i].as<uint32_t>());
+    }
+    if (expressIds.empty())
+        expressIds = GetAllElementIDs(modelID);
+
+    webifc::geometry::IfcMeshBatcher batcher(maxVertices, [&](webifc::geometry::IfcMeshBatch &batch)
+                                             {
+        std::vector<uint32_t> ranges;
+        ranges.reserve(batch.ranges.size() * 3);
+        for (auto &range : batch.ranges)
+        {
+            ranges.insert(ranges.end(), {range.expressID, range.firstIndex, range.indexCount});
+        }
+        auto retVal = emscripten::val::object();
+        retVal.set("color", batch.color);
+        retVal.set("vertexData", emscripten::val(emscripten::typed_memory_view(batch.vertexData.size(), batch.vertexData.data())).call<emscripten::val>("slice"));
+        retVal.set("indexData", emscripten::val(emscripten::typed_memory_view(batch.indexData.size(), batch.indexData.data())).call<emscripten::val>("slice"));
+        retVal.set("flatTransformation", batch.flatTransformation);
+        retVal.set("ranges", emscripten::val(emscripten::typed_memory_view(ranges.size(), ranges.data())).call<emscripten::val>("slice"));
+        callback(retVal); });
+    auto geomLoader = manager.GetGeometryProcessor(modelID);
+    StartOperation(modelID);
+    geomLoader->GetFlatMeshes(expressIds, manager.GetGeometryThreads(modelID), [&](webifc::geometry::IfcFlatMesh &mesh, size_t, size_t)
+                              {
+        // vertices are copied into the batch, the geometry can go right away
+        batcher.AddMesh(*geomLoader, mesh);
+        geomLoader->Clear(); });
+    // a cancelled stream still hands out what was batched, so every element delivered so far is in a batch
+    batcher.Flush();
+}
+
 std::vector<webifc::geometry::IfcFlatMesh> LoadAllGeometry(uint32_t modelID)
 {
     if (!manager.IsModelOpen(modelID))
@@ -195,27 +611,29 @@ std::vector<webifc::geometry::IfcFlatMesh> LoadAllGeometry(uint32_t modelID)
     auto loader = manager.GetIfcLoader(modelID);
     auto geomLoader = manager.GetGeometryProcessor(modelID);
     std::vector<webifc::geometry::IfcFlatMesh> meshes;
+    std::vector<uint32_t> expressIds;
 
     for (auto type : manager.GetSchemaManager().GetIfcElementList())
     {
-        auto elements = loader->GetExpressIDsWithType(type);
-
         if (type == webifc::schema::IFCOPENINGELEMENT || type == webifc::schema::IFCSPACE || type == webifc::schema::IFCOPENINGSTANDARDCASE)
         {
             continue;
         }
 
-        for (uint32_t i = 0; i < elements.size(); i++)
+        auto elements = loader->GetExpressIDsWithType(type);
+        expressIds.insert(expressIds.end(), elements.begin(), elements.end());
+    }
+
+    meshes.reserve(expressIds.size());
+    StartOperation(modelID);
+    geomLoader->GetFlatMeshes(expressIds, manager.GetGeometryThreads(modelID), [&](webifc::geometry::IfcFlatMesh &mesh, size_t, size_t)
+                              {
+        for (auto &geom : mesh.geometries)
         {
-            webifc::geometry::IfcFlatMesh mesh = geomLoader->GetFlatMesh(elements[i]);
-            for (auto &geom : mesh.geometries)
-            {
-                auto &flatGeom = geomLoader->GetGeometry(geom.geometryExpressID);
-                flatGeom.GetVertexData();
-            }
-            meshes.push_back(std::move(mesh));
+            auto &flatGeom = geomLoader->GetGeometry(geom.geometryExpressID);
+            flatGeom.GetVertexData();
         }
-    }
+        meshes.push_back(std::move(mesh)); });
 
     return meshes;
 }
@@ -225,6 +643,15 @@ webifc::geometry::IfcGeometry GetGeometry(uint32_t modelID, uint32_t expressID)
     return manager.IsModelOpen(modelID) ? manager.GetGeometryProcessor(modelID)->GetGeometry(expressID) : webifc::geometry::IfcGeometry();
 }
 
+webifc::geometry::IfcGeometry GetGeometryLod(uint32_t modelID, uint32_t expressID, uint32_t lod)
+{
+    if (!manager.IsModelOpen(modelID))
+        return webifc::geometry::IfcGeometry();
+    auto &geometry = manager.GetGeometryProcessor(modelID)->GetGeometry(expressID).GetLod(lod);
+    geometry.GetVertexData();
+    return geometry;
+}
+
 std::vector<webifc::geometry::IfcCrossSections> GetAllCrossSections(uint32_t modelID, uint8_t dimensions)
 {
     if (!manager.IsModelOpen(modelID))
@@ -312,6 +739,37 @@ std::array<double, 16> GetCoordinationMatrix(uint32_t modelID)
     return manager.IsModelOpen(modelID) ? manager.GetGeometryProcessor(modelID)->GetFlatCoordinationMatrix() : std::array<double, 16>();
 }
 
+emscripten::val GetVertexWeldStats(uint32_t modelID)
+{
+    auto retVal = emscripten::val::object();
+    if (!manager.IsModelOpen(modelID))
+        return retVal;
+    auto &stats = manager.GetGeometryProcessor(modelID)->GetWeldStats();
+    retVal.set("geometries", static_cast<double>(stats.geometries));
+    retVal.set("verticesBefore", static_cast<double>(stats.verticesBefore));
+    retVal.set("verticesAfter", static_cast<double>(stats.verticesAfter));
+    retVal.set("bytesSaved", static_cast<double>(stats.bytesSaved));
+    return retVal;
+}
+
+emscripten::val GetComplexityReport(uint32_t modelID)
+{
+    auto retVal = emscripten::val::array();
+    if (!manager.IsModelOpen(modelID))
+        return retVal;
+    for (auto &fallback : manager.GetGeometryProcessor(modelID)->GetComplexityReport())
+    {
+        auto entry = emscripten::val::object();
+        entry.set("expressID", fallback.expressID);
+        entry.set("reason", static_cast<uint32_t>(fallback.reason));
+        entry.set("operands", fallback.operands);
+        entry.set("triangles", static_cast<double>(fallback.triangles));
+        entry.set("milliseconds", fallback.milliseconds);
+        retVal.call<void>("push", entry);
+    }
+    return retVal;
+}
+
 std::vector<uint32_t> GetLineIDsWithType(uint32_t modelID, emscripten::val types)
 {
     if (!manager.IsModelOpen(modelID))
@@ -382,6 +840,11 @@ bool ValidateExpressID(uint32_t modelID, uint32_t expressId)
     return manager.IsModelOpen(modelID) ? manager.GetIfcLoader(modelID)->IsValidExpressID(expressId) : false;
 }
 
+bool ValidateLine(uint32_t modelID, uint32_t expressId)
+{
+    return manager.IsModelOpen(modelID) ? manager.GetIfcLoader(modelID)->ValidateLine(expressId) : false;
+}
+
 uint32_t GetNextExpressID(uint32_t modelID, uint32_t expressId)
 {
     return manager.IsModelOpen(modelID) ? manager.GetIfcLoader(modelID)->GetNextExpressID(expressId) : 0;
@@ -856,7 +1319,7 @@ std::string DecodeText(std::string text)
 void ResetCache(uint32_t modelID)
 {
     if (manager.IsModelOpen(modelID))
-        manager.GetGeometryProcessor(modelID)->GetLoader().ResetCache();
+        manager.GetGeometryProcessor(modelID)->ResetCache();
 }
 
 bimGeometry::AABB CreateAABB()
@@ -928,7 +1391,13 @@ EMSCRIPTEN_BINDINGS(my_module)
         .function("GetVertexDataSize", &webifc::geometry::IfcGeometry::GetVertexDataSize)
         .function("GetIndexData", &webifc::geometry::IfcGeometry::GetIndexData)
         .function("GetIndexDataSize", &webifc::geometry::IfcGeometry::GetIndexDataSize)
-        .function("GetSweptDiskSolid", &webifc::geometry::IfcGeometry::GetSweptDiskSolid);
+        .function("GetQuantizedVertexData", &webifc::geometry::IfcGeometry::GetQuantizedVertexData)
+        .function("GetQuantizedVertexDataSize", &webifc::geometry::IfcGeometry::GetQuantizedVertexDataSize)
+        .function("GetQuantizedIndexData", &webifc::geometry::IfcGeometry::GetQuantizedIndexData)
+        .function("GetQuantizedIndexDataSize", &webifc::geometry::IfcGeometry::GetQuantizedIndexDataSize)
+        .function("GetDequantizationMatrix", &webifc::geometry::IfcGeometry::GetDequantizationMatrix)
+        .function("GetSweptDiskSolid", &webifc::geometry::IfcGeometry::GetSweptDiskSolid)
+        .function("GetLodCount", &webifc::geometry::IfcGeometry::GetLodCount);
 
     emscripten::value_object<glm::dvec4>("dvec4")
         .field("x", &glm::dvec4::x)
@@ -939,6 +1408,8 @@ EMSCRIPTEN_BINDINGS(my_module)
     emscripten::value_object<webifc::manager::LoaderSettings>("LoaderSettings")
         .field("COORDINATE_TO_ORIGIN", &webifc::manager::LoaderSettings::COORDINATE_TO_ORIGIN)
         .field("CIRCLE_SEGMENTS", &webifc::manager::LoaderSettings::CIRCLE_SEGMENTS)
+        .field("CIRCLE_CHORD_TOLERANCE", &webifc::manager::LoaderSettings::CIRCLE_CHORD_TOLERANCE)
+        .field("MAX_CIRCLE_SEGMENTS", &webifc::manager::LoaderSettings::MAX_CIRCLE_SEGMENTS)
         .field("TAPE_SIZE", &webifc::manager::LoaderSettings::TAPE_SIZE)
         .field("MEMORY_LIMIT", &webifc::manager::LoaderSettings::MEMORY_LIMIT)
         .field("LINEWRITER_BUFFER", &webifc::manager::LoaderSettings::LINEWRITER_BUFFER)
@@ -948,7 +1419,19 @@ EMSCRIPTEN_BINDINGS(my_module)
         .field("TOLERANCE_INSIDE_OUTSIDE_PERIMETER", &webifc::manager::LoaderSettings::TOLERANCE_INSIDE_OUTSIDE_PERIMETER)
         .field("TOLERANCE_SCALAR_EQUALITY", &webifc::manager::LoaderSettings::TOLERANCE_SCALAR_EQUALITY)
         .field("PLANE_REFIT_ITERATIONS", &webifc::manager::LoaderSettings::PLANE_REFIT_ITERATIONS)
-        .field("BOOLEAN_UNION_THRESHOLD", &webifc::manager::LoaderSettings::BOOLEAN_UNION_THRESHOLD);
+        .field("BOOLEAN_UNION_THRESHOLD", &webifc::manager::LoaderSettings::BOOLEAN_UNION_THRESHOLD)
+        .field("STRICT_VALIDATION", &webifc::manager::LoaderSettings::STRICT_VALIDATION)
+        .field("PREFETCH_CARTESIAN_POINTS", &webifc::manager::LoaderSettings::PREFETCH_CARTESIAN_POINTS)
+        .field("DEDUPLICATE_GEOMETRY", &webifc::manager::LoaderSettings::DEDUPLICATE_GEOMETRY)
+        .field("GEOMETRY_THREADS", &webifc::manager::LoaderSettings::GEOMETRY_THREADS)
+        .field("FLOAT32_GEOMETRY", &webifc::manager::LoaderSettings::FLOAT32_GEOMETRY)
+        .field("GEOMETRY_LODS", &webifc::manager::LoaderSettings::GEOMETRY_LODS)
+        .field("VERTEX_WELD_TOLERANCE", &webifc::manager::LoaderSettings::VERTEX_WELD_TOLERANCE)
+        .field("GEOMETRY_CACHE_PATH", &webifc::manager::LoaderSettings::GEOMETRY_CACHE_PATH)
+        .field("ELEMENT_MAX_BOOLEAN_OPERANDS", &webifc::manager::LoaderSettings::ELEMENT_MAX_BOOLEAN_OPERANDS)
+        .field("ELEMENT_MAX_TRIANGLES", &webifc::manager::LoaderSettings::ELEMENT_MAX_TRIANGLES)
+        .field("ELEMENT_TIME_LIMIT_MS", &webifc::manager::LoaderSettings::ELEMENT_TIME_LIMIT_MS)
+        .field("CACHE_RETENTION_BYTES", &webifc::manager::LoaderSettings::CACHE_RETENTION_BYTES);
 
     emscripten::value_array<std::array<double, 16>>("array_double_16")
         .element(emscripten::index<0>())
@@ -979,9 +1462,18 @@ EMSCRIPTEN_BINDINGS(my_module)
 
     emscripten::value_object<webifc::geometry::IfcFlatMesh>("IfcFlatMesh")
         .field("geometries", &webifc::geometry::IfcFlatMesh::geometries)
-        .field("expressID", &webifc::geometry::IfcFlatMesh::expressID);
+        .field("expressID", &webifc::geometry::IfcFlatMesh::expressID)
+        .field("fallback", &webifc::geometry::IfcFlatMesh::fallback);
 
     emscripten::register_vector<webifc::geometry::IfcFlatMesh>("IfcFlatMeshVector");
+
+    emscripten::value_object<webifc::geometry::IfcGeometryInstance>("IfcGeometryInstance")
+        .field("elementExpressID", &webifc::geometry::IfcGeometryInstance::elementExpressID)
+        .field("geometryExpressID", &webifc::geometry::IfcGeometryInstance::geometryExpressID)
+        .field("flatTransformation", &webifc::geometry::IfcGeometryInstance::flatTransformation)
+        .field("color", &webifc::geometry::IfcGeometryInstance::color);
+
+    emscripten::register_vector<webifc::geometry::IfcGeometryInstance>("IfcGeometryInstanceVector");
     emscripten::register_vector<uint32_t>("UintVector");
 
     emscripten::value_object<webifc::geometry::SweptDiskSolid>("SweptDiskSolid")
@@ -1130,11 +1622,27 @@ EMSCRIPTEN_BINDINGS(my_module)
     emscripten::function("GetModelSize", &GetModelSize);
     emscripten::function("IsModelOpen", &IsModelOpen);
     emscripten::function("GetGeometry", &GetGeometry);
+    emscripten::function("GetGeometryLod", &GetGeometryLod);
     emscripten::function("GetFlatMesh", &GetFlatMesh);
     emscripten::function("GetCoordinationMatrix", &GetCoordinationMatrix);
+    emscripten::function("GetVertexWeldStats", &GetVertexWeldStats);
+    emscripten::function("GetComplexityReport", &GetComplexityReport);
+    emscripten::function("ExportGltf", &ExportGltf);
+    emscripten::function("StreamMeshBatches", &StreamMeshBatches);
     emscripten::function("StreamMeshes", &StreamMeshesWithExpressID);
     emscripten::function("StreamAllMeshes", &StreamAllMeshes);
     emscripten::function("StreamAllMeshesWithTypes", &StreamAllMeshesWithTypesVal);
+    emscripten::function("StreamInstancedMeshes", &StreamInstancedMeshesWithExpressID);
+    emscripten::function("StreamAllInstancedMeshes", &StreamAllInstancedMeshes);
+    emscripten::function("GetElementBounds", &GetElementBoundsWithExpressID);
+    emscripten::function("GetAllElementBounds", &GetAllElementBounds);
+    emscripten::function("BuildElementIndex", &BuildElementIndex);
+    emscripten::function("QueryElementsInBox", &QueryElementsInBox);
+    emscripten::function("QueryElementsInFrustum", &QueryElementsInFrustum);
+    emscripten::function("RaycastElements", &RaycastElements);
+    emscripten::function("DetectClashes", &DetectClashes);
+    emscripten::function("GetPrioritizedElementIDs", &GetPrioritizedElementIDs);
+    emscripten::function("StreamMeshesBudgeted", &StreamMeshesBudgeted);
     emscripten::function("GetLine", &GetLine);
     emscripten::function("GetLines", &GetLines);
     emscripten::function("GetLineType", &GetLineType);
@@ -1143,7 +1651,10 @@ EMSCRIPTEN_BINDINGS(my_module)
     emscripten::function("RemoveLine", &RemoveLine);
     emscripten::function("WriteHeaderLine", &WriteHeaderLine);
     emscripten::function("SaveModel", &SaveModel);
+    emscripten::function("SetProgressCallback", &SetProgressCallback);
+    emscripten::function("CancelOperation", &CancelOperation);
     emscripten::function("ValidateExpressID", &ValidateExpressID);
+    emscripten::function("ValidateLine", &ValidateLine);
     emscripten::function("GetNextExpressID", &GetNextExpressID);
     emscripten::function("GetLineIDsWithType", &GetLineIDsWithType);
     emscripten::function("GetInversePropertyForItem", &GetInversePropertyForItem);
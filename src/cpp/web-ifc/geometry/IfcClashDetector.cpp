@@ -0,0 +1,339 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <array>
+#include <stack>
+#include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <spdlog/spdlog.h>
+#include "IfcClashDetector.h"
+#include "operations/geometryutils.h"
+#include "operations/boolean-utils/bvh.h"
+#include "../parallel/parallel.h"
+
+namespace
+{
+    using webifc::geometry::IfcElementBounds;
+
+    // triangles of one element in the coordinates of the first model, with a tree over them for the narrow phase
+    struct ClashMesh
+    {
+        fuzzybools::Geometry geometry;
+        fuzzybools::BVH bvh;
+        IfcElementBounds bounds;
+    };
+
+    struct ClashMeshes
+    {
+        std::vector<ClashMesh> meshes;
+        std::unordered_map<uint32_t, uint32_t> slots;
+
+        ClashMesh *Find(uint32_t expressID)
+        {
+            auto it = slots.find(expressID);
+            return it == slots.end() ? nullptr : &meshes[it->second];
+        }
+    };
+
+    IfcElementBounds TransformBounds(const IfcElementBounds &box, const glm::dmat4 &matrix)
+    {
+        IfcElementBounds bounds;
+        bounds.expressID = box.expressID;
+        if (box.IsEmpty())
+        {
+            return bounds;
+        }
+        for (uint32_t corner = 0; corner < 8; corner++)
+        {
+            glm::dvec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+            bounds.Merge(glm::dvec3(matrix * glm::dvec4(point, 1)));
+        }
+        return bounds;
+    }
+
+    void LoadMeshes(webifc::geometry::IfcGeometryProcessor &processor, const std::vector<uint32_t> &expressIDs, const glm::dmat4 &matrix, double margin, uint32_t threads, ClashMeshes &result)
+    {
+        result.meshes.resize(expressIDs.size());
+        for (uint32_t i = 0; i < expressIDs.size(); i++)
+        {
+            result.slots[expressIDs[i]] = i;
+        }
+
+        processor.GetFlatMeshes(expressIDs, threads, [&](webifc::geometry::IfcFlatMesh &flatMesh, size_t index, size_t) {
+            ClashMesh &mesh = result.meshes[index];
+            mesh.bounds.expressID = flatMesh.expressID;
+            for (auto &placed : flatMesh.geometries)
+            {
+                const webifc::geometry::IfcGeometry &geometry = processor.GetGeometry(placed.geometryExpressID);
+                if (geometry.isPolygon)
+                {
+                    continue;
+                }
+                glm::dmat4 transformation = matrix * placed.transformation;
+                for (uint32_t face = 0; face < geometry.numFaces; face++)
+                {
+                    glm::dvec3 a = transformation * glm::dvec4(geometry.GetVertex(geometry.indexData[face * 3 + 0]), 1);
+                    glm::dvec3 b = transformation * glm::dvec4(geometry.GetVertex(geometry.indexData[face * 3 + 1]), 1);
+                    glm::dvec3 c = transformation * glm::dvec4(geometry.GetVertex(geometry.indexData[face * 3 + 2]), 1);
+                    mesh.geometry.AddFace(a, b, c, 0);
+                    mesh.bounds.Merge(a);
+                    mesh.bounds.Merge(b);
+                    mesh.bounds.Merge(c);
+                }
+            }
+        });
+
+        // the trees point into the geometries, so they are built once the vector stops moving; the face boxes grow by
+        // half the clearance on both sides, two of them then overlap whenever the triangles are closer than the clearance
+        webifc::parallel::WorkStealingFor(result.meshes.size(), threads, [&](size_t i, uint32_t) {
+            ClashMesh &mesh = result.meshes[i];
+            mesh.bvh = fuzzybools::MakeBVH(mesh.geometry);
+            if (margin <= 0)
+            {
+                return;
+            }
+            for (auto &box : mesh.bvh.boxes)
+            {
+                box.min -= glm::dvec3(margin);
+                box.max += glm::dvec3(margin);
+            }
+            for (auto &node : mesh.bvh.nodes)
+            {
+                node.box.min -= glm::dvec3(margin);
+                node.box.max += glm::dvec3(margin);
+            }
+        });
+    }
+
+    std::array<glm::dvec3, 3> GetTriangle(const fuzzybools::Geometry &geometry, uint32_t face)
+    {
+        return {geometry.GetPoint(geometry.indexData[face * 3 + 0]), geometry.GetPoint(geometry.indexData[face * 3 + 1]), geometry.GetPoint(geometry.indexData[face * 3 + 2])};
+    }
+
+    // how far the vertices of a reach behind the plane of b, with the plane facing out of the solid b belongs to
+    double DepthBehind(const std::array<glm::dvec3, 3> &a, const std::array<glm::dvec3, 3> &b)
+    {
+        glm::dvec3 normal = glm::cross(b[1] - b[0], b[2] - b[0]);
+        double length = glm::length(normal);
+        if (length == 0)
+        {
+            return 0;
+        }
+        normal /= length;
+        double depth = 0;
+        for (auto &point : a)
+        {
+            depth = std::max(depth, -glm::dot(normal, point - b[0]));
+        }
+        return depth;
+    }
+
+    double BoxOverlap(const IfcElementBounds &a, const IfcElementBounds &b)
+    {
+        glm::dvec3 overlap = glm::min(a.max, b.max) - glm::max(a.min, b.min);
+        return std::max(0.0, std::min(overlap.x, std::min(overlap.y, overlap.z)));
+    }
+
+    std::optional<webifc::geometry::IfcClash> TestPair(ClashMesh &a, ClashMesh &b, const webifc::geometry::IfcClashSettings &settings)
+    {
+        bool hard = false;
+        double depth = 0;
+        glm::dvec3 crossingSum(0);
+        uint32_t crossings = 0;
+        double gap = DBL_MAX;
+        glm::dvec3 gapPoint(0);
+
+        a.bvh.Intersect(b.bvh, [&](uint32_t faceA, uint32_t faceB) {
+            auto triangleA = GetTriangle(a.geometry, faceA);
+            auto triangleB = GetTriangle(b.geometry, faceB);
+            glm::dvec3 point;
+            if (webifc::geometry::TriangleTriangleIntersection(triangleA[0], triangleA[1], triangleA[2], triangleB[0], triangleB[1], triangleB[2], point))
+            {
+                hard = true;
+                crossingSum += point;
+                crossings++;
+                depth = std::max(depth, std::min(DepthBehind(triangleA, triangleB), DepthBehind(triangleB, triangleA)));
+                return;
+            }
+            if (settings.clearance > 0 && !hard)
+            {
+                glm::dvec3 closestA, closestB;
+                double distance = webifc::geometry::TriangleTriangleDistance(triangleA, triangleB, closestA, closestB);
+                if (distance < gap)
+                {
+                    gap = distance;
+                    gapPoint = (closestA + closestB) * 0.5;
+                }
+            }
+        });
+
+        webifc::geometry::IfcClash clash;
+        clash.expressIDA = a.bounds.expressID;
+        clash.expressIDB = b.bounds.expressID;
+        if (hard)
+        {
+            clash.point = crossingSum / static_cast<double>(crossings);
+            clash.penetration = std::min(depth, BoxOverlap(a.bounds, b.bounds));
+            if (clash.penetration > settings.tolerance)
+            {
+                clash.hard = true;
+                return clash;
+            }
+            // touching within the tolerance still leaves no clearance at all
+            gap = 0;
+            gapPoint = clash.point;
+            clash.penetration = 0;
+        }
+        if (settings.clearance > 0 && gap < settings.clearance)
+        {
+            clash.distance = gap;
+            clash.point = gapPoint;
+            return clash;
+        }
+        return std::nullopt;
+    }
+}
+
+namespace webifc::geometry
+{
+
+    IfcClashDetector::IfcClashDetector(const IfcClashSettings &settings, uint32_t threads) : _settings(settings), _threads(std::max(1u, threads))
+    {
+    }
+
+    std::vector<IfcClash> IfcClashDetector::Detect(IfcGeometryProcessor &processor, const std::vector<uint32_t> &expressIDs)
+    {
+        return DetectPairs(processor, expressIDs, nullptr, expressIDs);
+    }
+
+    std::vector<IfcClash> IfcClashDetector::Detect(IfcGeometryProcessor &first, const std::vector<uint32_t> &firstIDs, IfcGeometryProcessor &second, const std::vector<uint32_t> &secondIDs)
+    {
+        return DetectPairs(first, firstIDs, &second, secondIDs);
+    }
+
+    std::vector<IfcClash> IfcClashDetector::DetectPairs(IfcGeometryProcessor &first, const std::vector<uint32_t> &firstIDs, IfcGeometryProcessor *second, const std::vector<uint32_t> &secondIDs)
+    {
+        spdlog::debug("[DetectClashes({}, {})]", firstIDs.size(), secondIDs.size());
+        const bool selfClash = second == nullptr;
+        const bool sameModel = selfClash || second == &first;
+        IfcGeometryProcessor &secondProcessor = selfClash ? first : *second;
+        const double margin = _settings.clearance * 0.5;
+
+        // broad phase: boxes of the first set against a tree over the boxes of the second, both grown by half the
+        // clearance; the second model is brought into the coordinates of the first through the IFC world they share
+        std::vector<IfcElementBounds> firstBounds = first.GetElementBounds(firstIDs, _threads);
+        std::vector<IfcElementBounds> secondBounds = selfClash ? firstBounds : secondProcessor.GetElementBounds(secondIDs, _threads);
+        glm::dmat4 secondMatrix = sameModel ? glm::dmat4(1) : first.GetCoordinationMatrix() * glm::inverse(secondProcessor.GetCoordinationMatrix());
+        for (auto &box : secondBounds)
+        {
+            if (!sameModel)
+            {
+                box = TransformBounds(box, secondMatrix);
+            }
+            if (!box.IsEmpty())
+            {
+                box.min -= glm::dvec3(margin);
+                box.max += glm::dvec3(margin);
+            }
+        }
+
+        IfcElementBVH secondIndex;
+        secondIndex.Build(secondBounds);
+
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        std::unordered_set<uint64_t> seenPairs;
+        for (auto &box : firstBounds)
+        {
+            if (box.IsEmpty())
+            {
+                continue;
+            }
+            for (uint32_t other : secondIndex.QueryBox(box.min - glm::dvec3(margin), box.max + glm::dvec3(margin)))
+            {
+                if (sameModel && other == box.expressID)
+                {
+                    continue;
+                }
+                if (sameModel)
+                {
+                    // within one model the pair may come up from both sides
+                    uint64_t key = (static_cast<uint64_t>(std::min(box.expressID, other)) << 32) | std::max(box.expressID, other);
+                    if (!seenPairs.insert(key).second)
+                    {
+                        continue;
+                    }
+                }
+                pairs.emplace_back(box.expressID, other);
+            }
+        }
+        spdlog::debug("[DetectClashes()] {} candidate pairs", pairs.size());
+        if (pairs.empty())
+        {
+            return {};
+        }
+
+        // only elements that made it into a pair are tessellated, a model shared by both sets only once
+        std::vector<uint32_t> firstMeshIDs;
+        std::vector<uint32_t> secondMeshIDs;
+        std::unordered_set<uint32_t> firstSeen;
+        std::unordered_set<uint32_t> secondSeen;
+        for (auto &[expressIDA, expressIDB] : pairs)
+        {
+            if (firstSeen.insert(expressIDA).second)
+            {
+                firstMeshIDs.push_back(expressIDA);
+            }
+            auto &seen = sameModel ? firstSeen : secondSeen;
+            auto &meshIDs = sameModel ? firstMeshIDs : secondMeshIDs;
+            if (seen.insert(expressIDB).second)
+            {
+                meshIDs.push_back(expressIDB);
+            }
+        }
+
+        ClashMeshes firstMeshes;
+        ClashMeshes secondMeshes;
+        LoadMeshes(first, firstMeshIDs, glm::dmat4(1), margin, _threads, firstMeshes);
+        if (!sameModel)
+        {
+            LoadMeshes(secondProcessor, secondMeshIDs, secondMatrix, margin, _threads, secondMeshes);
+        }
+        ClashMeshes &otherMeshes = sameModel ? firstMeshes : secondMeshes;
+
+        // narrow phase: the pairs with the most triangles are started first, like the elements in GetFlatMeshes()
+        std::vector<std::pair<uint64_t, size_t>> schedule;
+        schedule.reserve(pairs.size());
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            ClashMesh *a = firstMeshes.Find(pairs[i].first);
+            ClashMesh *b = otherMeshes.Find(pairs[i].second);
+            if (a == nullptr || b == nullptr || a->geometry.numFaces == 0 || b->geometry.numFaces == 0)
+            {
+                continue;
+            }
+            schedule.emplace_back(static_cast<uint64_t>(a->geometry.numFaces) * b->geometry.numFaces, i);
+        }
+        std::stable_sort(schedule.begin(), schedule.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        std::vector<std::optional<IfcClash>> results(pairs.size());
+        webifc::parallel::WorkStealingFor(schedule.size(), _threads, [&](size_t s, uint32_t) {
+            size_t i = schedule[s].second;
+            results[i] = TestPair(*firstMeshes.Find(pairs[i].first), *otherMeshes.Find(pairs[i].second), _settings);
+        });
+
+        std::vector<IfcClash> clashes;
+        for (auto &result : results)
+        {
+            if (result)
+            {
+                clashes.push_back(*result);
+            }
+        }
+        spdlog::debug("[DetectClashes()] {} clashes", clashes.size());
+        return clashes;
+    }
+
+}
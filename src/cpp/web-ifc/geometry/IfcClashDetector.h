@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "IfcGeometryProcessor.h"
+
+// Finds elements of one or two models whose meshes intersect or come closer than a clearance
+
+namespace webifc::geometry
+{
+
+    struct IfcClashSettings
+    {
+        // hard clashes that do not go deeper than this are elements touching, they are dropped
+        double tolerance = 0;
+        // elements closer than this that do not intersect are reported as clearance clashes, 0 skips the check
+        double clearance = 0;
+    };
+
+    struct IfcClash
+    {
+        // expressIDA is in the first set (or model), expressIDB in the second one
+        uint32_t expressIDA = 0;
+        uint32_t expressIDB = 0;
+        // true when the meshes intersect, false when they only come closer than the clearance
+        bool hard = false;
+        // hard clashes: how deep the elements overlap, bounded by the overlap of their boxes along the shortest axis
+        double penetration = 0;
+        // clearance clashes: the gap left between the meshes
+        double distance = 0;
+        // in the coordinates of the first model, the mean of the crossings or the middle of the gap
+        glm::dvec3 point = glm::dvec3(0);
+    };
+
+    // broad phase on element boxes, narrow phase on triangle pairs found by fuzzybools::BVH::Intersect; both the
+    // meshes and the triangle pairs of the candidate elements are processed on the pool that generates geometry
+    class IfcClashDetector
+    {
+    public:
+        IfcClashDetector(const IfcClashSettings &settings, uint32_t threads);
+        // every pair of elements of one set
+        std::vector<IfcClash> Detect(IfcGeometryProcessor &processor, const std::vector<uint32_t> &expressIDs);
+        // elements of the first set against elements of the second, the processors may be the same model
+        std::vector<IfcClash> Detect(IfcGeometryProcessor &first, const std::vector<uint32_t> &firstIDs, IfcGeometryProcessor &second, const std::vector<uint32_t> &secondIDs);
+
+    private:
+        // second is null when the elements of the first set are checked against each other
+        std::vector<IfcClash> DetectPairs(IfcGeometryProcessor &first, const std::vector<uint32_t> &firstIDs, IfcGeometryProcessor *second, const std::vector<uint32_t> &secondIDs);
+        IfcClashSettings _settings;
+        uint32_t _threads;
+    };
+
+}
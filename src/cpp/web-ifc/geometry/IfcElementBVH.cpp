@@ -0,0 +1,353 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <array>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "IfcElementBVH.h"
+
+namespace
+{
+    double HalfArea(const glm::dvec3 &min, const glm::dvec3 &max)
+    {
+        glm::dvec3 d = max - min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    double Centroid(const webifc::geometry::IfcElementBounds &bounds, int axis)
+    {
+        return (bounds.min[axis] + bounds.max[axis]) * 0.5;
+    }
+}
+
+namespace webifc::geometry
+{
+
+    void IfcElementBVH::Build(std::vector<IfcElementBounds> bounds)
+    {
+        Clear();
+        for (auto &box : bounds)
+        {
+            if (!box.IsEmpty())
+            {
+                _elements.push_back(box);
+            }
+        }
+        if (_elements.empty())
+        {
+            return;
+        }
+
+        _elementLeaves.resize(_elements.size());
+        _nodes.reserve(2 * (_elements.size() / MAX_LEAF_SIZE + 1));
+        _nodes.emplace_back();
+        BuildNode(0, 0, static_cast<uint32_t>(_elements.size()), UINT32_MAX);
+
+        for (uint32_t i = 0; i < _elements.size(); i++)
+        {
+            _elementSlots[_elements[i].expressID] = i;
+        }
+        spdlog::debug("[IfcElementBVH::Build()] {} elements, {} nodes", _elements.size(), _nodes.size());
+    }
+
+    void IfcElementBVH::BuildNode(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t parent)
+    {
+        Node node;
+        node.parent = parent;
+        glm::dvec3 centroidMin(DBL_MAX);
+        glm::dvec3 centroidMax(-DBL_MAX);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            node.min = glm::min(node.min, _elements[i].min);
+            node.max = glm::max(node.max, _elements[i].max);
+            glm::dvec3 centroid = (_elements[i].min + _elements[i].max) * 0.5;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+
+        if (count <= MAX_LEAF_SIZE)
+        {
+            node.first = first;
+            node.count = count;
+            _nodes[nodeIndex] = node;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                _elementLeaves[i] = nodeIndex;
+            }
+            return;
+        }
+
+        // binned surface area heuristic along the axis the centroids spread most on
+        glm::dvec3 extent = centroidMax - centroidMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        auto begin = _elements.begin() + first;
+        auto end = begin + count;
+        uint32_t mid = first + count / 2;
+
+        if (extent[axis] > 0)
+        {
+            struct Bin
+            {
+                glm::dvec3 min = glm::dvec3(DBL_MAX);
+                glm::dvec3 max = glm::dvec3(-DBL_MAX);
+                uint32_t count = 0;
+            };
+            std::array<Bin, SAH_BINS> bins;
+            double scale = SAH_BINS / extent[axis];
+            auto binOf = [&](const IfcElementBounds &box) {
+                return std::min<uint32_t>(SAH_BINS - 1, static_cast<uint32_t>((Centroid(box, axis) - centroidMin[axis]) * scale));
+            };
+            for (auto it = begin; it != end; it++)
+            {
+                Bin &bin = bins[binOf(*it)];
+                bin.min = glm::min(bin.min, it->min);
+                bin.max = glm::max(bin.max, it->max);
+                bin.count++;
+            }
+
+            // costs of everything right of each split plane, then a sweep from the left picks the cheapest plane
+            std::array<double, SAH_BINS - 1> rightCost;
+            std::array<uint32_t, SAH_BINS - 1> rightCount;
+            Bin right;
+            for (uint32_t b = SAH_BINS - 1; b > 0; b--)
+            {
+                right.min = glm::min(right.min, bins[b].min);
+                right.max = glm::max(right.max, bins[b].max);
+                right.count += bins[b].count;
+                rightCount[b - 1] = right.count;
+                rightCost[b - 1] = right.count > 0 ? HalfArea(right.min, right.max) * right.count : 0;
+            }
+
+            Bin left;
+            double bestCost = DBL_MAX;
+            uint32_t bestSplit = SAH_BINS;
+            for (uint32_t b = 0; b < SAH_BINS - 1; b++)
+            {
+                left.min = glm::min(left.min, bins[b].min);
+                left.max = glm::max(left.max, bins[b].max);
+                left.count += bins[b].count;
+                if (left.count == 0 || rightCount[b] == 0)
+                {
+                    continue;
+                }
+                double cost = HalfArea(left.min, left.max) * left.count + rightCost[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = b;
+                }
+            }
+
+            if (bestSplit < SAH_BINS)
+            {
+                mid = first + static_cast<uint32_t>(std::partition(begin, end, [&](const IfcElementBounds &box) { return binOf(box) <= bestSplit; }) - begin);
+            }
+        }
+
+        // coincident centroids or a split that leaves one side empty fall back to the median
+        if (mid == first || mid == first + count || extent[axis] <= 0)
+        {
+            mid = first + count / 2;
+            std::nth_element(begin, _elements.begin() + mid, end, [axis](const IfcElementBounds &a, const IfcElementBounds &b) { return Centroid(a, axis) < Centroid(b, axis); });
+        }
+
+        // children are stored next to each other, the left one first
+        uint32_t children = static_cast<uint32_t>(_nodes.size());
+        node.first = children;
+        node.count = 0;
+        _nodes[nodeIndex] = node;
+        _nodes.resize(children + 2);
+        BuildNode(children, first, mid - first, nodeIndex);
+        BuildNode(children + 1, mid, first + count - mid, nodeIndex);
+    }
+
+    void IfcElementBVH::Update(const IfcElementBounds &bounds)
+    {
+        auto slotIt = _elementSlots.find(bounds.expressID);
+        if (slotIt != _elementSlots.end())
+        {
+            _elements[slotIt->second] = bounds;
+            Refit(_elementLeaves[slotIt->second]);
+            return;
+        }
+
+        auto pendingIt = std::find_if(_pending.begin(), _pending.end(), [&](const IfcElementBounds &box) { return box.expressID == bounds.expressID; });
+        if (pendingIt != _pending.end())
+        {
+            *pendingIt = bounds;
+            return;
+        }
+        if (bounds.IsEmpty())
+        {
+            return;
+        }
+        _pending.push_back(bounds);
+
+        // the pending list is searched linearly, a rebuild is cheaper once it is a sizeable part of the model
+        if (_pending.size() > std::max<size_t>(64, _elementSlots.size() / 4))
+        {
+            std::vector<IfcElementBounds> all = std::move(_elements);
+            all.insert(all.end(), _pending.begin(), _pending.end());
+            Build(std::move(all));
+        }
+    }
+
+    void IfcElementBVH::Remove(uint32_t expressID)
+    {
+        auto slotIt = _elementSlots.find(expressID);
+        if (slotIt != _elementSlots.end())
+        {
+            IfcElementBounds empty;
+            empty.expressID = expressID;
+            _elements[slotIt->second] = empty;
+            Refit(_elementLeaves[slotIt->second]);
+            _elementSlots.erase(slotIt);
+            return;
+        }
+        _pending.erase(std::remove_if(_pending.begin(), _pending.end(), [&](const IfcElementBounds &box) { return box.expressID == expressID; }), _pending.end());
+    }
+
+    void IfcElementBVH::Clear()
+    {
+        _nodes.clear();
+        _elements.clear();
+        _elementLeaves.clear();
+        _elementSlots.clear();
+        _pending.clear();
+    }
+
+    bool IfcElementBVH::Contains(uint32_t expressID) const
+    {
+        return _elementSlots.contains(expressID) || std::any_of(_pending.begin(), _pending.end(), [&](const IfcElementBounds &box) { return box.expressID == expressID; });
+    }
+
+    size_t IfcElementBVH::Size() const
+    {
+        return _elementSlots.size() + _pending.size();
+    }
+
+    void IfcElementBVH::Refit(uint32_t nodeIndex)
+    {
+        Node &leaf = _nodes[nodeIndex];
+        leaf.min = glm::dvec3(DBL_MAX);
+        leaf.max = glm::dvec3(-DBL_MAX);
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; i++)
+        {
+            leaf.min = glm::min(leaf.min, _elements[i].min);
+            leaf.max = glm::max(leaf.max, _elements[i].max);
+        }
+
+        for (uint32_t parent = leaf.parent; parent != UINT32_MAX; parent = _nodes[parent].parent)
+        {
+            Node &node = _nodes[parent];
+            const Node &left = _nodes[node.first];
+            const Node &right = _nodes[node.first + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+
+    template <typename F, typename G>
+    void IfcElementBVH::Traverse(F &&overlaps, G &&visit) const
+    {
+        std::vector<uint32_t> stack;
+        if (!_nodes.empty())
+        {
+            stack.push_back(0);
+        }
+        while (!stack.empty())
+        {
+            const Node &node = _nodes[stack.back()];
+            stack.pop_back();
+            // empty boxes (removed elements) never overlap anything
+            if (node.min.x > node.max.x || !overlaps(node.min, node.max))
+            {
+                continue;
+            }
+            if (node.count == 0)
+            {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                if (!_elements[i].IsEmpty())
+                {
+                    visit(_elements[i]);
+                }
+            }
+        }
+        for (auto &box : _pending)
+        {
+            if (!box.IsEmpty())
+            {
+                visit(box);
+            }
+        }
+    }
+
+    template <typename F>
+    std::vector<uint32_t> IfcElementBVH::Collect(F &&overlaps) const
+    {
+        std::vector<uint32_t> result;
+        Traverse(overlaps, [&](const IfcElementBounds &box) {
+            if (overlaps(box.min, box.max))
+            {
+                result.push_back(box.expressID);
+            }
+        });
+        return result;
+    }
+
+    std::vector<uint32_t> IfcElementBVH::QueryBox(const glm::dvec3 &min, const glm::dvec3 &max) const
+    {
+        return Collect([&](const glm::dvec3 &boxMin, const glm::dvec3 &boxMax) {
+            return boxMin.x <= max.x && boxMax.x >= min.x && boxMin.y <= max.y && boxMax.y >= min.y && boxMin.z <= max.z && boxMax.z >= min.z;
+        });
+    }
+
+    std::vector<uint32_t> IfcElementBVH::QueryPlanes(const std::vector<glm::dvec4> &planes) const
+    {
+        // a box is dropped when its corner furthest along a plane normal is still outside that plane
+        return Collect([&](const glm::dvec3 &boxMin, const glm::dvec3 &boxMax) {
+            for (auto &plane : planes)
+            {
+                glm::dvec3 corner(plane.x >= 0 ? boxMax.x : boxMin.x, plane.y >= 0 ? boxMax.y : boxMin.y, plane.z >= 0 ? boxMax.z : boxMin.z);
+                if (glm::dot(glm::dvec3(plane), corner) + plane.w < 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    std::vector<std::pair<double, uint32_t>> IfcElementBVH::QueryRay(const glm::dvec3 &origin, const glm::dvec3 &dir, double maxDistance) const
+    {
+        glm::dvec3 invDir = 1.0 / dir;
+        auto entry = [&](const glm::dvec3 &boxMin, const glm::dvec3 &boxMax, double &distance) {
+            glm::dvec3 t1 = (boxMin - origin) * invDir;
+            glm::dvec3 t2 = (boxMax - origin) * invDir;
+            glm::dvec3 tNear = glm::min(t1, t2);
+            glm::dvec3 tFar = glm::max(t1, t2);
+            distance = std::max(std::max(std::max(tNear.x, tNear.y), tNear.z), 0.0);
+            double exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+            return distance <= exit && distance <= maxDistance;
+        };
+
+        std::vector<std::pair<double, uint32_t>> hits;
+        double distance = 0;
+        Traverse([&](const glm::dvec3 &boxMin, const glm::dvec3 &boxMax) { return entry(boxMin, boxMax, distance); },
+                 [&](const IfcElementBounds &box) {
+                     if (entry(box.min, box.max, distance))
+                     {
+                         hits.emplace_back(distance, box.expressID);
+                     }
+                 });
+        std::sort(hits.begin(), hits.end());
+        return hits;
+    }
+
+}
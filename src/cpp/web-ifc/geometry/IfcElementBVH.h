@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "representation/geometry.h"
+
+// Spatial index over the element boxes of one model, used for picking, box selection and frustum culling
+
+namespace webifc::geometry
+{
+
+    // nearest triangle hit by a ray, the triangle is an index into the faces of the geometry
+    struct IfcRayHit
+    {
+        uint32_t expressID = 0;
+        uint32_t geometryExpressID = 0;
+        uint32_t triangle = 0;
+        double distance = 0;
+        glm::dvec3 point = glm::dvec3(0);
+    };
+
+    // binned SAH tree over element boxes; boxes of elements that are regenerated are refitted in place, elements
+    // added after the build are kept in a short list next to the tree until there are enough of them to rebuild
+    class IfcElementBVH
+    {
+    public:
+        void Build(std::vector<IfcElementBounds> bounds);
+        void Update(const IfcElementBounds &bounds);
+        void Remove(uint32_t expressID);
+        void Clear();
+        bool Contains(uint32_t expressID) const;
+        size_t Size() const;
+        std::vector<uint32_t> QueryBox(const glm::dvec3 &min, const glm::dvec3 &max) const;
+        // planes are (normal, d) with the inside where dot(normal, p) + d >= 0, a frustum has six of them
+        std::vector<uint32_t> QueryPlanes(const std::vector<glm::dvec4> &planes) const;
+        // elements whose box the ray enters before maxDistance, sorted by the distance at which it does
+        std::vector<std::pair<double, uint32_t>> QueryRay(const glm::dvec3 &origin, const glm::dvec3 &dir, double maxDistance) const;
+
+    private:
+        struct Node
+        {
+            glm::dvec3 min = glm::dvec3(DBL_MAX);
+            glm::dvec3 max = glm::dvec3(-DBL_MAX);
+            // leaves hold elements [first, first + count), inner nodes have count 0 and children first and first + 1
+            uint32_t first = 0;
+            uint32_t count = 0;
+            uint32_t parent = UINT32_MAX;
+        };
+        static constexpr uint32_t MAX_LEAF_SIZE = 4;
+        static constexpr uint32_t SAH_BINS = 12;
+        void BuildNode(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t parent);
+        void Refit(uint32_t nodeIndex);
+        // calls visit for every element of the leaves whose box passes overlaps, and for the pending ones
+        template <typename F, typename G>
+        void Traverse(F &&overlaps, G &&visit) const;
+        template <typename F>
+        std::vector<uint32_t> Collect(F &&overlaps) const;
+        std::vector<Node> _nodes;
+        // element boxes in leaf order, removed elements stay behind as empty boxes until the next build
+        std::vector<IfcElementBounds> _elements;
+        std::vector<uint32_t> _elementLeaves;
+        std::unordered_map<uint32_t, uint32_t> _elementSlots;
+        std::vector<IfcElementBounds> _pending;
+    };
+
+}
@@ -0,0 +1,496 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "IfcGeometryCache.h"
+
+namespace
+{
+    constexpr char CACHE_MAGIC[8] = {'W', 'I', 'F', 'C', 'G', 'E', 'O', 'C'};
+    // bump whenever the record layout or the meaning of the stored buffers changes
+    constexpr uint32_t CACHE_VERSION = 2;
+    constexpr uint64_t HEADER_SIZE = sizeof(CACHE_MAGIC) + sizeof(uint32_t);
+    // type, id, key, payload size and payload checksum
+    constexpr uint64_t RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t);
+
+    uint64_t Checksum(std::string_view bytes)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : bytes)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    void Put(std::string &out, const T &value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void PutVector(std::string &out, const std::vector<T> &values)
+    {
+        Put<uint64_t>(out, values.size());
+        out.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void PutMatrix(std::string &out, const glm::dmat4 &matrix)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                Put<double>(out, matrix[c][r]);
+            }
+        }
+    }
+
+    template <typename T>
+    bool Get(const std::string &in, size_t &pos, T &value)
+    {
+        if (pos + sizeof(T) > in.size())
+        {
+            return false;
+        }
+        std::memcpy(&value, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool GetVector(const std::string &in, size_t &pos, std::vector<T> &values)
+    {
+        uint64_t count = 0;
+        if (!Get(in, pos, count) || count > (in.size() - pos) / sizeof(T))
+        {
+            return false;
+        }
+        values.resize(count);
+        std::memcpy(values.data(), in.data() + pos, count * sizeof(T));
+        pos += count * sizeof(T);
+        return true;
+    }
+
+    bool GetMatrix(const std::string &in, size_t &pos, glm::dmat4 &matrix)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                if (!Get(in, pos, matrix[c][r]))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+namespace webifc::geometry
+{
+
+    IfcGeometryCache::IfcGeometryCache(const std::string &path) : _path(path)
+    {
+        // the original is only ever read, a cache that is missing or unusable is started over in the temporary file
+        _file.open(path, std::ios::in | std::ios::binary);
+        if (_file.is_open() && !Scan())
+        {
+            spdlog::warn("[IfcGeometryCache()] {} is not a geometry cache of this version, starting a new one", path);
+            Reset();
+        }
+        if (!_file.is_open())
+        {
+            Reset();
+            if (!BeginWriting())
+            {
+                spdlog::error("[IfcGeometryCache()] unable to open {}", path);
+                return;
+            }
+        }
+        spdlog::debug("[IfcGeometryCache()] {} elements and {} geometries cached in {}", _elements.size(), _geometries.size(), path);
+    }
+
+    IfcGeometryCache::~IfcGeometryCache()
+    {
+        Close();
+    }
+
+    bool IfcGeometryCache::IsOpen() const
+    {
+        return _file.is_open();
+    }
+
+    bool IfcGeometryCache::Scan()
+    {
+        _file.seekg(0, std::ios::end);
+        uint64_t fileSize = static_cast<uint64_t>(_file.tellg());
+        _file.seekg(0);
+
+        char magic[sizeof(CACHE_MAGIC)];
+        uint32_t version = 0;
+        _file.read(magic, sizeof(magic));
+        _file.read(reinterpret_cast<char *>(&version), sizeof(version));
+        if (!_file || std::memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || version != CACHE_VERSION)
+        {
+            _file.clear();
+            return false;
+        }
+
+        uint64_t offset = HEADER_SIZE;
+        while (offset + RECORD_HEADER_SIZE <= fileSize)
+        {
+            uint8_t type = 0;
+            uint32_t id = 0;
+            uint64_t key = 0;
+            uint64_t size = 0;
+            uint64_t checksum = 0;
+            _file.seekg(offset);
+            _file.read(reinterpret_cast<char *>(&type), sizeof(type));
+            _file.read(reinterpret_cast<char *>(&id), sizeof(id));
+            _file.read(reinterpret_cast<char *>(&key), sizeof(key));
+            _file.read(reinterpret_cast<char *>(&size), sizeof(size));
+            _file.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+            uint64_t payloadOffset = offset + RECORD_HEADER_SIZE;
+            if (!_file || size > fileSize - payloadOffset)
+            {
+                break;
+            }
+
+            // later records of the same id replace earlier ones, payloads are only checked when read
+            RecordLocation location = {payloadOffset, size, key, checksum};
+            if (type == GEOMETRY_RECORD)
+            {
+                _geometries[id] = location;
+            }
+            else if (type == ELEMENT_RECORD)
+            {
+                _elements[id] = location;
+            }
+            else if (type == COORDINATION_RECORD)
+            {
+                _coordination = location;
+                _hasCoordination = true;
+            }
+            else
+            {
+                break;
+            }
+            offset = payloadOffset + size;
+        }
+
+        _file.clear();
+        _end = offset;
+        return true;
+    }
+
+    void IfcGeometryCache::Reset()
+    {
+        _file.close();
+        _file.clear();
+        _elements.clear();
+        _geometries.clear();
+        _hasCoordination = false;
+        _end = HEADER_SIZE;
+    }
+
+    bool IfcGeometryCache::BeginWriting()
+    {
+        if (!_writePath.empty())
+        {
+            return true;
+        }
+        std::random_device random;
+        std::string writePath = _path + "." + std::to_string((static_cast<uint64_t>(random()) << 32) | random()) + ".tmp";
+        std::fstream out(writePath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            spdlog::error("[BeginWriting()] unable to create {}", writePath);
+            return false;
+        }
+
+        // the records already scanned keep their offsets, they are copied as they are
+        if (_file.is_open())
+        {
+            std::vector<char> buffer(1 << 20);
+            _file.seekg(0);
+            for (uint64_t copied = 0; copied < _end && _file;)
+            {
+                uint64_t chunk = std::min<uint64_t>(buffer.size(), _end - copied);
+                _file.read(buffer.data(), chunk);
+                out.write(buffer.data(), _file.gcount());
+                copied += _file.gcount();
+            }
+        }
+        else
+        {
+            out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            out.write(reinterpret_cast<const char *>(&CACHE_VERSION), sizeof(CACHE_VERSION));
+        }
+        if (!out || static_cast<uint64_t>(out.tellp()) != _end)
+        {
+            spdlog::error("[BeginWriting()] unable to write {}", writePath);
+            out.close();
+            std::remove(writePath.c_str());
+            _file.clear();
+            return false;
+        }
+
+        _file.close();
+        _file = std::move(out);
+        _writePath = writePath;
+        return true;
+    }
+
+    void IfcGeometryCache::Close()
+    {
+        if (_writePath.empty())
+        {
+            _file.close();
+            return;
+        }
+        _file.flush();
+        bool written = static_cast<bool>(_file);
+        _file.close();
+        // rename replaces the original in one step, readers see either the old file or the new one
+        if (!written || std::rename(_writePath.c_str(), _path.c_str()) != 0)
+        {
+            spdlog::error("[Close()] unable to replace {}, the geometry generated this time is not kept", _path);
+            std::remove(_writePath.c_str());
+        }
+        _writePath.clear();
+    }
+
+    bool IfcGeometryCache::ReadRecord(const RecordLocation &location, std::string &payload)
+    {
+        payload.resize(location.size);
+        _file.seekg(location.offset);
+        _file.read(payload.data(), location.size);
+        if (!_file)
+        {
+            _file.clear();
+            return false;
+        }
+        if (Checksum(payload) != location.checksum)
+        {
+            spdlog::warn("[ReadRecord()] damaged record at offset {} of {}, it is generated again", location.offset, _path);
+            return false;
+        }
+        return true;
+    }
+
+    void IfcGeometryCache::WriteRecord(RecordType type, uint32_t id, uint64_t key, const std::string &payload)
+    {
+        if (!BeginWriting())
+        {
+            return;
+        }
+        uint64_t checksum = Checksum(payload);
+        std::string header;
+        Put<uint8_t>(header, type);
+        Put<uint32_t>(header, id);
+        Put<uint64_t>(header, key);
+        Put<uint64_t>(header, payload.size());
+        Put<uint64_t>(header, checksum);
+
+        _file.seekp(_end);
+        _file.write(header.data(), header.size());
+        _file.write(payload.data(), payload.size());
+        if (!_file)
+        {
+            _file.clear();
+            spdlog::error("[WriteRecord()] unable to write to {}", _path);
+            return;
+        }
+
+        RecordLocation location = {_end + RECORD_HEADER_SIZE, payload.size(), key, checksum};
+        _end = location.offset + location.size;
+        if (type == GEOMETRY_RECORD)
+        {
+            _geometries[id] = location;
+        }
+        else if (type == ELEMENT_RECORD)
+        {
+            _elements[id] = location;
+        }
+        else
+        {
+            _coordination = location;
+            _hasCoordination = true;
+        }
+    }
+
+    bool IfcGeometryCache::HasFlatMesh(uint32_t expressID, uint64_t matrixKey) const
+    {
+        auto it = _elements.find(expressID);
+        return it != _elements.end() && it->second.key == matrixKey;
+    }
+
+    bool IfcGeometryCache::ReadFlatMesh(uint32_t expressID, uint64_t matrixKey, IfcFlatMesh &mesh)
+    {
+        std::string payload;
+        if (!HasFlatMesh(expressID, matrixKey))
+        {
+            return false;
+        }
+        if (!ReadRecord(_elements[expressID], payload))
+        {
+            // forgotten, so the element is written again once it has been generated
+            _elements.erase(expressID);
+            return false;
+        }
+
+        size_t pos = 0;
+        uint32_t count = 0;
+        if (!Get(payload, pos, count))
+        {
+            return false;
+        }
+        mesh.expressID = expressID;
+        mesh.geometries.resize(count);
+        for (auto &geometry : mesh.geometries)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (!Get(payload, pos, geometry.color[i]))
+                {
+                    return false;
+                }
+            }
+            if (!GetMatrix(payload, pos, geometry.transformation) || !Get(payload, pos, geometry.geometryExpressID))
+            {
+                return false;
+            }
+            geometry.SetFlatTransformation();
+        }
+        return true;
+    }
+
+    void IfcGeometryCache::WriteFlatMesh(const IfcFlatMesh &mesh, uint64_t matrixKey)
+    {
+        std::string payload;
+        Put<uint32_t>(payload, mesh.geometries.size());
+        for (auto &geometry : mesh.geometries)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                Put<double>(payload, geometry.color[i]);
+            }
+            PutMatrix(payload, geometry.transformation);
+            Put<uint32_t>(payload, geometry.geometryExpressID);
+        }
+        WriteRecord(ELEMENT_RECORD, mesh.expressID, matrixKey, payload);
+    }
+
+    bool IfcGeometryCache::HasGeometry(uint32_t geometryExpressID) const
+    {
+        return _geometries.contains(geometryExpressID);
+    }
+
+    bool IfcGeometryCache::ReadGeometry(uint32_t geometryExpressID, IfcGeometry &geometry)
+    {
+        std::string payload;
+        auto it = _geometries.find(geometryExpressID);
+        if (it == _geometries.end())
+        {
+            return false;
+        }
+        if (!ReadRecord(it->second, payload))
+        {
+            _geometries.erase(it);
+            return false;
+        }
+        size_t pos = 0;
+        return ReadGeometryPayload(payload, pos, geometry);
+    }
+
+    void IfcGeometryCache::WriteGeometry(uint32_t geometryExpressID, const IfcGeometry &geometry)
+    {
+        std::string payload;
+        WriteGeometryPayload(payload, geometry);
+        WriteRecord(GEOMETRY_RECORD, geometryExpressID, 0, payload);
+    }
+
+    bool IfcGeometryCache::HasCoordination() const
+    {
+        return _hasCoordination;
+    }
+
+    bool IfcGeometryCache::ReadCoordination(glm::dmat4 &coordination)
+    {
+        std::string payload;
+        size_t pos = 0;
+        return _hasCoordination && ReadRecord(_coordination, payload) && GetMatrix(payload, pos, coordination);
+    }
+
+    void IfcGeometryCache::WriteCoordination(const glm::dmat4 &coordination)
+    {
+        std::string payload;
+        PutMatrix(payload, coordination);
+        WriteRecord(COORDINATION_RECORD, 0, 0, payload);
+    }
+
+    uint64_t IfcGeometryCache::MatrixKey(const glm::dmat4 &matrix)
+    {
+        std::string bytes;
+        PutMatrix(bytes, matrix);
+        return Checksum(bytes);
+    }
+
+    void IfcGeometryCache::WriteGeometryPayload(std::string &out, const IfcGeometry &geometry)
+    {
+        // only what the finished geometry hands out is kept, planes and parts are boolean input and never read back
+        uint8_t flags = (geometry.isPolygon ? 1 : 0) | (geometry.normalized ? 2 : 0) | (geometry.compact ? 4 : 0) | (geometry.welded ? 8 : 0) | (geometry.lodsBuilt ? 16 : 0);
+        Put<uint32_t>(out, geometry.numPoints);
+        Put<uint32_t>(out, geometry.numFaces);
+        Put<uint8_t>(out, flags);
+        Put<double>(out, geometry.normalizationCenter.x);
+        Put<double>(out, geometry.normalizationCenter.y);
+        Put<double>(out, geometry.normalizationCenter.z);
+        PutVector(out, geometry.vertexData);
+        PutVector(out, geometry.compact ? geometry.fvertexData : std::vector<float>());
+        PutVector(out, geometry.indexData);
+        Put<uint32_t>(out, geometry.lods.size());
+        for (auto &lod : geometry.lods)
+        {
+            WriteGeometryPayload(out, lod);
+        }
+    }
+
+    bool IfcGeometryCache::ReadGeometryPayload(const std::string &in, size_t &pos, IfcGeometry &geometry)
+    {
+        uint8_t flags = 0;
+        uint32_t lodCount = 0;
+        if (!Get(in, pos, geometry.numPoints) || !Get(in, pos, geometry.numFaces) || !Get(in, pos, flags) ||
+            !Get(in, pos, geometry.normalizationCenter.x) || !Get(in, pos, geometry.normalizationCenter.y) || !Get(in, pos, geometry.normalizationCenter.z) ||
+            !GetVector(in, pos, geometry.vertexData) || !GetVector(in, pos, geometry.fvertexData) || !GetVector(in, pos, geometry.indexData) ||
+            !Get(in, pos, lodCount))
+        {
+            return false;
+        }
+        geometry.isPolygon = flags & 1;
+        geometry.normalized = flags & 2;
+        geometry.compact = flags & 4;
+        geometry.welded = flags & 8;
+        geometry.lodsBuilt = flags & 16;
+        geometry.lods.resize(lodCount);
+        for (auto &lod : geometry.lods)
+        {
+            if (!ReadGeometryPayload(in, pos, lod))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,77 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <string_view>
+#include <cstdint>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "representation/geometry.h"
+#include "representation/IfcGeometry.h"
+
+// Keeps the geometry produced for a model in a file, so opening the same model again with the same settings skips tessellation
+
+namespace webifc::geometry
+{
+
+    // the file is a header followed by records of geometries (IfcGeometry buffers), elements (their IfcFlatMesh) and
+    // the coordination matrix; it is scanned once when opened and records are read back on demand, each checked
+    // against its checksum; the first new record copies the file to a private temporary one that takes all further
+    // records, and closing renames it over the original, so a crash or another instance writing the same path never
+    // leaves a mixed file behind (when two write, the last to close wins and the records only the other added are lost)
+    class IfcGeometryCache
+    {
+    public:
+        IfcGeometryCache(const std::string &path);
+        ~IfcGeometryCache();
+        bool IsOpen() const;
+        // elements are stored for the matrix they were flattened with, see MatrixKey()
+        bool HasFlatMesh(uint32_t expressID, uint64_t matrixKey) const;
+        bool ReadFlatMesh(uint32_t expressID, uint64_t matrixKey, IfcFlatMesh &mesh);
+        void WriteFlatMesh(const IfcFlatMesh &mesh, uint64_t matrixKey);
+        bool HasGeometry(uint32_t geometryExpressID) const;
+        bool ReadGeometry(uint32_t geometryExpressID, IfcGeometry &geometry);
+        void WriteGeometry(uint32_t geometryExpressID, const IfcGeometry &geometry);
+        bool ReadCoordination(glm::dmat4 &coordination);
+        void WriteCoordination(const glm::dmat4 &coordination);
+        bool HasCoordination() const;
+        static uint64_t MatrixKey(const glm::dmat4 &matrix);
+
+    private:
+        enum RecordType : uint8_t
+        {
+            GEOMETRY_RECORD = 1,
+            ELEMENT_RECORD = 2,
+            COORDINATION_RECORD = 3
+        };
+        struct RecordLocation
+        {
+            uint64_t offset;
+            uint64_t size;
+            uint64_t key;
+            uint64_t checksum;
+        };
+        bool Scan();
+        void Reset();
+        bool BeginWriting();
+        void Close();
+        bool ReadRecord(const RecordLocation &location, std::string &payload);
+        void WriteRecord(RecordType type, uint32_t id, uint64_t key, const std::string &payload);
+        static void WriteGeometryPayload(std::string &out, const IfcGeometry &geometry);
+        static bool ReadGeometryPayload(const std::string &in, size_t &pos, IfcGeometry &geometry);
+        std::string _path;
+        // empty until the first record is written, then the file _file refers to
+        std::string _writePath;
+        std::fstream _file;
+        uint64_t _end = 0;
+        std::unordered_map<uint32_t, RecordLocation> _elements;
+        std::unordered_map<uint32_t, RecordLocation> _geometries;
+        bool _hasCoordination = false;
+        RecordLocation _coordination;
+    };
+
+}
@@ -4,7 +4,9 @@
 
 #include <spdlog/spdlog.h>
 #include <iomanip>
+#include <fast_float/fast_float.h>
 #include "IfcGeometryLoader.h"
+#include "../parallel/parallel.h"
 #include "operations/curve-utils.h"
 #include "operations/geometryutils.h"
 #ifdef DEBUG_DUMP_SVG
@@ -12,6 +14,23 @@
 #include "../../test/dumpToThree.h"
 #endif
 
+namespace
+{
+  // what a cached curve or profile holds on the heap, close enough to weigh entries against each other
+  uint64_t CurveBytes(const webifc::geometry::IfcCurve &curve)
+  {
+    return sizeof(curve) + curve.points.capacity() * sizeof(glm::dvec3) + curve.arcSegments.capacity() * sizeof(uint32_t) + curve.indices.capacity() * sizeof(uint16_t) + curve.segmentStartTangents.capacity() * sizeof(glm::dvec3);
+  }
+
+  uint64_t ProfileBytes(const webifc::geometry::IfcProfile &profile)
+  {
+    uint64_t bytes = sizeof(profile) + CurveBytes(profile.curve) + profile.tags.capacity() * sizeof(double);
+    for (auto &hole : profile.holes) bytes += CurveBytes(hole);
+    for (auto &child : profile.profiles) bytes += ProfileBytes(child);
+    return bytes;
+  }
+}
+
 namespace webifc::geometry
 {
 
@@ -30,16 +49,59 @@ namespace webifc::geometry
     _styledItems = PopulateStyledItemMap();
     _relMaterials = PopulateRelMaterialsMap();
     _materialDefinitions = PopulateMaterialDefinitionsMap();
+    _profileCache.clear();
+    _curveCache.clear();
+    _expressIDToPlacement.clear();
+    _cacheLru.Clear();
+    _placementGraphBuilt = false;
+    _placementTable.reset();
+  }
+
+  void IfcGeometryLoader::SetCacheBudget(uint64_t bytes)
+  {
+    _cacheBudget = bytes;
+    if (_cacheBudget == 0) _cacheLru.Clear();
   }
 
   void IfcGeometryLoader::Clear() const
   {
+    if (_cacheBudget > 0)
+    {
+      // the slot table is sized by the model and always kept, only the points decoded into it count against the
+      // budget; they are kept together while they take at most half of it
+      uint64_t pointBytes = _cartesianPoints.size() * (sizeof(glm::dvec3) + sizeof(uint32_t));
+      if (pointBytes > _cacheBudget / 2)
+      {
+        ResetCartesianPoints();
+        pointBytes = 0;
+      }
+      _cacheLru.Evict(_cacheBudget - pointBytes, [&](uint64_t key)
+                      {
+        switch (key & (3ull << 62))
+        {
+        case CACHE_PLACEMENT:
+          _expressIDToPlacement.erase(static_cast<uint32_t>(key));
+          break;
+        case CACHE_PROFILE:
+          _profileCache.erase(static_cast<uint32_t>(key));
+          break;
+        default:
+          _curveCache.erase(key & ~(3ull << 62));
+          break;
+        } });
+      return;
+    }
     _expressIDToPlacement.clear();
     std::unordered_map<uint32_t, glm::dmat4>().swap(_expressIDToPlacement);
-    _cartesianPoint3DCache.clear();
-    std::unordered_map<uint32_t, glm::dvec3>().swap(_cartesianPoint3DCache);
-    _cartesianPoint2DCache.clear();
-    std::unordered_map<uint32_t, glm::dvec2>().swap(_cartesianPoint2DCache);
+    ResetCartesianPoints();
+  }
+
+  void IfcGeometryLoader::ResetCartesianPoints() const
+  {
+    // zero filling the whole table for every element would cost as much as the model has express IDs
+    for (uint32_t expressID : _cartesianPointIDs) _cartesianPointSlots[expressID] = 0;
+    _cartesianPointIDs.clear();
+    _cartesianPoints.clear();
   }
 
   IfcCrossSections IfcGeometryLoader::GetCrossSections2D(uint32_t expressID) const
@@ -920,7 +982,7 @@ namespace webifc::geometry
           ifcStartDirection = ifcStartDirection + CONST_PI;
           ifcEndDirection = ifcEndDirection + CONST_PI;
         }
-        auto curve2D = GetEllipseCurve(RadiusOfCurvature, RadiusOfCurvature, _circleSegments, glm::dmat3(1), ifcStartDirection, ifcEndDirection, sw);
+        auto curve2D = GetEllipseCurve(RadiusOfCurvature, RadiusOfCurvature, GetCircleSegments(std::abs(RadiusOfCurvature), ifcEndDirection - ifcStartDirection), glm::dmat3(1), ifcStartDirection, ifcEndDirection, sw);
         glm::dvec2 desp = glm::dvec2(StartPoint.x - curve2D.points[0].x, StartPoint.y - curve2D.points[0].y);
 
         for (size_t i = 0; i < curve2D.points.size(); i++)
@@ -1531,36 +1593,106 @@ namespace webifc::geometry
   glm::dvec3 IfcGeometryLoader::GetCartesianPoint3D(const uint32_t expressID) const
   {
     spdlog::debug("[GetCartesianPoint3D({})]", expressID);
-    if (auto it = _cartesianPoint3DCache.find(expressID); it != _cartesianPoint3DCache.end())
+    return ReadCartesianPoint(expressID);
+  }
+
+  glm::dvec2 IfcGeometryLoader::GetCartesianPoint2D(const uint32_t expressID) const
+  {
+    spdlog::debug("[GetCartesianPoint2D({})]", expressID);
+    glm::dvec3 point = ReadCartesianPoint(expressID);
+    return glm::dvec2(point.x, point.y);
+  }
+
+  glm::dvec3 IfcGeometryLoader::ReadCartesianPoint(const uint32_t expressID) const
+  {
+    if (_prefetchedPoints)
     {
-      return it->second;
+      const glm::dvec3 *point = _prefetchedPoints->Find(expressID);
+      if (point != nullptr) return *point;
+    }
+    if (expressID < _cartesianPointSlots.size() && _cartesianPointSlots[expressID] != 0)
+    {
+      return _cartesianPoints[_cartesianPointSlots[expressID] - 1];
     }
     _loader.MoveToArgumentOffset(expressID, 0);
     _loader.GetTokenType();
     // because these calls cannot be reordered we have to use intermediate variables
+    // the optional z is always consumed so 2D and 3D requests can share one cache entry
     double x = _loader.GetDoubleArgument();
     double y = _loader.GetDoubleArgument();
     double z = _loader.GetOptionalDoubleParam(0);
     glm::dvec3 point(x, y, z);
-    _cartesianPoint3DCache.emplace(expressID, point);
+    if (expressID >= _cartesianPointSlots.size()) _cartesianPointSlots.resize(std::max(expressID, _loader.GetMaxExpressId()) + 1, 0);
+    _cartesianPoints.push_back(point);
+    _cartesianPointIDs.push_back(expressID);
+    _cartesianPointSlots[expressID] = _cartesianPoints.size();
     return point;
   }
 
-  glm::dvec2 IfcGeometryLoader::GetCartesianPoint2D(const uint32_t expressID) const
+  void IfcGeometryLoader::PrefetchCartesianPoints() const
   {
-    spdlog::debug("[GetCartesianPoint2D({})]", expressID);
-    if (auto it = _cartesianPoint2DCache.find(expressID); it != _cartesianPoint2DCache.end())
+    if (_prefetchedPoints) return;
+    spdlog::debug("[PrefetchCartesianPoints()]");
+    auto pointIDs = _loader.GetExpressIDsWithType(schema::IFCCARTESIANPOINT);
+    auto table = std::make_shared<IfcDenseTable<glm::dvec3>>();
+    table->slots.resize(_loader.GetMaxExpressId() + 1, 0);
+    table->values.reserve(pointIDs.size());
+
+    struct PointText
     {
-      return it->second;
+      uint32_t slot;
+      uint32_t offset[3];
+      uint16_t length[3];
+      uint8_t count;
+    };
+
+    // walking the tape is sequential, so the coordinate text of a batch is gathered first and parsed on all cores afterwards
+    const size_t batchSize = 1 << 18;
+    std::string text;
+    std::vector<PointText> batch;
+    for (size_t batchStart = 0; batchStart < pointIDs.size(); batchStart += batchSize)
+    {
+      size_t batchEnd = std::min(pointIDs.size(), batchStart + batchSize);
+      text.clear();
+      batch.clear();
+      for (size_t i = batchStart; i < batchEnd; i++)
+      {
+        uint32_t pointID = pointIDs[i];
+        if (table->slots[pointID] != 0) continue;
+        _loader.MoveToArgumentOffset(pointID, 0);
+        if (_loader.GetTokenType() != parsing::IfcTokenType::SET_BEGIN) continue;
+        PointText point{};
+        while (point.count < 3)
+        {
+          auto t = _loader.GetTokenType();
+          if (t != parsing::IfcTokenType::REAL && t != parsing::IfcTokenType::INTEGER) break;
+          _loader.StepBack();
+          std::string_view coordinate = _loader.GetDoubleArgumentAsString();
+          point.offset[point.count] = text.size();
+          point.length[point.count] = coordinate.size();
+          text.append(coordinate);
+          point.count++;
+        }
+        table->values.emplace_back(0);
+        point.slot = table->values.size();
+        table->slots[pointID] = point.slot;
+        batch.push_back(point);
+      }
+
+      webifc::parallel::ParallelFor(batch.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+          auto &point = batch[i];
+          glm::dvec3 &target = table->values[point.slot - 1];
+          for (uint8_t c = 0; c < point.count; c++)
+          {
+            const char *first = text.data() + point.offset[c];
+            fast_float::from_chars(first, first + point.length[c], target[c]);
+          }
+        }
+      });
     }
-    _loader.MoveToArgumentOffset(expressID, 0);
-    _loader.GetTokenType();
-    // because these calls cannot be reordered we have to use intermediate variables
-    double x = _loader.GetDoubleArgument();
-    double y = _loader.GetDoubleArgument();
-    glm::dvec2 point(x, y);
-    _cartesianPoint2DCache.emplace(expressID, point);
-    return point;
+    _prefetchedPoints = table;
   }
 
   bool IfcGeometryLoader::ReadIfcCartesianPointList(uint32_t expressID) const
@@ -1702,12 +1834,27 @@ namespace webifc::geometry
 
   IfcCurve IfcGeometryLoader::GetCurve(uint32_t expressID, uint8_t dimensions, bool edge) const
   {
+    return *GetSharedCurve(expressID, dimensions, edge);
+  }
+
+  std::shared_ptr<const IfcCurve> IfcGeometryLoader::GetSharedCurve(uint32_t expressID, uint8_t dimensions, bool edge) const
+  {
+    uint64_t key = (static_cast<uint64_t>(expressID) << 9) | (static_cast<uint64_t>(dimensions) << 1) | (edge ? 1 : 0);
+    auto it = _curveCache.find(key);
+    if (it != _curveCache.end())
+    {
+      if (_cacheBudget > 0) _cacheLru.Touch(CACHE_CURVE | key, 0);
+      return it->second;
+    }
+
     spdlog::debug("[GetCurve({})]", expressID);
-    IfcCurve curve;
+    auto curve = std::make_shared<IfcCurve>();
     ComputeCurveParams params;
     params.dimensions = dimensions;
     params.edge = edge;
-    ComputeCurve(expressID, curve, params);
+    ComputeCurve(expressID, *curve, params);
+    _curveCache.emplace(key, curve);
+    if (_cacheBudget > 0) _cacheLru.Touch(CACHE_CURVE | key, CurveBytes(*curve));
     return curve;
   }
 
@@ -1979,7 +2126,10 @@ namespace webifc::geometry
             if (sg.type == "IFCARCINDEX")
             {
               auto pts = ReadIfcCartesianPointList2D(ptsRef);
-              IfcCurve arc = BuildArc3Pt(pts[sg.indexs[0] - 1], pts[sg.indexs[1] - 1], pts[sg.indexs[2] - 1], _circleSegments);
+              glm::dvec2 &p1 = pts[sg.indexs[0] - 1];
+              glm::dvec2 &p2 = pts[sg.indexs[1] - 1];
+              glm::dvec2 &p3 = pts[sg.indexs[2] - 1];
+              IfcCurve arc = BuildArc3Pt(p1, p2, p3, GetArcSegments(glm::dvec3(p1, 0), glm::dvec3(p2, 0), glm::dvec3(p3, 0)));
               for (auto &pt : arc.points)
               {
                 curve.Add(pt);
@@ -2017,7 +2167,10 @@ namespace webifc::geometry
             if (sg.type == "IFCARCINDEX")
             {
               auto pts = ReadIfcCartesianPointList3D(ptsRef);
-              IfcCurve arc = Build3DArc3Pt(pts[sg.indexs[0] - 1], pts[sg.indexs[1] - 1], pts[sg.indexs[2] - 1], _circleSegments, EPS_MINISCULE);
+              glm::dvec3 &p1 = pts[sg.indexs[0] - 1];
+              glm::dvec3 &p2 = pts[sg.indexs[1] - 1];
+              glm::dvec3 &p3 = pts[sg.indexs[2] - 1];
+              IfcCurve arc = Build3DArc3Pt(p1, p2, p3, GetArcSegments(p1, p2, p3), EPS_MINISCULE);
               for (auto &pt : arc.points)
               {
                 curve.Add(pt);
@@ -2200,7 +2353,7 @@ namespace webifc::geometry
             }
         }
         curve.arcSegments.push_back(curve.points.size());
-        const int numPointsCurrentArc = _circleSegments;
+        const int numPointsCurrentArc = GetCircleSegments(std::max(radius1, radius2), openingAngleRad);
         double deltaAngle = openingAngleRad / (numPointsCurrentArc - 1);
         double angle = startRad;
         std::vector<glm::dvec3> points;
@@ -3035,8 +3188,21 @@ namespace webifc::geometry
 
   IfcProfile IfcGeometryLoader::GetProfile(uint32_t expressID) const
   {
+    return *GetSharedProfile(expressID);
+  }
+
+  std::shared_ptr<const IfcProfile> IfcGeometryLoader::GetSharedProfile(uint32_t expressID) const
+  {
+    auto it = _profileCache.find(expressID);
+    if (it != _profileCache.end())
+    {
+      if (_cacheBudget > 0) _cacheLru.Touch(CACHE_PROFILE | expressID, 0);
+      return it->second;
+    }
+
     spdlog::debug("[GetProfile({})]", expressID);
-    auto profile = GetProfileByLine(expressID);
+    auto sharedProfile = std::make_shared<IfcProfile>(GetProfileByLine(expressID));
+    auto &profile = *sharedProfile;
 
     if (!profile.isComposite)
     {
@@ -3070,7 +3236,9 @@ namespace webifc::geometry
       }
     }
 
-    return profile;
+    _profileCache.emplace(expressID, sharedProfile);
+    if (_cacheBudget > 0) _cacheLru.Touch(CACHE_PROFILE | expressID, ProfileBytes(profile));
+    return sharedProfile;
   }
 
   IfcProfile IfcGeometryLoader::GetProfileByLine(uint32_t expressID) const
@@ -3163,8 +3331,8 @@ namespace webifc::geometry
 
       glm::dmat3 placement = GetAxis2Placement2D(placementID);
 
-      profile.curve = GetRectangleCurve(xdim, ydim, placement, _circleSegments, outerRadius);
-      profile.holes.push_back(GetRectangleCurve(xdim - thickness, ydim - thickness, placement, _circleSegments, innerRadius));
+      profile.curve = GetRectangleCurve(xdim, ydim, placement, GetCircleSegments(outerRadius, CONST_PI / 2), outerRadius);
+      profile.holes.push_back(GetRectangleCurve(xdim - thickness, ydim - thickness, placement, GetCircleSegments(innerRadius, CONST_PI / 2), innerRadius));
 
       std::reverse(profile.holes[0].points.begin(), profile.holes[0].points.end());
 
@@ -3189,7 +3357,7 @@ namespace webifc::geometry
         placement = GetAxis2Placement2D(placementID);
       }
 
-      profile.curve = GetCircleCurve(radius, _circleSegments, placement);
+      profile.curve = GetCircleCurve(radius, GetCircleSegments(radius), placement);
 
       return profile;
     }
@@ -3208,7 +3376,7 @@ namespace webifc::geometry
 
       glm::dmat3 placement = GetAxis2Placement2D(placementID);
 
-      profile.curve = GetEllipseCurve(radiusX, radiusY, _circleSegments, placement);
+      profile.curve = GetEllipseCurve(radiusX, radiusY, GetCircleSegments(std::max(radiusX, radiusY)), placement);
 
       return profile;
     }
@@ -3232,8 +3400,8 @@ namespace webifc::geometry
         placement = GetAxis2Placement2D(placementID);
       }
 
-      profile.curve = GetCircleCurve(radius, _circleSegments, placement);
-      profile.holes.push_back(GetCircleCurve(radius - thickness, _circleSegments, placement));
+      profile.curve = GetCircleCurve(radius, GetCircleSegments(radius), placement);
+      profile.holes.push_back(GetCircleCurve(radius - thickness, GetCircleSegments(radius - thickness), placement));
       std::reverse(profile.holes[0].points.begin(), profile.holes[0].points.end());
 
       return profile;
@@ -3325,7 +3493,7 @@ namespace webifc::geometry
         hasFillet = true;
       }
 
-      profile.curve = GetLShapedCurve(width, depth, thickness, hasFillet, filletRadius, edgeRadius, legSlope, _circleSegments, placement);
+      profile.curve = GetLShapedCurve(width, depth, thickness, hasFillet, filletRadius, edgeRadius, legSlope, GetCircleSegments(std::max(filletRadius, edgeRadius), CONST_PI / 2), placement);
 
       return profile;
     }
@@ -3819,11 +3987,115 @@ namespace webifc::geometry
     return curve;
   }
 
+  void IfcGeometryLoader::BuildPlacementGraph() const
+  {
+    if (_placementGraphBuilt) return;
+    _placementGraphBuilt = true;
+    auto placementIDs = _loader.GetExpressIDsWithType(schema::IFCLOCALPLACEMENT);
+    if (placementIDs.empty()) return;
+    spdlog::debug("[BuildPlacementGraph()] {} placements", placementIDs.size());
+
+    const size_t count = placementIDs.size();
+    std::vector<uint32_t> slots(_loader.GetMaxExpressId() + 1, 0);
+    for (size_t i = 0; i < count; i++) slots[placementIDs[i]] = i + 1;
+
+    // decode the relative placement of every node, the tape can only be walked by one thread
+    // matrices holds the local matrix of a node until its level is resolved, then its world matrix
+    std::vector<uint32_t> parents(count, 0);
+    std::vector<glm::dmat4> matrices(count, glm::dmat4(1));
+    for (size_t i = 0; i < count; i++)
+    {
+      uint32_t parentID = _loader.GetRefAttribute(placementIDs[i], 0);
+      uint32_t axis2PlacementID = _loader.GetRefAttribute(placementIDs[i], 1);
+      glm::dmat4 axis2Placement = GetLocalPlacement(axis2PlacementID);
+      if (parentID != 0 && parentID < slots.size() && slots[parentID] != 0)
+      {
+        parents[i] = slots[parentID];
+        matrices[i] = axis2Placement;
+      }
+      else if (parentID != 0)
+      {
+        // relative to something other than an IfcLocalPlacement, resolve that chain on demand
+        matrices[i] = GetLocalPlacement(parentID) * axis2Placement;
+      }
+      else
+      {
+        matrices[i] = axis2Placement;
+      }
+    }
+
+    // group the nodes by depth, so every level only depends on the levels before it
+    std::vector<uint32_t> childOffsets(count + 1, 0);
+    for (size_t i = 0; i < count; i++)
+    {
+      if (parents[i] != 0) childOffsets[parents[i]]++;
+    }
+    for (size_t i = 0; i < count; i++) childOffsets[i + 1] += childOffsets[i];
+    std::vector<uint32_t> children(childOffsets[count]);
+    std::vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+    for (size_t i = 0; i < count; i++)
+    {
+      if (parents[i] != 0) children[fill[parents[i] - 1]++] = i;
+    }
+
+    std::vector<uint32_t> level;
+    for (size_t i = 0; i < count; i++)
+    {
+      if (parents[i] == 0) level.push_back(i);
+    }
+    size_t resolved = level.size();
+    std::vector<uint32_t> nextLevel;
+    while (!level.empty())
+    {
+      nextLevel.clear();
+      for (uint32_t node : level)
+      {
+        nextLevel.insert(nextLevel.end(), children.begin() + childOffsets[node], children.begin() + childOffsets[node + 1]);
+      }
+      webifc::parallel::ParallelFor(nextLevel.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+          uint32_t node = nextLevel[i];
+          matrices[node] = matrices[parents[node] - 1] * matrices[node];
+        }
+      });
+      resolved += nextLevel.size();
+      std::swap(level, nextLevel);
+    }
+
+    if (resolved != count)
+    {
+      spdlog::error("[BuildPlacementGraph()] {} placements are part of a cycle, their relative placement is ignored", count - resolved);
+    }
+
+    auto table = std::make_shared<IfcDenseTable<glm::dmat4>>();
+    table->slots = std::move(slots);
+    table->values = std::move(matrices);
+    _placementTable = table;
+  }
+
+  void IfcGeometryLoader::CachePlacement(uint32_t expressID, const glm::dmat4 &placement) const
+  {
+    _expressIDToPlacement[expressID] = placement;
+    if (_cacheBudget > 0) _cacheLru.Touch(CACHE_PLACEMENT | expressID, sizeof(placement) + 4 * sizeof(void *));
+  }
+
   glm::dmat4 IfcGeometryLoader::GetLocalPlacement(uint32_t expressID, glm::dvec3 vector) const
   {
-    if (_expressIDToPlacement.contains(expressID))
+    if (!_placementGraphBuilt)
+    {
+      BuildPlacementGraph();
+    }
+    if (_placementTable)
     {
-      return _expressIDToPlacement[expressID];
+      const glm::dmat4 *placement = _placementTable->Find(expressID);
+      if (placement != nullptr) return *placement;
+    }
+    auto cached = _expressIDToPlacement.find(expressID);
+    if (cached != _expressIDToPlacement.end())
+    {
+      if (_cacheBudget > 0) _cacheLru.Touch(CACHE_PLACEMENT | expressID, 0);
+      return cached->second;
     }
     else
     {
@@ -3910,7 +4182,7 @@ namespace webifc::geometry
             glm::dmat4 globalVerticalTranslation = glm::translate(glm::dmat4(1), glm::dvec3(0, 0, OffsetVertical));
             result = globalVerticalTranslation * (result * localTranslation);
         }
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCAXIS1PLACEMENT:
@@ -3939,7 +4211,7 @@ namespace webifc::geometry
             glm::dvec4(zAxis, 0),
             glm::dvec4(pos, 1));
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCAXIS2PLACEMENT3D:
@@ -3979,7 +4251,7 @@ namespace webifc::geometry
             glm::dvec4(zAxis, 0),
             glm::dvec4(pos, 1));
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
 
         return result;
       }
@@ -4012,7 +4284,7 @@ namespace webifc::geometry
             glm::dvec4(zAxis, 0),
             glm::dvec4(pos, 1));
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCLOCALPLACEMENT:
@@ -4034,7 +4306,7 @@ namespace webifc::geometry
 
         auto result = relPlacement * axis2Placement;
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCCARTESIANTRANSFORMATIONOPERATOR3D:
@@ -4119,7 +4391,7 @@ namespace webifc::geometry
             glm::dvec4(Axis3 * scale3, 0),
             glm::dvec4(LocalOrigin, 1));
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCAXIS2PLACEMENTLINEAR:
@@ -4145,7 +4417,7 @@ namespace webifc::geometry
             result = GetLocalPlacement(posID, vector);
         }
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       case schema::IFCLINEARPLACEMENT:
@@ -4154,7 +4426,7 @@ namespace webifc::geometry
         uint32_t posID = _loader.GetRefArgument();
         glm::dmat4 result = GetLocalPlacement(posID);
 
-        _expressIDToPlacement[expressID] = result;
+        CachePlacement(expressID, result);
         return result;
       }
       default:
@@ -4484,6 +4756,11 @@ namespace webifc::geometry
     return _relVoids;
   }
 
+  const std::unordered_map<uint32_t, std::vector<uint32_t>> &IfcGeometryLoader::GetRelAggregates() const
+  {
+    return _relAggregates;
+  }
+
   const std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> &IfcGeometryLoader::GetStyledItems() const
   {
     return _styledItems;
@@ -4504,6 +4781,62 @@ namespace webifc::geometry
     return _linearScalingFactor;
   }
 
+  void IfcGeometryLoader::SetChordTolerance(double tolerance, uint16_t maxCircleSegments)
+  {
+    _chordTolerance = std::max(0.0, tolerance);
+    _maxCircleSegments = std::max<uint16_t>(maxCircleSegments, 5);
+  }
+
+  uint16_t IfcGeometryLoader::GetCircleSegments(double radius, double sweepAngle) const
+  {
+    // like _circleSegments the result is the number of points along the arc, so one more than the number of chords
+    sweepAngle = std::min(std::abs(sweepAngle), 2 * (double)CONST_PI);
+    if (_chordTolerance <= 0 || !(radius > 0) || sweepAngle < EPS_MINISCULE)
+    {
+      return _circleSegments;
+    }
+
+    // at least one chord per quarter turn, at most the full circle cap scaled down to the sweep
+    double sweepFraction = sweepAngle / (2 * CONST_PI);
+    double minChords = std::ceil(sweepFraction * 4);
+    double maxChords = std::max(minChords, std::ceil(sweepFraction * (_maxCircleSegments - 1)));
+
+    double radiusMetres = radius * _linearScalingFactor;
+    if (_chordTolerance >= radiusMetres)
+    {
+      return static_cast<uint16_t>(minChords + 1);
+    }
+
+    // a chord spanning the angle a stays within r * (1 - cos(a / 2)) of the arc
+    double maxChordAngle = 2 * std::acos(1 - _chordTolerance / radiusMetres);
+    return static_cast<uint16_t>(std::clamp(std::ceil(sweepAngle / maxChordAngle), minChords, maxChords) + 1);
+  }
+
+  uint16_t IfcGeometryLoader::GetArcSegments(const glm::dvec3 &p1, const glm::dvec3 &p2, const glm::dvec3 &p3) const
+  {
+    if (_chordTolerance <= 0)
+    {
+      return _circleSegments;
+    }
+
+    // the inscribed angle at p2 is half the central angle of the arc that does not pass through p2
+    glm::dvec3 a = p1 - p2;
+    glm::dvec3 b = p3 - p2;
+    double la = glm::length(a);
+    double lb = glm::length(b);
+    if (la < EPS_MINISCULE || lb < EPS_MINISCULE)
+    {
+      return _circleSegments;
+    }
+    double inscribed = std::acos(std::clamp(glm::dot(a, b) / (la * lb), -1.0, 1.0));
+    double sine = std::sin(inscribed);
+    if (sine < EPS_MINISCULE)
+    {
+      return _circleSegments;
+    }
+    return GetCircleSegments(glm::distance(p1, p3) / (2 * sine), 2 * (CONST_PI - inscribed));
+  }
+
   std::string IfcGeometryLoader::GetAngleUnits() const
   {
     return _angleUnits;
@@ -4603,6 +4936,15 @@ namespace webifc::geometry
   IfcGeometryLoader *IfcGeometryLoader::Clone(const webifc::parsing::IfcLoader &newLoader) const
   {
     IfcGeometryLoader *newGeomLoader = new IfcGeometryLoader(newLoader, _schemaManager, _relVoids, _relNests, _relAggregates, _styledItems, _relMaterials, _materialDefinitions, _linearScalingFactor, _squaredScalingFactor, _cubicScalingFactor, _angularScalingFactor, _angleUnits, _circleSegments, _localCurvesList, _localcurvesIndices, _expressIDToPlacement);
+    newGeomLoader->_prefetchedPoints = _prefetchedPoints;
+    newGeomLoader->_placementGraphBuilt = _placementGraphBuilt;
+    newGeomLoader->_placementTable = _placementTable;
+    newGeomLoader->_profileCache = _profileCache;
+    newGeomLoader->_curveCache = _curveCache;
+    newGeomLoader->_cacheBudget = _cacheBudget;
+    newGeomLoader->_cacheLru = _cacheLru;
+    newGeomLoader->_chordTolerance = _chordTolerance;
+    newGeomLoader->_maxCircleSegments = _maxCircleSegments;
     return newGeomLoader;
   }
 
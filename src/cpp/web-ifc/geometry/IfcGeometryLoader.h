@@ -5,9 +5,11 @@
 #pragma once
 
 #include <map>
+#include <list>
 #include <unordered_map>
 #include <vector>
 #include <optional>
+#include <memory>
 #include <cstdint>
 #include <glm/glm.hpp>
 
@@ -23,6 +25,91 @@
 namespace webifc::geometry
 {
 
+  // express ID indexed values, slots holds the position in values plus one (zero means absent)
+  template <typename T>
+  struct IfcDenseTable
+  {
+    std::vector<uint32_t> slots;
+    std::vector<T> values;
+
+    const T *Find(uint32_t expressID) const
+    {
+      if (expressID >= slots.size() || slots[expressID] == 0) return nullptr;
+      return &values[slots[expressID] - 1];
+    }
+  };
+
+  // recency order and estimated size of cache entries, the key of an entry also names the cache it lives in; the
+  // index points into the order list, so a copy rebuilds it
+  class IfcCacheLru
+  {
+  public:
+    IfcCacheLru() = default;
+    IfcCacheLru(const IfcCacheLru &other)
+    {
+      *this = other;
+    }
+
+    IfcCacheLru &operator=(const IfcCacheLru &other)
+    {
+      if (this == &other) return *this;
+      _order = other._order;
+      _index.clear();
+      for (auto it = _order.begin(); it != _order.end(); ++it) _index[it->first] = it;
+      _bytes = other._bytes;
+      return *this;
+    }
+
+    // marks the entry as just used, bytes only count when it is new
+    void Touch(uint64_t key, uint64_t bytes)
+    {
+      auto it = _index.find(key);
+      if (it != _index.end())
+      {
+        _order.splice(_order.begin(), _order, it->second);
+        return;
+      }
+      _order.emplace_front(key, bytes);
+      _index[key] = _order.begin();
+      _bytes += bytes;
+    }
+
+    // drops the least recently used entries until at most budget bytes are left, evict removes each from its cache
+    template <typename F>
+    void Evict(uint64_t budget, F evict)
+    {
+      while (_bytes > budget && !_order.empty())
+      {
+        auto [key, bytes] = _order.back();
+        evict(key);
+        _bytes -= bytes;
+        _index.erase(key);
+        _order.pop_back();
+      }
+    }
+
+    void Remove(uint64_t key)
+    {
+      auto it = _index.find(key);
+      if (it == _index.end()) return;
+      _bytes -= it->second->second;
+      _order.erase(it->second);
+      _index.erase(it);
+    }
+
+    void Clear()
+    {
+      _order.clear();
+      _index.clear();
+      _bytes = 0;
+    }
+
+  private:
+    std::list<std::pair<uint64_t, uint64_t>> _order;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, uint64_t>>::iterator> _index;
+    uint64_t _bytes = 0;
+  };
+
   class IfcGeometryLoader
   {
   public:
@@ -33,11 +120,19 @@ namespace webifc::geometry
     glm::dmat4 GetLocalPlacement(const uint32_t expressID, glm::dvec3 vector = glm::dvec3(1)) const;
     glm::dvec3 GetCartesianPoint3D(const uint32_t expressID) const;
     glm::dvec2 GetCartesianPoint2D(const uint32_t expressID) const;
+    void PrefetchCartesianPoints() const;
+    void SetChordTolerance(double tolerance, uint16_t maxCircleSegments);
+    void SetCacheBudget(uint64_t bytes);
+    uint16_t GetCircleSegments(double radius, double sweepAngle = CONST_PI * 2) const;
+    uint16_t GetArcSegments(const glm::dvec3 &p1, const glm::dvec3 &p2, const glm::dvec3 &p3) const;
+    void BuildPlacementGraph() const;
     glm::dvec3 GetVector(const uint32_t expressID) const;
     IfcProfile GetProfile(uint32_t expressID) const;
+    std::shared_ptr<const IfcProfile> GetSharedProfile(uint32_t expressID) const;
     IfcProfile GetProfile3D(uint32_t expressID) const;
     IfcCurve GetLocalCurve(uint32_t expressID) const;
     IfcCurve GetCurve(uint32_t expressID, uint8_t dimensions, bool edge = false) const;
+    std::shared_ptr<const IfcCurve> GetSharedCurve(uint32_t expressID, uint8_t dimensions, bool edge = false) const;
 
     // Helper function to compute the total length of the curve
     double ComputeCurveLength(const IfcCurve& curve) const;
@@ -62,6 +157,7 @@ namespace webifc::geometry
     IfcAlignment GetAlignment(uint32_t expressID, IfcAlignment alignment = IfcAlignment(), glm::dmat4 transform = glm::dmat4(1), uint32_t sourceExpressID = -1) const;
     bool GetColor(const uint32_t expressID, const glm::dvec4 &outputColor) const;
     const std::unordered_map<uint32_t, std::vector<uint32_t>> &GetRelVoids() const;
+    const std::unordered_map<uint32_t, std::vector<uint32_t>> &GetRelAggregates() const;
     const std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> &GetStyledItems() const;
     const std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> &GetRelMaterials() const;
     const std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> &GetMaterialDefinitions() const;
@@ -76,6 +172,7 @@ namespace webifc::geometry
     IfcProfile GetProfileByLine(uint32_t expressID) const;
     glm::dvec3 GetVertexPoint(uint32_t expressID) const;
     IfcTrimmingSelect GetTrimSelect(uint32_t DIM, std::vector<uint32_t> &tapeOffsets) const;
+    glm::dvec3 ReadCartesianPoint(const uint32_t expressID) const;
 
     struct ComputeCurveParams {
 		ComputeCurveParams() = default;
@@ -117,11 +214,20 @@ namespace webifc::geometry
     double _angularScalingFactor = 1;
     std::string _angleUnits;
     uint16_t _circleSegments;
+    // maximum deviation in metres between a tessellated arc and the true curve, zero keeps the fixed _circleSegments
+    double _chordTolerance = 0;
+    uint16_t _maxCircleSegments = 128;
     mutable std::vector<IfcCurve> _localCurvesList;
     mutable std::vector<uint32_t> _localcurvesIndices;
-    // Caches to avoid repeatedly decoding the same points
-    mutable std::unordered_map<uint32_t, glm::dvec3> _cartesianPoint3DCache;
-    mutable std::unordered_map<uint32_t, glm::dvec2> _cartesianPoint2DCache;
+    // Caches to avoid repeatedly decoding the same points, _cartesianPointSlots is indexed by express ID and holds
+    // the position in _cartesianPoints plus one (zero means not decoded yet); the slot table stays allocated across
+    // Clear(), only the slots listed in _cartesianPointIDs are reset
+    mutable std::vector<uint32_t> _cartesianPointSlots;
+    mutable std::vector<glm::dvec3> _cartesianPoints;
+    mutable std::vector<uint32_t> _cartesianPointIDs;
+    void ResetCartesianPoints() const;
+    // points decoded in bulk, immutable once built so clones share them
+    mutable std::shared_ptr<const IfcDenseTable<glm::dvec3>> _prefetchedPoints;
     std::unordered_map<uint32_t, std::vector<uint32_t>> PopulateRelVoidsMap();
     std::unordered_map<uint32_t, std::vector<uint32_t>> PopulateRelNestsMap();
     std::unordered_map<uint32_t, std::vector<uint32_t>> PopulateRelAggregatesMap();
@@ -131,6 +237,20 @@ namespace webifc::geometry
     void ReadLinearScalingFactor();
     double ConvertPrefix(const std::string_view &prefix);
     mutable std::unordered_map<uint32_t, glm::dmat4> _expressIDToPlacement;
+    void CachePlacement(uint32_t expressID, const glm::dmat4 &placement) const;
+    // profiles and curves only depend on the model, so they are kept across Clear() and shared between users
+    mutable std::unordered_map<uint32_t, std::shared_ptr<const IfcProfile>> _profileCache;
+    mutable std::unordered_map<uint64_t, std::shared_ptr<const IfcCurve>> _curveCache;
+    // world matrices of every IfcLocalPlacement, built once per model and kept across Clear()
+    mutable bool _placementGraphBuilt = false;
+    mutable std::shared_ptr<const IfcDenseTable<glm::dmat4>> _placementTable;
+    // bytes of placements, profiles, curves and decoded points that survive Clear(), least recently used first to go;
+    // with no budget Clear() drops placements and points while profiles and curves are kept without limit
+    uint64_t _cacheBudget = 0;
+    mutable IfcCacheLru _cacheLru;
+    static constexpr uint64_t CACHE_PLACEMENT = 0;
+    static constexpr uint64_t CACHE_PROFILE = 1ull << 62;
+    static constexpr uint64_t CACHE_CURVE = 2ull << 62;
   };
 
 }
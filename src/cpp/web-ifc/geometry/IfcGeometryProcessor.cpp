@@ -3,6 +3,12 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include <spdlog/spdlog.h>
+#include <memory>
+#include <chrono>
+#include <set>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
 
 #if defined(DEBUG_DUMP_SVG) || defined(DUMP_CSG_MESHES)
 #include "../../test/io_helpers.h"
@@ -16,6 +22,16 @@
 #include "operations/curve-utils.h"
 #include "operations/mesh_utils.h"
 #include "operations/boolean-utils/fuzzy-bools.h"
+#include "../parallel/parallel.h"
+
+namespace
+{
+    // what a retained geometry holds on the heap
+    uint64_t GeometryBytes(const webifc::geometry::IfcGeometry &geom)
+    {
+        return geom.vertexData.capacity() * sizeof(double) + geom.fvertexData.capacity() * sizeof(float) + geom.indexData.capacity() * sizeof(uint32_t);
+    }
+}
 
 namespace webifc::geometry
 {
@@ -32,6 +48,27 @@ namespace webifc::geometry
         SetEpsilons(TOLERANCE_SCALAR_EQUALITY, PLANE_REFIT_ITERATIONS, BOOLEAN_UNION_THRESHOLD);
     }
 
+    void IfcGeometryProcessor::SetGeometryDeduplication(bool enabled, uint64_t retainedBytes)
+    {
+        _settings._deduplicateGeometry = enabled;
+        _retainedGeometryBudget = retainedBytes;
+    }
+
+    void IfcGeometryProcessor::SetFloat32Geometry(bool enabled)
+    {
+        _settings._float32Geometry = enabled;
+    }
+
+    void IfcGeometryProcessor::SetGeometryLods(uint16_t levels)
+    {
+        _settings._lodLevels = levels;
+    }
+
+    void IfcGeometryProcessor::SetVertexWelding(double tolerance)
+    {
+        _settings._vertexWeldTolerance = tolerance;
+    }
+
     IfcGeometryLoader& IfcGeometryProcessor::GetLoader()
     {
          return _geometryLoader;
@@ -50,20 +87,92 @@ namespace webifc::geometry
         transformation[2] = v3;
         transformation[3] = v4;
         _transformation = transformation;
+        // the boxes were taken in the old coordinates
+        _elementIndex.Clear();
     }
 
     IfcGeometry &IfcGeometryProcessor::GetGeometry(uint32_t expressID)
     {
+        auto geometryIt = _expressIDToGeometry.find(expressID);
+        if (geometryIt != _expressIDToGeometry.end())
+        {
+            return geometryIt->second;
+        }
+        // lent to the workers of a run, the calling thread is the only one handing it out
+        if (_lent)
+        {
+            auto lentIt = _lent->geometries.find(expressID);
+            if (lentIt != _lent->geometries.end())
+            {
+                return lentIt->second;
+            }
+        }
+        if (_geometryCache)
+        {
+            IfcGeometry cached;
+            if (_geometryCache->ReadGeometry(expressID, cached))
+            {
+                _expressIDToGeometry[expressID] = std::move(cached);
+            }
+        }
         return _expressIDToGeometry[expressID];
     }
 
     void IfcGeometryProcessor::Clear()
     {
-        _expressIDToGeometry.clear();
-        std::unordered_map<uint32_t, IfcGeometry>().swap(_expressIDToGeometry);
+        // placed geometry is only needed until the flat mesh is handed out, what is evicted is tessellated again;
+        // nothing is evicted while the workers of a run read it
+        if (!_lent)
+        {
+            _retainedGeometryLru.Evict(_retainedGeometryBudget, [&](uint64_t key)
+                                       {
+                if (key & RETAINED_MAPPED)
+                {
+                    DropMappedRepresentation(static_cast<uint32_t>(key));
+                }
+                else
+                {
+                    DropUniqueGeometry(static_cast<uint32_t>(key));
+                } });
+        }
+        std::unordered_map<uint32_t, IfcGeometry> retainedGeometries;
+        auto retain = [&](uint32_t geometryID)
+        {
+            auto it = _expressIDToGeometry.find(geometryID);
+            if (it != _expressIDToGeometry.end())
+            {
+                retainedGeometries.emplace(geometryID, std::move(it->second));
+            }
+        };
+        for (auto &[geometryID, count] : _mappedGeometryIDs)
+        {
+            retain(geometryID);
+        }
+        for (uint32_t geometryID : _uniqueGeometryIDs)
+        {
+            retain(geometryID);
+        }
+        _expressIDToGeometry.swap(retainedGeometries);
         _geometryLoader.Clear();
     }
 
+    void IfcGeometryProcessor::ResetCache()
+    {
+        _mappedRepresentations.clear();
+        _mappedGeometryIDs.clear();
+        _geometryHashes.clear();
+        _geometryAliases.clear();
+        _uniqueGeometryIDs.clear();
+        _uniqueGeometryHashes.clear();
+        _retainedGeometryLru.Clear();
+        _mappedBounds.clear();
+        _elementIndex.Clear();
+        _rayMeshes.clear();
+        _rayMeshLru.Clear();
+        _expressIDToGeometry.clear();
+        _geometryLoader.ResetCache();
+    }
+
     std::array<double, 16> IfcGeometryProcessor::GetFlatCoordinationMatrix() const
     {
         std::array<double, 16> flatTransformation;
@@ -133,6 +242,48 @@ namespace webifc::geometry
     }
 
     IfcComposedMesh IfcGeometryProcessor::GetMesh(uint32_t expressID)
+    {
+        const IfcGeometryAlias *found = FindAlias(expressID);
+        if (found == nullptr || !IsRetainedAlias(*found))
+        {
+            return BuildMesh(expressID);
+        }
+        const IfcGeometryAlias &alias = *found;
+        bool retained = alias.geometryExpressID == expressID;
+
+        // a retained leaf is read by booleans as it is, FindOperand() undoes its normalization
+        if (alias.leaf && (_booleanOperandDepth == 0 || retained))
+        {
+            // the output is known already, AddComposedMeshToFlatMesh() places the retained geometry
+            IfcComposedMesh mesh;
+            mesh.expressID = expressID;
+            mesh.transformation = alias.meshTransformation;
+            mesh.color = alias.color;
+            mesh.hasColor = alias.hasColor;
+            mesh.hasGeometry = true;
+            return mesh;
+        }
+        if (!retained)
+        {
+            return BuildMesh(expressID);
+        }
+
+        // the children are built again, the retained geometry stays in place of what is tessellated for the item itself
+        auto geometryIt = _expressIDToGeometry.find(expressID);
+        if (geometryIt == _expressIDToGeometry.end())
+        {
+            // lent geometry is not touched, it is found again once what was built here is gone
+            IfcComposedMesh mesh = BuildMesh(expressID);
+            _expressIDToGeometry.erase(expressID);
+            return mesh;
+        }
+        IfcGeometry output = std::move(geometryIt->second);
+        IfcComposedMesh mesh = BuildMesh(expressID);
+        _expressIDToGeometry[expressID] = std::move(output);
+        return mesh;
+    }
+
+    IfcComposedMesh IfcGeometryProcessor::BuildMesh(uint32_t expressID)
     {
         spdlog::debug("[GetMesh({})]", expressID);
         auto lineType = _loader.GetLineType(expressID);
@@ -156,79 +307,94 @@ namespace webifc::geometry
 
         if (_schemaManager.IsIfcElement(lineType))
         {
-            _loader.MoveToArgumentOffset(expressID, 5);
-            uint32_t localPlacement = 0;
-            if (_loader.GetTokenType() == parsing::IfcTokenType::REF)
-            {
-                _loader.StepBack();
-                localPlacement = _loader.GetRefArgument();
-            }
-            uint32_t ifcPresentation = 0;
-            if (_loader.GetTokenType() == parsing::IfcTokenType::REF)
-            {
-                _loader.StepBack();
-                ifcPresentation = _loader.GetRefArgument();
-            }
+            // IfcProduct.ObjectPlacement and IfcProduct.Representation
+            uint32_t localPlacement = _loader.GetRefAttribute(expressID, 5);
+            uint32_t ifcPresentation = _loader.GetRefAttribute(expressID, 6);
 
             if (localPlacement != 0 && _loader.IsValidExpressID(localPlacement))
             {
                 mesh.transformation = _geometryLoader.GetLocalPlacement(localPlacement);
             }
 
+            auto relVoidsIt = relVoids.find(expressID);
+            bool hasVoids = relVoidsIt != relVoids.end() && !relVoidsIt->second.empty();
+
             if (ifcPresentation != 0 && _loader.IsValidExpressID(ifcPresentation))
             {
+                _booleanOperandDepth += hasVoids ? 1 : 0;
                 mesh.children.push_back(GetMesh(ifcPresentation));
+                _booleanOperandDepth -= hasVoids ? 1 : 0;
             }
 
-            auto relVoidsIt = relVoids.find(expressID);
-
-            if (relVoidsIt != relVoids.end() && !relVoidsIt->second.empty())
+            if (hasVoids)
             {
                 IfcComposedMesh resultMesh;
 
-                auto origin = GetOrigin(mesh, _expressIDToGeometry);
+                auto origin = GetOrigin(mesh, _expressIDToGeometry, InheritedGeometries());
                 auto normalizeMat = glm::translate(-origin);
-                auto flatElementMeshes = flatten(mesh, _expressIDToGeometry, normalizeMat);
+                auto flatElementMeshes = flatten(mesh, _expressIDToGeometry, normalizeMat, InheritedGeometries());
                 auto elementColor = mesh.GetColor();
 
                 IfcGeometry finalGeometry;
 
-                if (flatElementMeshes.size() != 0)
+                // over either limit the element keeps its unclipped body, an opening left out is cheaper than a stalled stream
+                const auto start = std::chrono::steady_clock::now();
+                const uint32_t operands = relVoidsIt->second.size();
+                const auto outerDeadline = _settings._booleanDeadline;
+                if (_settings._elementTimeLimitMs > 0)
+                {
+                    auto limit = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(_settings._elementTimeLimitMs));
+                    _settings._booleanDeadline = std::min(outerDeadline, start + limit);
+                }
+                auto timedOut = [&]() { return std::chrono::steady_clock::now() > _settings._booleanDeadline; };
+
+                if (flatElementMeshes.size() != 0 && _settings._maxBooleanOperands > 0 && operands > _settings._maxBooleanOperands)
+                {
+                    finalGeometry = MergeGeometries(flatElementMeshes);
+                    ReportFallback({expressID, FALLBACK_BOOLEAN_OPERANDS, operands, finalGeometry.numFaces, 0});
+                }
+                else if (flatElementMeshes.size() != 0)
                 {
 
                     std::vector<IfcGeometry> voidGeoms;
 
                     for (auto relVoidExpressID : relVoidsIt->second)
                     {
+                        if (timedOut())
+                        {
+                            break;
+                        }
+                        _booleanOperandDepth++;
                         IfcComposedMesh voidGeom = GetMesh(relVoidExpressID);
-                        auto flatVoidMesh = flatten(voidGeom, _expressIDToGeometry, normalizeMat);
-                        voidGeoms.insert(voidGeoms.end(), flatVoidMesh.begin(), flatVoidMesh.end());
+                        _booleanOperandDepth--;
+                        auto flatVoidMesh = flatten(voidGeom, _expressIDToGeometry, normalizeMat, InheritedGeometries());
+                        voidGeoms.insert(voidGeoms.end(), std::make_move_iterator(flatVoidMesh.begin()), std::make_move_iterator(flatVoidMesh.end()));
                     }
 
                     if (relVoidsIt->second.size() > _settings._BOOLEAN_UNION_THRESHOLD) // When voids are greater than 10 they are all fused
                     {
                         std::vector<IfcGeometry> joinedVoidGeoms;
-                        IfcGeometry fusedVoids;
-                        for (auto geom : voidGeoms)
+                        std::vector<IfcGeometry> solidVoidGeoms;
+                        for (auto &geom : voidGeoms)
                         {
                             if (geom.halfSpace)
                             {
-                                joinedVoidGeoms.push_back(geom);
+                                joinedVoidGeoms.push_back(std::move(geom));
                             }
                             else
                             {
-                                std::vector<IfcGeometry> geomVector = {geom}; // Wrap 'geom' in a vector
-                                fusedVoids = BoolProcess(std::vector<IfcGeometry>{fusedVoids}, geomVector, "UNION", _settings);
+                                solidVoidGeoms.push_back(std::move(geom));
                             }
                         }
+                        IfcGeometry fusedVoids = FuseGeometries(solidVoidGeoms);
 
 #ifdef CSG_DEBUG_OUTPUT
                         // io::DumpIfcGeometry(fusedVoids, "union_bool_void.obj");
 #endif
 
-                        joinedVoidGeoms.push_back(fusedVoids);
+                        joinedVoidGeoms.push_back(std::move(fusedVoids));
 
-                        voidGeoms = joinedVoidGeoms;
+                        voidGeoms = std::move(joinedVoidGeoms);
                         voidGeoms.shrink_to_fit();
                     }
 
@@ -276,9 +442,18 @@ namespace webifc::geometry
 #ifdef CSG_DEBUG_OUTPUT
 //    io::DumpIfcGeometry(finalGeometry, "mesh_bool.obj");
 #endif
+
+                    // BoolProcess() stops between operands once the deadline passed, what it got through is dropped
+                    if (timedOut())
+                    {
+                        finalGeometry = MergeGeometries(flatElementMeshes);
+                        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                        ReportFallback({expressID, FALLBACK_TIME, operands, finalGeometry.numFaces, milliseconds});
+                    }
                 }
+                _settings._booleanDeadline = outerDeadline;
 
-                _expressIDToGeometry[expressID] = finalGeometry;
+                _expressIDToGeometry[expressID] = std::move(finalGeometry);
                 resultMesh.transformation = glm::translate(origin);
                 resultMesh.expressID = expressID;
                 resultMesh.hasGeometry = true;
@@ -332,7 +507,7 @@ namespace webifc::geometry
 
                 mesh.transformation = glm::dmat4(1);
                 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.hasGeometry = true;
 
                 // #ifdef DEBUG_DUMP_SVG
@@ -351,7 +526,63 @@ namespace webifc::geometry
                 uint32_t localPlacement = _loader.GetRefArgument();
 
                 mesh.transformation = _geometryLoader.GetLocalPlacement(localPlacement);
-                mesh.children.push_back(GetMesh(ifcPresentation));
+
+                if (_inherited)
+                {
+                    auto inheritedIt = _inherited->mappedRepresentations.find(ifcPresentation);
+                    if (inheritedIt != _inherited->mappedRepresentations.end())
+                    {
+                        _retainedGeometryLru.Touch(RETAINED_MAPPED | ifcPresentation, 0);
+                        mesh.children.push_back(inheritedIt->second.mesh);
+                        return mesh;
+                    }
+                }
+
+                auto mappedIt = _mappedRepresentations.find(ifcPresentation);
+                if (mappedIt == _mappedRepresentations.end())
+                {
+                    // later instances may be clipped, the cached tree needs every geometry it refers to
+                    IfcMappedRepresentation mapped;
+                    _booleanOperandDepth++;
+                    mapped.mesh = GetMesh(ifcPresentation);
+                    _booleanOperandDepth--;
+
+                    // only geometries not held by another map yet are charged to this one
+                    uint64_t bytes = 0;
+                    std::vector<const IfcComposedMesh *> stack = {&mapped.mesh};
+                    while (!stack.empty())
+                    {
+                        const IfcComposedMesh *current = stack.back();
+                        stack.pop_back();
+                        auto geometryIt = _expressIDToGeometry.find(current->expressID);
+                        if (geometryIt != _expressIDToGeometry.end())
+                        {
+                            // complete before a run lends it out, its workers place it without changing it
+                            PrepareRetainedGeometry(geometryIt->second);
+                            if (_settings._lodLevels > 0)
+                            {
+                                geometryIt->second.BuildLods(_settings._lodLevels);
+                            }
+                            if (_mappedGeometryIDs[current->expressID]++ == 0)
+                            {
+                                bytes += GeometryBytes(geometryIt->second);
+                            }
+                            mapped.geometryIDs.push_back(current->expressID);
+                        }
+                        for (auto &child : current->children)
+                        {
+                            stack.push_back(&child);
+                        }
+                    }
+
+                    mappedIt = _mappedRepresentations.emplace(ifcPresentation, std::move(mapped)).first;
+                    _retainedGeometryLru.Touch(RETAINED_MAPPED | ifcPresentation, bytes);
+                }
+                else
+                {
+                    _retainedGeometryLru.Touch(RETAINED_MAPPED | ifcPresentation, 0);
+                }
+                mesh.children.push_back(mappedIt->second.mesh);
 
                 return mesh;
             }
@@ -361,18 +592,20 @@ namespace webifc::geometry
                 uint32_t firstOperandID = _loader.GetRefArgument();
                 uint32_t secondOperandID = _loader.GetRefArgument();
 
+                _booleanOperandDepth++;
                 auto firstMesh = GetMesh(firstOperandID);
                 auto secondMesh = GetMesh(secondOperandID);
+                _booleanOperandDepth--;
 
-                auto origin = GetOrigin(firstMesh, _expressIDToGeometry);
+                auto origin = GetOrigin(firstMesh, _expressIDToGeometry, InheritedGeometries());
                 auto normalizeMat = glm::translate(-origin);
 
-                auto flatFirstMeshes = flatten(firstMesh, _expressIDToGeometry, normalizeMat);
-                auto flatSecondMeshes = flatten(secondMesh, _expressIDToGeometry, normalizeMat);
+                auto flatFirstMeshes = flatten(firstMesh, _expressIDToGeometry, normalizeMat, InheritedGeometries());
+                auto flatSecondMeshes = flatten(secondMesh, _expressIDToGeometry, normalizeMat, InheritedGeometries());
 
                 IfcGeometry resultMesh = BoolProcess(flatFirstMeshes, flatSecondMeshes, "DIFFERENCE", _settings);
 
-                _expressIDToGeometry[expressID] = resultMesh;
+                _expressIDToGeometry[expressID] = std::move(resultMesh);
                 mesh.hasGeometry = true;
                 mesh.transformation = glm::translate(origin);
 
@@ -400,14 +633,16 @@ namespace webifc::geometry
                 uint32_t firstOperandID = _loader.GetRefArgument();
                 uint32_t secondOperandID = _loader.GetRefArgument();
 
+                _booleanOperandDepth++;
                 auto firstMesh = GetMesh(firstOperandID);
                 auto secondMesh = GetMesh(secondOperandID);
+                _booleanOperandDepth--;
 
-                auto origin = GetOrigin(firstMesh, _expressIDToGeometry);
+                auto origin = GetOrigin(firstMesh, _expressIDToGeometry, InheritedGeometries());
                 auto normalizeMat = glm::translate(-origin);
 
-                auto flatFirstMeshes = flatten(firstMesh, _expressIDToGeometry, normalizeMat);
-                auto flatSecondMeshes = flatten(secondMesh, _expressIDToGeometry, normalizeMat);
+                auto flatFirstMeshes = flatten(firstMesh, _expressIDToGeometry, normalizeMat, InheritedGeometries());
+                auto flatSecondMeshes = flatten(secondMesh, _expressIDToGeometry, normalizeMat, InheritedGeometries());
 
                 if (flatFirstMeshes.size() == 0)
                 {
@@ -418,7 +653,7 @@ namespace webifc::geometry
 
                 IfcGeometry resultMesh = BoolProcess(flatFirstMeshes, flatSecondMeshes, std::string(op), _settings);
 
-                _expressIDToGeometry[expressID] = resultMesh;
+                _expressIDToGeometry[expressID] = std::move(resultMesh);
                 mesh.hasGeometry = true;
                 mesh.transformation = glm::translate(origin);
                 if (!mesh.hasColor && firstMesh.hasColor)
@@ -469,7 +704,7 @@ namespace webifc::geometry
 
                 mesh.transformation = surface.transformation;
                 // TODO: this is getting problematic.....
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.hasGeometry = true;
 
                 return mesh;
@@ -537,7 +772,7 @@ namespace webifc::geometry
 #endif
 
                 // TODO: this is getting problematic.....
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.hasGeometry = true;
                 mesh.transformation = position;
 
@@ -580,7 +815,7 @@ namespace webifc::geometry
                 int unitaryFaces = 0;
                 for (auto &child : mesh.children)
                 {
-                    auto temp = _expressIDToGeometry[child.expressID];
+                    auto &temp = _expressIDToGeometry[child.expressID];
                     if (temp.numFaces < 4)
                     {
                         unitaryFaces++;
@@ -592,11 +827,11 @@ namespace webifc::geometry
                 {
                     for (auto &child : mesh.children)
                     {
-                        auto temp = _expressIDToGeometry[child.expressID];
+                        auto &temp = _expressIDToGeometry[child.expressID];
                         newGeometry.AddGeometry(temp);
                     }
                     IfcComposedMesh newMesh;
-                    _expressIDToGeometry[expressID] = newGeometry;
+                    _expressIDToGeometry[expressID] = std::move(newGeometry);
                     std::optional<glm::dvec4> shellColor = GetStyleItemFromExpressId(expressID);
                     if (shellColor)
                     {
@@ -700,7 +935,7 @@ namespace webifc::geometry
                     spdlog::error("[GetMesh()] Unsupported IFCPOLYGONALFACESET with PnIndex {}", expressID);
                 }
 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -733,7 +968,7 @@ namespace webifc::geometry
                 }
                 else if (surface.CylinderSurface.Active)
                 {
-                    TriangulateCylindricalSurface(geometry, bounds3D, surface, _settings._circleSegments);
+                    TriangulateCylindricalSurface(geometry, bounds3D, surface, _geometryLoader.GetCircleSegments(surface.CylinderSurface.Radius));
                 }
                 else if (surface.RevolutionSurface.Active)
                 {
@@ -748,7 +983,7 @@ namespace webifc::geometry
                     TriangulateBounds(geometry, bounds3D, expressID);
                 }
 
-                _expressIDToGeometry[expressID] = geometry;
+                _expressIDToGeometry[expressID] = std::move(geometry);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -792,7 +1027,7 @@ namespace webifc::geometry
 
                 // DumpIfcGeometry(geom, "test.obj");
 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -875,7 +1110,7 @@ namespace webifc::geometry
                 IfcGeometry geom = Sweep(_geometryLoader.GetLinearScalingFactor(), closed, profile, directrix, surface.normal(), true);
 
                 mesh.transformation = placement;
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -914,7 +1149,7 @@ namespace webifc::geometry
                 );
 
                 // Store the geometry and update mesh
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
                 mesh.transformation = placement;
@@ -957,7 +1192,7 @@ namespace webifc::geometry
                 IfcCurve directrix = _geometryLoader.GetCurve(directrixRef, 3);
 
                 IfcProfile profile;
-                profile.curve = GetCircleCurve(radius, _settings._circleSegments);
+                profile.curve = GetCircleCurve(radius, _geometryLoader.GetCircleSegments(radius));
 
                 IfcGeometry geom = SweepCircular(_geometryLoader.GetLinearScalingFactor(), closed, profile, radius, directrix);
 
@@ -965,7 +1200,7 @@ namespace webifc::geometry
                 geom.sweptDiskSolid.profiles = std::vector<IfcProfile>{profile};
                 geom.sweptDiskSolid.profileRadius = radius;
 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -989,7 +1224,22 @@ namespace webifc::geometry
 
                 glm::dvec3 pos = _geometryLoader.GetAxis1Placement(axis1PlacementID)[1];
 
-                IfcCurve directrix = BuildArc(_geometryLoader.GetLinearScalingFactor(), pos, axis, angle, _settings._circleSegments);
+                // the profile point farthest from the axis follows the widest circle, so it sets the chord error
+                double sweepRadius = 0;
+                glm::dvec3 axisDir = glm::normalize(axis);
+                auto widenSweep = [&](const IfcCurve &curve) {
+                    for (auto &pt : curve.points)
+                    {
+                        sweepRadius = std::max(sweepRadius, glm::length(glm::cross(pt - pos, axisDir)));
+                    }
+                };
+                widenSweep(profile.curve);
+                for (auto &part : profile.profiles)
+                {
+                    widenSweep(part.curve);
+                }
+
+                IfcCurve directrix = BuildArc(_geometryLoader.GetLinearScalingFactor(), pos, axis, angle, _geometryLoader.GetCircleSegments(sweepRadius, angle));
                 if (glm::distance(directrix.points[0], directrix.points[directrix.points.size() - 1]) < EPS_BIG)
                 {
                     closed = true;
@@ -1012,7 +1262,7 @@ namespace webifc::geometry
                 }
 
                 mesh.transformation = placement;
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
                 if (!mesh.hasColor)
@@ -1030,7 +1280,8 @@ namespace webifc::geometry
                 double depth = _loader.GetDoubleArgument();
 
                 auto lineProfileType = _loader.GetLineType(profileID);
-                IfcProfile profile = _geometryLoader.GetProfile(profileID);
+                auto sharedProfile = _geometryLoader.GetSharedProfile(profileID);
+                const IfcProfile &profile = *sharedProfile;
                 if (!profile.isComposite)
                 {
                     if (profile.curve.points.empty())
@@ -1105,7 +1356,7 @@ namespace webifc::geometry
 //    io::DumpIfcGeometry(geom, "IFCEXTRUDEDAREASOLID_geom.obj");
 #endif
 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
 
@@ -1121,7 +1372,7 @@ namespace webifc::geometry
                 // Create a circular profile
                 IfcProfile profile;
                 profile.isConvex = true;
-                profile.curve = GetCircleCurve(radius, _settings._circleSegments);
+                profile.curve = GetCircleCurve(radius, _geometryLoader.GetCircleSegments(radius));
 
                 // Extrude along Z-axis
                 glm::dvec3 extrusionDir = glm::dvec3(0, 0, 1);
@@ -1137,7 +1388,7 @@ namespace webifc::geometry
                 io::DumpIfcGeometry(geom, "IFCRIGHTCIRCULARCYLINDER_geom.obj");
 #endif
 
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
                 mesh.expressID = expressID;
                 mesh.hasGeometry = true;
                 return mesh;
@@ -1176,7 +1427,7 @@ namespace webifc::geometry
                 geom.numPoints = 1;
                 geom.isPolygon = true;
                 mesh.hasGeometry = true;
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
 
                 return mesh;
             }
@@ -1200,7 +1451,7 @@ namespace webifc::geometry
                 geom.numPoints = edge.points.size();
                 geom.isPolygon = true;
                 mesh.hasGeometry = true;
-                _expressIDToGeometry[expressID] = geom;
+                _expressIDToGeometry[expressID] = std::move(geom);
 
                 return mesh;
             }
@@ -1232,7 +1483,7 @@ namespace webifc::geometry
                     geom.numPoints = curve.points.size();
                     geom.isPolygon = true;
                     mesh.hasGeometry = true;
-                    _expressIDToGeometry[expressID] = geom;
+                    _expressIDToGeometry[expressID] = std::move(geom);
                 }
 
                 return mesh;
@@ -1641,9 +1892,21 @@ namespace webifc::geometry
     IfcFlatMesh IfcGeometryProcessor::GetFlatMesh(uint32_t expressID, bool applyLinearScalingFactor)
     {
         spdlog::debug("[GetFlatMesh({})]", expressID);
+        const GeometryCopyStats copyStatsBefore = GetThreadGeometryCopyStats();
         IfcFlatMesh flatMesh;
         flatMesh.expressID = expressID;
 
+        uint64_t matrixKey = 0;
+        if (_geometryCache)
+        {
+            matrixKey = FlatMeshMatrixKey(applyLinearScalingFactor);
+            if (ReadCachedFlatMesh(expressID, matrixKey, flatMesh))
+            {
+                UpdateElementIndex(flatMesh);
+                return flatMesh;
+            }
+        }
+
         IfcComposedMesh composedMesh = GetMesh(expressID);
 
         glm::dmat4 mat = glm::dmat4(1);
@@ -1657,125 +1920,1641 @@ namespace webifc::geometry
         bool hasColor = false;
         AddComposedMeshToFlatMesh(flatMesh, composedMesh, _transformation * NormalizeIFC * mat, color, hasColor);
 
+        if (_settings._maxElementTriangles > 0)
+        {
+            uint64_t triangles = 0;
+            for (auto &placed : flatMesh.geometries)
+            {
+                const IfcGeometry *geometry = FindGeometry(placed.geometryExpressID);
+                triangles += geometry != nullptr ? geometry->numFaces : 0;
+            }
+            if (triangles > _settings._maxElementTriangles)
+            {
+                ReplaceWithBoundingBox(flatMesh, triangles);
+            }
+        }
+        flatMesh.fallback = _complexityFallbacks.contains(expressID);
+        if (flatMesh.fallback)
+        {
+            spdlog::warn("[GetFlatMesh({})] over the complexity limits, using a fallback representation", expressID);
+        }
+
+        const GeometryCopyStats &copyStats = GetThreadGeometryCopyStats();
+        _copyStats.copies += copyStats.copies - copyStatsBefore.copies;
+        _copyStats.bytes += copyStats.bytes - copyStatsBefore.bytes;
+        spdlog::debug("[GetFlatMesh({})] {} geometry copies, {} bytes", expressID, copyStats.copies - copyStatsBefore.copies, copyStats.bytes - copyStatsBefore.bytes);
+
+        // fallbacks are not cached, so raising the limits takes effect on the next run
+        if (_geometryCache && !flatMesh.fallback)
+        {
+            CacheFlatMesh(flatMesh, matrixKey);
+        }
+        UpdateElementIndex(flatMesh);
+
         return flatMesh;
     }
 
-    void IfcGeometryProcessor::AddComposedMeshToFlatMesh(IfcFlatMesh &flatMesh, const IfcComposedMesh &composedMesh, const glm::dmat4 &parentMatrix, const glm::dvec4 &color, bool hasColor)
+    void IfcGeometryProcessor::SetGeometryCache(const std::string &path)
     {
-
-        glm::dvec4 newParentColor = color;
-        bool newHasColor = hasColor;
-        glm::dmat4 newMatrix = parentMatrix * composedMesh.transformation;
-
-        if (composedMesh.hasColor && !hasColor)
+        auto cache = std::make_unique<IfcGeometryCache>(path);
+        if (!cache->IsOpen())
         {
-            newHasColor = true;
-            newParentColor = composedMesh.color;
+            return;
+        }
+        // the cached transformations already contain the coordination matrix of the run that wrote them
+        glm::dmat4 coordination;
+        if (cache->ReadCoordination(coordination))
+        {
+            _coordinationMatrix = coordination;
+            _isCoordinated = true;
         }
+        _geometryCache = std::move(cache);
+    }
 
-        if (composedMesh.hasGeometry)
+    uint64_t IfcGeometryProcessor::FlatMeshMatrixKey(bool applyLinearScalingFactor) const
+    {
+        // the parent matrix GetFlatMesh() starts from, cached elements are only valid for the one they were written with
+        glm::dmat4 mat = glm::dmat4(1);
+        if (applyLinearScalingFactor)
         {
-            IfcPlacedGeometry geometry;
+            mat = glm::scale(glm::dvec3(_geometryLoader.GetLinearScalingFactor()));
+        }
+        return IfcGeometryCache::MatrixKey(_transformation * NormalizeIFC * mat);
+    }
 
-            if (!_isCoordinated && _settings._coordinateToOrigin)
+    bool IfcGeometryProcessor::ReadCachedFlatMesh(uint32_t expressID, uint64_t matrixKey, IfcFlatMesh &flatMesh)
+    {
+        if (!_geometryCache->ReadFlatMesh(expressID, matrixKey, flatMesh))
+        {
+            flatMesh.geometries.clear();
+            return false;
+        }
+        for (auto &geometry : flatMesh.geometries)
+        {
+            if (_expressIDToGeometry.contains(geometry.geometryExpressID))
             {
-                auto &geom = _expressIDToGeometry[composedMesh.expressID];
-                if (geom.numPoints > 0)
-                {
-                    auto pt = geom.GetPoint(0);
-                    auto transformedPt = newMatrix * glm::dvec4(pt, 1);
-                    _coordinationMatrix = glm::translate(-glm::dvec3(transformedPt));
-                    _isCoordinated = true;
-                }
+                continue;
+            }
+            IfcGeometry cached;
+            if (!_geometryCache->ReadGeometry(geometry.geometryExpressID, cached))
+            {
+                spdlog::warn("[ReadCachedFlatMesh({})] geometry {} missing from the cache, generating it again", expressID, geometry.geometryExpressID);
+                flatMesh.geometries.clear();
+                return false;
             }
+            _expressIDToGeometry[geometry.geometryExpressID] = std::move(cached);
+        }
+        return true;
+    }
 
-            auto geom = _expressIDToGeometry[composedMesh.expressID];
-            if (geom.isPolygon)
+    void IfcGeometryProcessor::CacheFlatMesh(const IfcFlatMesh &flatMesh, uint64_t matrixKey)
+    {
+        // geometries go first, an element record is only ever read back once everything it points at is on disk
+        for (auto &geometry : flatMesh.geometries)
+        {
+            if (!_geometryCache->HasGeometry(geometry.geometryExpressID))
             {
-                if (!_settings._exportPolylines)
-                {
-                    return; // only triangles
-                }
+                _geometryCache->WriteGeometry(geometry.geometryExpressID, _expressIDToGeometry[geometry.geometryExpressID]);
             }
-            if (geometry.testReverse())
-                geom.ReverseFaces();
+        }
+        if (_isCoordinated && !_geometryCache->HasCoordination())
+        {
+            _geometryCache->WriteCoordination(_coordinationMatrix);
+        }
+        _geometryCache->WriteFlatMesh(flatMesh, matrixKey);
+    }
 
-            auto translation = glm::dmat4(1.0);
+    const GeometryCopyStats &IfcGeometryProcessor::GetCopyStats() const
+    {
+        return _copyStats;
+    }
+
+    const VertexWeldStats &IfcGeometryProcessor::GetWeldStats() const
+    {
+        return _weldStats;
+    }
 
-            translation = geom.Normalize();
+    glm::dmat4 IfcGeometryProcessor::PrepareRetainedGeometry(IfcGeometry &geom)
+    {
+        // both steps happen once, later calls return the same translation
+        glm::dmat4 translation = geom.Normalize();
+        if (_settings._vertexWeldTolerance > 0)
+        {
+            VertexWeldStats weldStats = geom.WeldVertices(_settings._vertexWeldTolerance / _geometryLoader.GetLinearScalingFactor());
+            _weldStats.geometries += weldStats.geometries;
+            _weldStats.verticesBefore += weldStats.verticesBefore;
+            _weldStats.verticesAfter += weldStats.verticesAfter;
+            _weldStats.bytesSaved += weldStats.bytesSaved;
+            spdlog::debug("[WeldVertices()] {} vertices welded to {}", weldStats.verticesBefore, weldStats.verticesAfter);
+        }
+        return translation;
+    }
 
-            _expressIDToGeometry[composedMesh.expressID] = geom;
+    uint32_t IfcGeometryProcessor::DeduplicateGeometry(const IfcComposedMesh &composedMesh, const glm::dmat4 &translation)
+    {
+        uint32_t expressID = composedMesh.expressID;
+        const IfcGeometry *found = FindGeometry(expressID);
+        if (found == nullptr || !found->part.empty() || found->numFaces == 0)
+        {
+            return expressID;
+        }
+        const IfcGeometry &geom = *found;
 
-            if (!composedMesh.hasColor)
+        IfcGeometryAlias alias = {expressID, translation, composedMesh.children.empty(), composedMesh.transformation, composedMesh.color, composedMesh.hasColor};
+        uint64_t hash = geom.ContentHash();
+        // candidates of a lent table are older, they come first like they did before it was lent
+        std::vector<uint32_t> inheritedCandidates;
+        if (_inherited)
+        {
+            auto inheritedIt = _inherited->geometryHashes.find(hash);
+            if (inheritedIt != _inherited->geometryHashes.end())
             {
-                geometry.color = newParentColor;
+                inheritedCandidates = inheritedIt->second;
             }
-            else
+        }
+        auto &candidates = _geometryHashes[hash];
+        for (auto *candidateIDs : {&inheritedCandidates, &candidates})
+        {
+            for (uint32_t candidateID : *candidateIDs)
             {
-                geometry.color = composedMesh.color;
-                newParentColor = composedMesh.color;
-                newHasColor = composedMesh.hasColor;
+                if (candidateID == expressID)
+                {
+                    return expressID;
+                }
+                const IfcGeometry *candidate = FindGeometry(candidateID);
+                if (candidate != nullptr && candidate->SameContent(geom))
+                {
+                    alias.geometryExpressID = candidateID;
+                    _geometryAliases[expressID] = alias;
+                    _retainedGeometryLru.Touch(RETAINED_UNIQUE | candidateID, 0);
+                    if (!IsMappedGeometry(expressID))
+                    {
+                        _expressIDToGeometry.erase(expressID);
+                    }
+                    return candidateID;
+                }
             }
+        }
 
-            geometry.transformation = _coordinationMatrix * newMatrix * translation;
+        // only the hash and the normalized buffers are kept, the item is not tessellated again while they are; lent
+        // geometry is not charged to a worker
+        candidates.push_back(expressID);
+        _uniqueGeometryIDs.insert(expressID);
+        _uniqueGeometryHashes[expressID] = hash;
+        _geometryAliases[expressID] = alias;
+        _retainedGeometryLru.Touch(RETAINED_UNIQUE | expressID, _expressIDToGeometry.contains(expressID) ? GeometryBytes(geom) : 0);
+        return expressID;
+    }
 
-            geometry.SetFlatTransformation();
-            geometry.geometryExpressID = composedMesh.expressID;
+    bool IfcGeometryProcessor::IsRetainedAlias(const IfcGeometryAlias &alias) const
+    {
+        return IsUniqueGeometry(alias.geometryExpressID) && FindGeometry(alias.geometryExpressID) != nullptr;
+    }
 
-            flatMesh.geometries.push_back(geometry);
+    const IfcGeometry *IfcGeometryProcessor::FindGeometry(uint32_t expressID) const
+    {
+        auto geometryIt = _expressIDToGeometry.find(expressID);
+        if (geometryIt != _expressIDToGeometry.end())
+        {
+            return &geometryIt->second;
         }
-        else if (composedMesh.hasColor)
+        if (_inherited)
         {
-            newParentColor = composedMesh.color;
-            newHasColor = composedMesh.hasColor;
+            auto inheritedIt = _inherited->geometries.find(expressID);
+            if (inheritedIt != _inherited->geometries.end())
+            {
+                return &inheritedIt->second;
+            }
         }
+        return nullptr;
+    }
 
-        for (auto &c : composedMesh.children)
+    const IfcGeometryAlias *IfcGeometryProcessor::FindAlias(uint32_t expressID) const
+    {
+        auto aliasIt = _geometryAliases.find(expressID);
+        if (aliasIt != _geometryAliases.end())
         {
-            AddComposedMeshToFlatMesh(flatMesh, c, newMatrix, newParentColor, newHasColor);
+            return &aliasIt->second;
         }
+        if (_inherited)
+        {
+            auto inheritedIt = _inherited->geometryAliases.find(expressID);
+            if (inheritedIt != _inherited->geometryAliases.end())
+            {
+                return &inheritedIt->second;
+            }
+        }
+        return nullptr;
     }
 
-    IfcGeometry IfcGeometryProcessor::BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, std::string op, IfcGeometrySettings _settings)
+    bool IfcGeometryProcessor::IsMappedGeometry(uint32_t expressID) const
     {
-        return _boolEngine.BoolProcess(firstGeoms, secondGeoms, op, _settings);
+        return _mappedGeometryIDs.contains(expressID) || (_inherited && _inherited->mappedGeometryIDs.contains(expressID));
     }
 
-    std::vector<uint32_t> IfcGeometryProcessor::Read2DArrayOfThreeIndices()
+    bool IfcGeometryProcessor::IsUniqueGeometry(uint32_t expressID) const
     {
-        std::vector<uint32_t> result;
+        return _uniqueGeometryIDs.contains(expressID) || (_inherited && _inherited->uniqueGeometryIDs.contains(expressID));
+    }
 
-        _loader.GetTokenType();
+    const std::unordered_map<uint32_t, IfcGeometry> *IfcGeometryProcessor::InheritedGeometries() const
+    {
+        return _inherited ? &_inherited->geometries : nullptr;
+    }
 
-        // while we have point set begin
-        while (_loader.GetTokenType() == parsing::IfcTokenType::SET_BEGIN)
+    void IfcGeometryProcessor::LendRetainedGeometry()
+    {
+        // moved rather than copied, the workers only read it and the processor looks it up there as well
+        _lent = std::make_shared<IfcRetainedGeometry>();
+        auto lend = [&](uint32_t geometryID)
         {
-            result.push_back((uint32_t)_loader.GetIntArgument());
-            result.push_back((uint32_t)_loader.GetIntArgument());
-            result.push_back((uint32_t)_loader.GetIntArgument());
-
-            // read point set end
-            _loader.GetTokenType();
+            auto node = _expressIDToGeometry.extract(geometryID);
+            if (!node.empty())
+            {
+                _lent->geometries.insert(std::move(node));
+            }
+        };
+        for (auto &[geometryID, count] : _mappedGeometryIDs)
+        {
+            lend(geometryID);
         }
-
-        return result;
+        for (uint32_t geometryID : _uniqueGeometryIDs)
+        {
+            lend(geometryID);
+        }
+        _lent->mappedRepresentations = std::move(_mappedRepresentations);
+        _lent->mappedGeometryIDs = std::move(_mappedGeometryIDs);
+        _lent->geometryHashes = std::move(_geometryHashes);
+        _lent->geometryAliases = std::move(_geometryAliases);
+        _lent->uniqueGeometryIDs = std::move(_uniqueGeometryIDs);
+        _lent->uniqueGeometryHashes = std::move(_uniqueGeometryHashes);
+        _lent->mappedBounds = std::move(_mappedBounds);
+        _mappedRepresentations.clear();
+        _mappedGeometryIDs.clear();
+        _geometryHashes.clear();
+        _geometryAliases.clear();
+        _uniqueGeometryIDs.clear();
+        _uniqueGeometryHashes.clear();
+        _mappedBounds.clear();
+        _inherited = _lent;
     }
 
-    void IfcGeometryProcessor::ReadIndexedPolygonalFace(uint32_t expressID, std::vector<IfcBound3D> &bounds, const std::vector<glm::dvec3> &points)
+    void IfcGeometryProcessor::ReturnRetainedGeometry()
     {
-
-        spdlog::debug("[ReadIndexedPolygonalFace({})]", expressID);
-        auto lineType = _loader.GetLineType(expressID);
-
-        bounds.emplace_back();
-
-        switch (lineType)
+        // the workers are gone, entries made in the meantime are newer and win over the lent ones
+        _inherited.reset();
+        IfcRetainedGeometry &lent = *_lent;
+        _expressIDToGeometry.merge(lent.geometries);
+        _mappedRepresentations.merge(lent.mappedRepresentations);
+        for (auto &[geometryID, count] : lent.mappedGeometryIDs)
         {
-        case schema::IFCINDEXEDPOLYGONALFACEWITHVOIDS:
-        case schema::IFCINDEXEDPOLYGONALFACE:
+            _mappedGeometryIDs[geometryID] += count;
+        }
+        for (auto &[hash, lentCandidates] : lent.geometryHashes)
         {
-            _loader.MoveToArgumentOffset(expressID, 0);
-            auto indexIDs = _loader.GetSetArgument();
+            auto &candidates = _geometryHashes[hash];
+            candidates.insert(candidates.begin(), lentCandidates.begin(), lentCandidates.end());
+        }
+        _geometryAliases.merge(lent.geometryAliases);
+        _uniqueGeometryIDs.merge(lent.uniqueGeometryIDs);
+        _uniqueGeometryHashes.merge(lent.uniqueGeometryHashes);
+        _mappedBounds.merge(lent.mappedBounds);
+        _lent.reset();
+    }
+
+    void IfcGeometryProcessor::DropUniqueGeometry(uint32_t expressID)
+    {
+        // copies still pointing at it are found out by IsRetainedAlias() and tessellated again
+        _uniqueGeometryIDs.erase(expressID);
+        _geometryAliases.erase(expressID);
+        auto hashIt = _uniqueGeometryHashes.find(expressID);
+        if (hashIt != _uniqueGeometryHashes.end())
+        {
+            auto candidatesIt = _geometryHashes.find(hashIt->second);
+            if (candidatesIt != _geometryHashes.end())
+            {
+                std::erase(candidatesIt->second, expressID);
+                if (candidatesIt->second.empty())
+                {
+                    _geometryHashes.erase(candidatesIt);
+                }
+            }
+            _uniqueGeometryHashes.erase(hashIt);
+        }
+        if (!_mappedGeometryIDs.contains(expressID))
+        {
+            _expressIDToGeometry.erase(expressID);
+        }
+    }
+
+    void IfcGeometryProcessor::DropMappedRepresentation(uint32_t representationID)
+    {
+        // the next IfcMappedItem tessellates the map again
+        auto mappedIt = _mappedRepresentations.find(representationID);
+        if (mappedIt == _mappedRepresentations.end())
+        {
+            return;
+        }
+        for (uint32_t geometryID : mappedIt->second.geometryIDs)
+        {
+            auto countIt = _mappedGeometryIDs.find(geometryID);
+            if (countIt == _mappedGeometryIDs.end() || --countIt->second > 0)
+            {
+                continue;
+            }
+            _mappedGeometryIDs.erase(countIt);
+            if (!_uniqueGeometryIDs.contains(geometryID))
+            {
+                _expressIDToGeometry.erase(geometryID);
+            }
+        }
+        _mappedRepresentations.erase(mappedIt);
+    }
+
+    size_t IfcGeometryProcessor::GetFlatMeshes(const std::vector<uint32_t> &expressIDs, uint32_t threads, const std::function<void(IfcFlatMesh &, size_t, size_t)> &callback, const std::function<bool(size_t)> &stop)
+    {
+        spdlog::debug("[GetFlatMeshes({})]", expressIDs.size());
+        const size_t total = expressIDs.size();
+        size_t next = 0;
+
+        // the coordination matrix is taken from the first geometry produced, so that part always runs serially
+        while (next < total && _settings._coordinateToOrigin && !_isCoordinated)
+        {
+            if (IsCancelled(next, total) || (stop && stop(next)))
+            {
+                return next;
+            }
+            IfcFlatMesh mesh = GetFlatMesh(expressIDs[next]);
+            callback(mesh, next, total);
+            next++;
+        }
+
+        // deduplication depends on the order geometries are seen in, and clones need the whole tape in memory; a run
+        // started from a callback of another would run inline anyway, its retained geometry is lent out already
+        threads = std::min(threads, webifc::parallel::GetHardwareThreads());
+        if (threads <= 1 || total - next < 2 || _settings._deduplicateGeometry || _lent || !_loader.PrepareForClones())
+        {
+            for (; next < total; next++)
+            {
+                if (IsCancelled(next, total) || (stop && stop(next)))
+                {
+                    break;
+                }
+                IfcFlatMesh mesh = GetFlatMesh(expressIDs[next]);
+                callback(mesh, next, total);
+            }
+            return next;
+        }
+
+        // every worker gets its own reader and processor, the model wide tables and the retained geometry are shared
+        _geometryLoader.BuildPlacementGraph();
+        LendRetainedGeometry();
+        std::vector<std::unique_ptr<parsing::IfcLoader>> workerLoaders;
+        std::vector<std::unique_ptr<IfcGeometryProcessor>> workers;
+        for (uint32_t i = 0; i < threads; i++)
+        {
+            workerLoaders.emplace_back(_loader.Clone());
+            workers.emplace_back(Clone(*workerLoaders.back()));
+            workers.back()->Clear();
+            workers.back()->_copyStats = GeometryCopyStats();
+            workers.back()->_weldStats = VertexWeldStats();
+        }
+
+        struct WorkerResult
+        {
+            IfcFlatMesh mesh;
+            std::vector<std::pair<uint32_t, IfcGeometry>> geometries;
+            std::vector<IfcComplexityFallback> fallbacks;
+        };
+
+        // results are handed over in input order, which keeps the output identical to a serial run; at most `window`
+        // elements past the next one to deliver are admitted, and of those the most expensive are started first
+        enum class SlotState
+        {
+            QUEUED,
+            RUNNING,
+            READY,
+            CACHED
+        };
+        struct Slot
+        {
+            WorkerResult result;
+            SlotState state = SlotState::QUEUED;
+            uint64_t cost = 0;
+        };
+        const size_t window = static_cast<size_t>(threads) * 32;
+        std::vector<Slot> slots(window);
+        auto moreExpensive = [](const std::pair<uint64_t, size_t> &a, const std::pair<uint64_t, size_t> &b) { return a.first != b.first ? a.first > b.first : a.second < b.second; };
+        std::set<std::pair<uint64_t, size_t>, decltype(moreExpensive)> queued(moreExpensive);
+        std::mutex mutex;
+        std::condition_variable condition;
+        const uint64_t matrixKey = _geometryCache ? FlatMeshMatrixKey(true) : 0;
+        size_t delivered = next;
+        size_t admitted = next;
+        bool done = delivered == total;
+
+        // elements found in the geometry cache are not queued at all, they are read back on the calling thread
+        auto admit = [&]() {
+            for (; admitted < total && admitted < delivered + window; admitted++)
+            {
+                Slot &slot = slots[admitted % window];
+                slot.result = WorkerResult();
+                if (_geometryCache && _geometryCache->HasFlatMesh(expressIDs[admitted], matrixKey))
+                {
+                    slot.state = SlotState::CACHED;
+                    continue;
+                }
+                slot.state = SlotState::QUEUED;
+                slot.cost = EstimateCost(expressIDs[admitted]);
+                queued.emplace(slot.cost, admitted);
+            }
+        };
+
+        // a full window only moves once its first element is delivered, so that one is taken ahead of the rest
+        auto take = [&]() {
+            auto it = queued.begin();
+            if (admitted == delivered + window)
+            {
+                auto head = queued.find({slots[delivered % window].cost, delivered});
+                if (head != queued.end())
+                {
+                    it = head;
+                }
+            }
+            size_t i = it->second;
+            queued.erase(it);
+            slots[i % window].state = SlotState::RUNNING;
+            return i;
+        };
+
+        auto generate = [&](IfcGeometryProcessor &processor, size_t i, WorkerResult &result) {
+            result.mesh = processor.GetFlatMesh(expressIDs[i]);
+            for (auto &[fallbackID, fallback] : processor._complexityFallbacks)
+            {
+                result.fallbacks.push_back(fallback);
+            }
+            processor._complexityFallbacks.clear();
+            for (auto &geometry : result.mesh.geometries)
+            {
+                uint32_t geometryExpressID = geometry.geometryExpressID;
+                if (std::any_of(result.geometries.begin(), result.geometries.end(), [&](const auto &entry) { return entry.first == geometryExpressID; }))
+                {
+                    continue;
+                }
+                // lent geometry is found by the calling thread as it is, Clear() drops everything but the mapped
+                // geometries and those stay with the worker
+                auto geometryIt = processor._expressIDToGeometry.find(geometryExpressID);
+                if (geometryIt == processor._expressIDToGeometry.end())
+                {
+                    continue;
+                }
+                if (processor._mappedGeometryIDs.contains(geometryExpressID))
+                {
+                    result.geometries.emplace_back(geometryExpressID, geometryIt->second);
+                }
+                else
+                {
+                    result.geometries.emplace_back(geometryExpressID, std::move(geometryIt->second));
+                }
+            }
+            processor.Clear();
+        };
+
+        auto deliver = [&](size_t i, WorkerResult &result, bool fromCache) {
+            if (fromCache)
+            {
+                result.mesh = GetFlatMesh(expressIDs[i]);
+                callback(result.mesh, i, total);
+                return;
+            }
+            for (auto &[geometryExpressID, geometry] : result.geometries)
+            {
+                _expressIDToGeometry[geometryExpressID] = std::move(geometry);
+            }
+            result.geometries.clear();
+            for (auto &fallback : result.fallbacks)
+            {
+                ReportFallback(fallback);
+            }
+            if (_geometryCache && !result.mesh.fallback)
+            {
+                CacheFlatMesh(result.mesh, matrixKey);
+            }
+            UpdateElementIndex(result.mesh);
+            callback(result.mesh, i, total);
+        };
+
+        admit();
+        // the threads live for the whole stream; the calling thread delivers, and works on the queue while it waits
+        webifc::parallel::ThreadPool::Shared().Run(threads, [&](uint32_t worker) {
+            IfcGeometryProcessor &processor = *workers[worker];
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                if (worker == 0 && delivered < total && (slots[delivered % window].state == SlotState::READY || slots[delivered % window].state == SlotState::CACHED))
+                {
+                    Slot &slot = slots[delivered % window];
+                    WorkerResult result = std::move(slot.result);
+                    bool fromCache = slot.state == SlotState::CACHED;
+                    lock.unlock();
+                    bool cancelled = IsCancelled(delivered, total) || (stop && stop(delivered));
+                    if (!cancelled)
+                    {
+                        deliver(delivered, result, fromCache);
+                    }
+                    lock.lock();
+                    if (cancelled)
+                    {
+                        done = true;
+                    }
+                    else
+                    {
+                        delivered++;
+                        admit();
+                        done = delivered == total;
+                    }
+                    condition.notify_all();
+                }
+                else if (done)
+                {
+                    return;
+                }
+                else if (!queued.empty())
+                {
+                    size_t i = take();
+                    lock.unlock();
+                    // once cancelled nothing is generated any more, the calling thread stops at the next delivery
+                    WorkerResult result;
+                    if (_cancellation == nullptr || !_cancellation->IsCancelled())
+                    {
+                        generate(processor, i, result);
+                    }
+                    lock.lock();
+                    slots[i % window].result = std::move(result);
+                    slots[i % window].state = SlotState::READY;
+                    condition.notify_all();
+                }
+                else
+                {
+                    condition.wait(lock);
+                }
+            }
+        });
+
+        for (auto &worker : workers)
+        {
+            _copyStats.copies += worker->_copyStats.copies;
+            _copyStats.bytes += worker->_copyStats.bytes;
+            _weldStats.geometries += worker->_weldStats.geometries;
+            _weldStats.verticesBefore += worker->_weldStats.verticesBefore;
+            _weldStats.verticesAfter += worker->_weldStats.verticesAfter;
+            _weldStats.bytesSaved += worker->_weldStats.bytesSaved;
+        }
+
+        // the clones share tape chunks with _loader, they have to be gone before it evicts anything
+        workers.clear();
+        workerLoaders.clear();
+        ReturnRetainedGeometry();
+        return delivered;
+    }
+
+    bool IfcGeometryProcessor::IsCancelled(size_t done, size_t total)
+    {
+        if (_cancellation == nullptr)
+        {
+            return false;
+        }
+        if (done % PROGRESS_INTERVAL == 0)
+        {
+            return _cancellation->Report({0, done, total});
+        }
+        return _cancellation->IsCancelled();
+    }
+
+    void IfcGeometryProcessor::SetComplexityLimits(uint32_t maxBooleanOperands, uint32_t maxTriangles, double timeLimitMs)
+    {
+        _settings._maxBooleanOperands = maxBooleanOperands;
+        _settings._maxElementTriangles = maxTriangles;
+        _settings._elementTimeLimitMs = timeLimitMs;
+    }
+
+    std::vector<IfcComplexityFallback> IfcGeometryProcessor::GetComplexityReport() const
+    {
+        // in expressID order, which does not depend on the order or the threads the elements were generated with
+        std::vector<IfcComplexityFallback> report;
+        report.reserve(_complexityFallbacks.size());
+        for (auto &[expressID, fallback] : _complexityFallbacks)
+        {
+            report.push_back(fallback);
+        }
+        std::sort(report.begin(), report.end(), [](const auto &a, const auto &b) { return a.expressID < b.expressID; });
+        return report;
+    }
+
+    void IfcGeometryProcessor::ReportFallback(const IfcComplexityFallback &fallback)
+    {
+        _complexityFallbacks[fallback.expressID] = fallback;
+    }
+
+    IfcGeometry IfcGeometryProcessor::MergeGeometries(const std::vector<IfcGeometry> &geoms)
+    {
+        IfcGeometry merged;
+        for (auto &geom : geoms)
+        {
+            merged.AddGeometry(geom);
+        }
+        return merged;
+    }
+
+    void IfcGeometryProcessor::ReplaceWithBoundingBox(IfcFlatMesh &flatMesh, uint64_t triangles)
+    {
+        IfcElementBounds bounds;
+        for (auto &placed : flatMesh.geometries)
+        {
+            const IfcGeometry *geom = FindGeometry(placed.geometryExpressID);
+            if (geom == nullptr)
+            {
+                continue;
+            }
+            for (uint32_t i = 0; i < geom->numPoints; i++)
+            {
+                bounds.Merge(glm::dvec3(placed.transformation * glm::dvec4(geom->GetVertex(i), 1)));
+            }
+        }
+        if (bounds.IsEmpty())
+        {
+            return;
+        }
+
+        // built around the centre of the box, so the float vertex data keeps its precision far from the origin
+        glm::dvec3 center = (bounds.min + bounds.max) * 0.5;
+        glm::dvec3 lo = bounds.min - center;
+        glm::dvec3 hi = bounds.max - center;
+        std::array<glm::dvec3, 8> corners;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            corners[i] = glm::dvec3(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z);
+        }
+        // two outward facing triangles per side, corners indexed by their x, y, z bits
+        constexpr uint32_t quads[6][4] = {{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}};
+        IfcGeometry box;
+        for (auto &quad : quads)
+        {
+            box.AddFace(corners[quad[0]], corners[quad[1]], corners[quad[2]]);
+            box.AddFace(corners[quad[0]], corners[quad[2]], corners[quad[3]]);
+        }
+
+        // stored past the last express ID, so the box never replaces a geometry another element shares
+        uint32_t boxID = _loader.GetMaxExpressId() + flatMesh.expressID;
+        _expressIDToGeometry[boxID] = std::move(box);
+
+        IfcPlacedGeometry placed;
+        placed.color = flatMesh.geometries.empty() ? glm::dvec4(1) : flatMesh.geometries.front().color;
+        placed.transformation = glm::translate(center);
+        placed.SetFlatTransformation();
+        placed.geometryExpressID = boxID;
+        flatMesh.geometries.clear();
+        flatMesh.geometries.push_back(placed);
+
+        ReportFallback({flatMesh.expressID, FALLBACK_TRIANGLES, 0, triangles, 0});
+    }
+
+    void IfcGeometryProcessor::SetCancellationToken(parsing::IfcCancellationToken *cancellation)
+    {
+        _cancellation = cancellation;
+    }
+
+    uint64_t IfcGeometryProcessor::EstimateCost(uint32_t expressID) const
+    {
+        // rough relative cost of GetFlatMesh(expressID): one unit per face, a fixed amount per procedural item
+        // and per boolean operation, reading it only touches the first levels of the representation
+        uint64_t cost = 1;
+        if (!_loader.IsValidExpressID(expressID) || !_schemaManager.IsIfcElement(_loader.GetLineType(expressID)))
+        {
+            return cost;
+        }
+
+        uint32_t ifcPresentation = _loader.GetRefAttribute(expressID, 6);
+        if (ifcPresentation != 0 && _loader.IsValidExpressID(ifcPresentation))
+        {
+            cost += EstimateItemCost(ifcPresentation, 0);
+        }
+
+        auto &relVoids = _geometryLoader.GetRelVoids();
+        auto relVoidsIt = relVoids.find(expressID);
+        if (relVoidsIt != relVoids.end())
+        {
+            uint64_t voids = relVoidsIt->second.size();
+            cost += voids * BOOLEAN_COST;
+            if (voids > _settings._BOOLEAN_UNION_THRESHOLD)
+            {
+                cost += voids * BOOLEAN_COST;
+            }
+        }
+
+        return cost;
+    }
+
+    uint64_t IfcGeometryProcessor::EstimateItemCost(uint32_t expressID, uint32_t depth) const
+    {
+        if (depth > 8 || !_loader.IsValidExpressID(expressID))
+        {
+            return 0;
+        }
+
+        auto sumRefs = [&](uint32_t argumentIndex) {
+            uint64_t cost = 0;
+            _loader.MoveToArgumentOffset(expressID, argumentIndex);
+            auto refs = _loader.GetSetArgument();
+            for (auto &refToken : refs)
+            {
+                cost += EstimateItemCost(_loader.GetRefArgument(refToken), depth + 1);
+            }
+            return cost;
+        };
+
+        auto countItems = [&](uint32_t argumentIndex) -> uint64_t {
+            _loader.MoveToArgumentOffset(expressID, argumentIndex);
+            return _loader.GetSetArgument().size();
+        };
+
+        switch (_loader.GetLineType(expressID))
+        {
+        case schema::IFCPRODUCTREPRESENTATION:
+        case schema::IFCPRODUCTDEFINITIONSHAPE:
+            return sumRefs(2);
+        case schema::IFCTOPOLOGYREPRESENTATION:
+        case schema::IFCSHAPEREPRESENTATION:
+            return sumRefs(3);
+        case schema::IFCFACETEDBREP:
+        case schema::IFCADVANCEDBREP:
+        {
+            uint32_t shell = _loader.GetRefAttribute(expressID, 0);
+            if (!_loader.IsValidExpressID(shell))
+            {
+                return ITEM_COST;
+            }
+            _loader.MoveToArgumentOffset(shell, 0);
+            return ITEM_COST + _loader.GetSetArgument().size();
+        }
+        case schema::IFCTRIANGULATEDFACESET:
+            return ITEM_COST + countItems(3) / 3;
+        case schema::IFCPOLYGONALFACESET:
+            return ITEM_COST + countItems(2);
+        case schema::IFCBOOLEANRESULT:
+        case schema::IFCBOOLEANCLIPPINGRESULT:
+            return BOOLEAN_COST + EstimateItemCost(_loader.GetRefAttribute(expressID, 1), depth + 1) + EstimateItemCost(_loader.GetRefAttribute(expressID, 2), depth + 1);
+        default:
+            return ITEM_COST;
+        }
+    }
+
+    IfcElementBounds IfcGeometryProcessor::GetElementBounds(uint32_t expressID)
+    {
+        spdlog::debug("[GetElementBounds({})]", expressID);
+        IfcElementBounds bounds;
+        bounds.expressID = expressID;
+
+        // same parent matrix as GetFlatMesh(), so the boxes enclose the streamed meshes
+        glm::dmat4 mat = glm::scale(glm::dvec3(_geometryLoader.GetLinearScalingFactor()));
+        AddItemBounds(expressID, _coordinationMatrix * _transformation * NormalizeIFC * mat, bounds, 0);
+
+        return bounds;
+    }
+
+    std::vector<IfcElementBounds> IfcGeometryProcessor::GetElementBounds(const std::vector<uint32_t> &expressIDs, uint32_t threads)
+    {
+        spdlog::debug("[GetElementBounds({})]", expressIDs.size());
+        std::vector<IfcElementBounds> bounds(expressIDs.size());
+
+        // meshes take the coordination matrix from the first geometry they produce, the boxes have to use the same one
+        for (size_t i = 0; i < expressIDs.size() && _settings._coordinateToOrigin && !_isCoordinated; i++)
+        {
+            GetFlatMesh(expressIDs[i]);
+        }
+
+        threads = std::min(threads, webifc::parallel::GetHardwareThreads());
+        if (threads <= 1 || expressIDs.size() < 2 || _lent || !_loader.PrepareForClones())
+        {
+            for (size_t i = 0; i < expressIDs.size(); i++)
+            {
+                bounds[i] = GetElementBounds(expressIDs[i]);
+            }
+            return bounds;
+        }
+
+        _geometryLoader.BuildPlacementGraph();
+        LendRetainedGeometry();
+        std::vector<std::unique_ptr<parsing::IfcLoader>> workerLoaders;
+        std::vector<std::unique_ptr<IfcGeometryProcessor>> workers;
+        for (uint32_t i = 0; i < threads; i++)
+        {
+            workerLoaders.emplace_back(_loader.Clone());
+            workers.emplace_back(Clone(*workerLoaders.back()));
+            workers.back()->Clear();
+        }
+
+        webifc::parallel::WorkStealingFor(expressIDs.size(), threads, [&](size_t i, uint32_t worker) {
+            IfcGeometryProcessor &processor = *workers[worker];
+            bounds[i] = processor.GetElementBounds(expressIDs[i]);
+            processor.Clear();
+        });
+
+        // the clones share tape chunks with _loader, they have to be gone before it evicts anything
+        workers.clear();
+        workerLoaders.clear();
+        ReturnRetainedGeometry();
+        return bounds;
+    }
+
+    void IfcGeometryProcessor::BuildElementIndex(const std::vector<uint32_t> &expressIDs, uint32_t threads)
+    {
+        _elementIndex.Build(GetElementBounds(expressIDs, threads));
+    }
+
+    IfcElementBVH &IfcGeometryProcessor::GetElementIndex()
+    {
+        return _elementIndex;
+    }
+
+    void IfcGeometryProcessor::UpdateElementIndex(const IfcFlatMesh &flatMesh)
+    {
+        if (_rayMeshes.erase(flatMesh.expressID) > 0)
+        {
+            _rayMeshLru.Remove(flatMesh.expressID);
+        }
+        if (!_elementIndex.Contains(flatMesh.expressID))
+        {
+            return;
+        }
+
+        IfcElementBounds bounds;
+        bounds.expressID = flatMesh.expressID;
+        for (auto &placed : flatMesh.geometries)
+        {
+            const IfcGeometry *geometry = FindGeometry(placed.geometryExpressID);
+            if (geometry == nullptr)
+            {
+                continue;
+            }
+            for (uint32_t i = 0; i < geometry->numPoints; i++)
+            {
+                bounds.Merge(glm::dvec3(placed.transformation * glm::dvec4(geometry->GetVertex(i), 1)));
+            }
+        }
+        _elementIndex.Update(bounds);
+    }
+
+    IfcGeometryProcessor::IfcRayMesh IfcGeometryProcessor::BuildRayMesh(uint32_t expressID)
+    {
+        IfcRayMesh rayMesh;
+        IfcFlatMesh flatMesh = GetFlatMesh(expressID);
+        for (auto &placed : flatMesh.geometries)
+        {
+            const IfcGeometry &geometry = GetGeometry(placed.geometryExpressID);
+            if (geometry.isPolygon)
+            {
+                continue;
+            }
+            for (uint32_t face = 0; face < geometry.numFaces; face++)
+            {
+                for (uint32_t corner = 0; corner < 3; corner++)
+                {
+                    rayMesh.points.push_back(placed.transformation * glm::dvec4(geometry.GetPoint(geometry.indexData[face * 3 + corner]), 1));
+                }
+                rayMesh.faces.emplace_back(placed.geometryExpressID, face);
+            }
+        }
+        return rayMesh;
+    }
+
+    std::optional<IfcRayHit> IfcGeometryProcessor::Raycast(const glm::dvec3 &origin, const glm::dvec3 &dir, double maxDistance)
+    {
+        spdlog::debug("[Raycast()]");
+        std::optional<IfcRayHit> nearest;
+        if (glm::length(dir) == 0)
+        {
+            return nearest;
+        }
+        glm::dvec3 rayDir = glm::normalize(dir);
+
+        double best = maxDistance;
+        for (auto &[entry, expressID] : _elementIndex.QueryRay(origin, rayDir, maxDistance))
+        {
+            // candidates come nearest box first, once a box starts behind the best hit nothing closer is left
+            if (entry > best)
+            {
+                break;
+            }
+            auto rayMeshIt = _rayMeshes.find(expressID);
+            if (rayMeshIt == _rayMeshes.end())
+            {
+                IfcRayMesh rayMesh = BuildRayMesh(expressID);
+                _rayMeshLru.Touch(expressID, rayMesh.points.size() * sizeof(glm::dvec3) + rayMesh.faces.size() * sizeof(std::pair<uint32_t, uint32_t>));
+                rayMeshIt = _rayMeshes.emplace(expressID, std::move(rayMesh)).first;
+            }
+            else
+            {
+                _rayMeshLru.Touch(expressID, 0);
+            }
+
+            const IfcRayMesh &rayMesh = rayMeshIt->second;
+            for (size_t i = 0; i < rayMesh.faces.size(); i++)
+            {
+                double distance;
+                if (RayTriangleDistance(origin, rayDir, rayMesh.points[i * 3], rayMesh.points[i * 3 + 1], rayMesh.points[i * 3 + 2], distance) && distance < best)
+                {
+                    best = distance;
+                    nearest = IfcRayHit{expressID, rayMesh.faces[i].first, rayMesh.faces[i].second, distance, origin + rayDir * distance};
+                }
+            }
+        }
+        // evicted only once the query is done, the meshes it tested stay valid while it runs
+        _rayMeshLru.Evict(_retainedGeometryBudget, [&](uint64_t expressID)
+                          { _rayMeshes.erase(static_cast<uint32_t>(expressID)); });
+        return nearest;
+    }
+
+    std::vector<uint32_t> IfcGeometryProcessor::PrioritizeElements(const std::vector<uint32_t> &expressIDs, IfcStreamPriority priority, const glm::dvec3 &point, uint32_t storeyID, uint32_t threads)
+    {
+        spdlog::debug("[PrioritizeElements({}, {})]", expressIDs.size(), static_cast<int>(priority));
+        std::vector<IfcElementBounds> bounds = GetElementBounds(expressIDs, threads);
+        std::unordered_set<uint32_t> storeyElements;
+        if (priority == PRIORITY_STOREY)
+        {
+            storeyElements = GetStoreyElements(storeyID);
+        }
+
+        // sorted on (group, key, -size): elements without geometry go last, bigger elements win ties
+        struct Entry
+        {
+            uint32_t group;
+            double key;
+            double size;
+            uint32_t expressID;
+        };
+        std::vector<Entry> entries;
+        entries.reserve(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++)
+        {
+            const IfcElementBounds &box = bounds[i];
+            if (box.IsEmpty())
+            {
+                entries.push_back({2, 0, 0, expressIDs[i]});
+                continue;
+            }
+            double size = glm::distance(box.min, box.max);
+            switch (priority)
+            {
+            case PRIORITY_DISTANCE:
+                entries.push_back({0, glm::distance(point, glm::clamp(point, box.min, box.max)), size, expressIDs[i]});
+                break;
+            case PRIORITY_STOREY:
+                entries.push_back({storeyElements.contains(expressIDs[i]) ? 0u : 1u, -size, size, expressIDs[i]});
+                break;
+            default:
+                entries.push_back({0, -size, size, expressIDs[i]});
+                break;
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            if (a.group != b.group)
+            {
+                return a.group < b.group;
+            }
+            if (a.key != b.key)
+            {
+                return a.key < b.key;
+            }
+            return a.size > b.size;
+        });
+
+        std::vector<uint32_t> ordered;
+        ordered.reserve(entries.size());
+        for (auto &entry : entries)
+        {
+            ordered.push_back(entry.expressID);
+        }
+        return ordered;
+    }
+
+    std::unordered_set<uint32_t> IfcGeometryProcessor::GetStoreyElements(uint32_t storeyID)
+    {
+        std::unordered_map<uint32_t, std::vector<uint32_t>> contained;
+        for (uint32_t relID : _loader.GetExpressIDsWithType(schema::IFCRELCONTAINEDINSPATIALSTRUCTURE))
+        {
+            uint32_t relatingStructure = _loader.GetRefAttribute(relID, 5);
+            _loader.MoveToArgumentOffset(relID, 4);
+            auto relatedElements = _loader.GetSetArgument();
+            for (auto &relatedToken : relatedElements)
+            {
+                contained[relatingStructure].push_back(_loader.GetRefArgument(relatedToken));
+            }
+        }
+
+        std::unordered_set<uint32_t> elements;
+        auto &relAggregates = _geometryLoader.GetRelAggregates();
+        std::vector<uint32_t> pending = {storeyID};
+        while (!pending.empty())
+        {
+            uint32_t expressID = pending.back();
+            pending.pop_back();
+            if (!elements.insert(expressID).second)
+            {
+                continue;
+            }
+            auto containedIt = contained.find(expressID);
+            if (containedIt != contained.end())
+            {
+                pending.insert(pending.end(), containedIt->second.begin(), containedIt->second.end());
+            }
+            auto aggregatesIt = relAggregates.find(expressID);
+            if (aggregatesIt != relAggregates.end())
+            {
+                pending.insert(pending.end(), aggregatesIt->second.begin(), aggregatesIt->second.end());
+            }
+        }
+        return elements;
+    }
+
+    size_t IfcGeometryProcessor::GetFlatMeshesBudgeted(const std::vector<uint32_t> &expressIDs, size_t cursor, uint32_t threads, double timeBudgetMs, uint64_t byteBudget, const std::function<void(IfcFlatMesh &, size_t, size_t)> &callback)
+    {
+        spdlog::debug("[GetFlatMeshesBudgeted({}, {})]", expressIDs.size(), cursor);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        if (cursor >= expressIDs.size())
+        {
+            return cursor;
+        }
+
+        // one run over the rest of the list, the budget is checked before every element is handed out; the first one
+        // always is, so each call makes progress, and elements generated ahead but not handed out stay queued
+        std::vector<uint32_t> remaining(expressIDs.begin() + cursor, expressIDs.end());
+        size_t delivered = GetFlatMeshes(remaining, threads, [&](IfcFlatMesh &mesh, size_t index, size_t) {
+            // counted as handed out (float vertices and 32 bit indices), before the callback gets to clear anything
+            for (auto &placed : mesh.geometries)
+            {
+                const IfcGeometry *geometry = FindGeometry(placed.geometryExpressID);
+                if (geometry != nullptr)
+                {
+                    bytes += static_cast<uint64_t>(geometry->numPoints) * VERTEX_FORMAT_SIZE_FLOATS * sizeof(float) + geometry->indexData.size() * sizeof(uint32_t);
+                }
+            }
+            callback(mesh, cursor + index, expressIDs.size());
+        }, [&](size_t done) {
+            if (done == 0)
+            {
+                return false;
+            }
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return (timeBudgetMs > 0 && elapsedMs >= timeBudgetMs) || (byteBudget > 0 && bytes >= byteBudget);
+        });
+        // a cancelled call returns the first element not handed out as well, calling again with it resumes the stream
+        return cursor + delivered;
+    }
+
+    void IfcGeometryProcessor::AddItemBounds(uint32_t expressID, const glm::dmat4 &matrix, IfcElementBounds &bounds, uint32_t depth)
+    {
+        if (depth > 32 || !_loader.IsValidExpressID(expressID))
+        {
+            return;
+        }
+
+        auto lineType = _loader.GetLineType(expressID);
+        if (_schemaManager.IsIfcElement(lineType))
+        {
+            // openings only take material away, the box of the element without them is still conservative
+            uint32_t localPlacement = _loader.GetRefAttribute(expressID, 5);
+            uint32_t ifcPresentation = _loader.GetRefAttribute(expressID, 6);
+
+            glm::dmat4 placement = matrix;
+            if (localPlacement != 0 && _loader.IsValidExpressID(localPlacement))
+            {
+                placement = matrix * _geometryLoader.GetLocalPlacement(localPlacement);
+            }
+            if (ifcPresentation != 0)
+            {
+                AddItemBounds(ifcPresentation, placement, bounds, depth + 1);
+            }
+            return;
+        }
+
+        auto addRefs = [&](uint32_t argumentIndex) {
+            _loader.MoveToArgumentOffset(expressID, argumentIndex);
+            auto refs = _loader.GetSetArgument();
+            for (auto &refToken : refs)
+            {
+                AddItemBounds(_loader.GetRefArgument(refToken), matrix, bounds, depth + 1);
+            }
+        };
+
+        auto addPoint = [&](const glm::dmat4 &transformation, const glm::dvec3 &point) {
+            bounds.Merge(glm::dvec3(transformation * glm::dvec4(point, 1)));
+        };
+
+        switch (lineType)
+        {
+        case schema::IFCPRODUCTREPRESENTATION:
+        case schema::IFCPRODUCTDEFINITIONSHAPE:
+            addRefs(2);
+            return;
+        case schema::IFCTOPOLOGYREPRESENTATION:
+        case schema::IFCSHAPEREPRESENTATION:
+            addRefs(3);
+            return;
+        case schema::IFCGEOMETRICSET:
+        case schema::IFCGEOMETRICCURVESET:
+            addRefs(0);
+            return;
+        case schema::IFCMAPPEDITEM:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t representationMap = _loader.GetRefArgument();
+            uint32_t localPlacement = _loader.GetRefArgument();
+
+            if (_inherited)
+            {
+                auto inheritedIt = _inherited->mappedBounds.find(representationMap);
+                if (inheritedIt != _inherited->mappedBounds.end())
+                {
+                    AddBoxBounds(inheritedIt->second, matrix * _geometryLoader.GetLocalPlacement(localPlacement), bounds);
+                    return;
+                }
+            }
+            auto mappedIt = _mappedBounds.find(representationMap);
+            if (mappedIt == _mappedBounds.end())
+            {
+                IfcElementBounds mappedBounds;
+                AddItemBounds(representationMap, glm::dmat4(1), mappedBounds, depth + 1);
+                mappedIt = _mappedBounds.emplace(representationMap, mappedBounds).first;
+            }
+            AddBoxBounds(mappedIt->second, matrix * _geometryLoader.GetLocalPlacement(localPlacement), bounds);
+            return;
+        }
+        case schema::IFCREPRESENTATIONMAP:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t axis2Placement = _loader.GetRefArgument();
+            uint32_t ifcPresentation = _loader.GetRefArgument();
+
+            AddItemBounds(ifcPresentation, matrix * _geometryLoader.GetLocalPlacement(axis2Placement), bounds, depth + 1);
+            return;
+        }
+        case schema::IFCEXTRUDEDAREASOLID:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t profileID = _loader.GetRefArgument();
+            uint32_t placementID = _loader.GetOptionalRefArgument();
+            uint32_t directionID = _loader.GetRefArgument();
+            double extrusionDepth = _loader.GetDoubleArgument();
+
+            glm::dmat4 placement = matrix;
+            if (placementID)
+            {
+                placement = matrix * _geometryLoader.GetLocalPlacement(placementID);
+            }
+            glm::dvec3 extrusion = _geometryLoader.GetCartesianPoint3D(directionID) * extrusionDepth;
+
+            // holes lie inside the outer curve, both caps of the prism are enough
+            auto profile = _geometryLoader.GetSharedProfile(profileID);
+            auto addCurve = [&](const IfcCurve &curve) {
+                for (auto &pt : curve.points)
+                {
+                    addPoint(placement, pt);
+                    addPoint(placement, pt + extrusion);
+                }
+            };
+            addCurve(profile->curve);
+            for (auto &part : profile->profiles)
+            {
+                addCurve(part.curve);
+            }
+            return;
+        }
+        case schema::IFCREVOLVEDAREASOLID:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t profileID = _loader.GetRefArgument();
+            uint32_t placementID = _loader.GetRefArgument();
+            uint32_t axis1PlacementID = _loader.GetRefArgument();
+
+            auto profile = _geometryLoader.GetSharedProfile(profileID);
+            glm::dmat4 placement = matrix * _geometryLoader.GetLocalPlacement(placementID);
+            auto axis1Placement = _geometryLoader.GetAxis1Placement(axis1PlacementID);
+            glm::dvec3 axisDir = glm::normalize(axis1Placement[0]);
+            glm::dvec3 pos = axis1Placement[1];
+
+            // whatever the angle, the solid stays inside the cylinder around the axis through the farthest profile point
+            IfcElementBounds extents;
+            auto addCurve = [&](const IfcCurve &curve) {
+                for (auto &pt : curve.points)
+                {
+                    glm::dvec3 offset = pt - pos;
+                    double radius = glm::length(glm::cross(offset, axisDir));
+                    double along = glm::dot(offset, axisDir);
+                    extents.Merge(glm::dvec3(along, -radius, -radius));
+                    extents.Merge(glm::dvec3(along, radius, radius));
+                }
+            };
+            addCurve(profile->curve);
+            for (auto &part : profile->profiles)
+            {
+                addCurve(part.curve);
+            }
+            if (extents.IsEmpty())
+            {
+                return;
+            }
+
+            glm::dvec3 u = glm::normalize(glm::cross(axisDir, std::abs(axisDir.x) < 0.9 ? glm::dvec3(1, 0, 0) : glm::dvec3(0, 1, 0)));
+            glm::dvec3 v = glm::cross(axisDir, u);
+            glm::dmat4 axisFrame(glm::dvec4(axisDir, 0), glm::dvec4(u, 0), glm::dvec4(v, 0), glm::dvec4(pos, 1));
+            AddBoxBounds(extents, placement * axisFrame, bounds);
+            return;
+        }
+        case schema::IFCSWEPTDISKSOLID:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t directrixRef = _loader.GetRefArgument();
+            double radius = _loader.GetDoubleArgument();
+
+            IfcElementBounds extents;
+            for (auto &pt : _geometryLoader.GetCurve(directrixRef, 3).points)
+            {
+                extents.Merge(pt);
+            }
+            if (extents.IsEmpty())
+            {
+                return;
+            }
+            extents.min -= glm::dvec3(radius);
+            extents.max += glm::dvec3(radius);
+            AddBoxBounds(extents, matrix, bounds);
+            return;
+        }
+        case schema::IFCRIGHTCIRCULARCYLINDER:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            uint32_t placementID = _loader.GetRefArgument();
+            double height = _loader.GetDoubleArgument();
+            double radius = _loader.GetDoubleArgument();
+
+            IfcElementBounds extents;
+            extents.Merge(glm::dvec3(-radius, -radius, 0));
+            extents.Merge(glm::dvec3(radius, radius, height));
+            AddBoxBounds(extents, placementID ? matrix * _geometryLoader.GetLocalPlacement(placementID) : matrix, bounds);
+            return;
+        }
+        case schema::IFCPOLYGONALFACESET:
+        case schema::IFCTRIANGULATEDIRREGULARNETWORK:
+        case schema::IFCTRIANGULATEDFACESET:
+        {
+            uint32_t coordinatesRef = _loader.GetRefAttribute(expressID, 0);
+            for (auto &pt : _geometryLoader.ReadIfcCartesianPointList3D(coordinatesRef))
+            {
+                addPoint(matrix, pt);
+            }
+            return;
+        }
+        case schema::IFCFACETEDBREP:
+        {
+            if (!AddShellBounds(_loader.GetRefAttribute(expressID, 0), matrix, bounds))
+            {
+                AddMeshBounds(expressID, matrix, bounds);
+            }
+            return;
+        }
+        case schema::IFCFACEBASEDSURFACEMODEL:
+        case schema::IFCSHELLBASEDSURFACEMODEL:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            auto shells = _loader.GetSetArgument();
+            for (auto &shell : shells)
+            {
+                if (!AddShellBounds(_loader.GetRefArgument(shell), matrix, bounds))
+                {
+                    AddMeshBounds(expressID, matrix, bounds);
+                    return;
+                }
+            }
+            return;
+        }
+        case schema::IFCBOOLEANCLIPPINGRESULT:
+            // always a difference, the second operand can only remove material
+            AddItemBounds(_loader.GetRefAttribute(expressID, 1), matrix, bounds, depth + 1);
+            return;
+        case schema::IFCBOOLEANRESULT:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            std::string_view op = _loader.GetStringArgument();
+            uint32_t firstOperandID = _loader.GetRefArgument();
+            uint32_t secondOperandID = _loader.GetRefArgument();
+
+            // GetMesh() only produces differences and unions
+            if (op == "DIFFERENCE" || op == "UNION")
+            {
+                AddItemBounds(firstOperandID, matrix, bounds, depth + 1);
+            }
+            if (op == "UNION")
+            {
+                AddItemBounds(secondOperandID, matrix, bounds, depth + 1);
+            }
+            return;
+        }
+        case schema::IFCCARTESIANPOINT:
+        case schema::IFCEDGE:
+        case schema::IFCCIRCLE:
+        case schema::IFCCOMPOSITECURVE:
+        case schema::IFCPOLYLINE:
+        case schema::IFCINDEXEDPOLYCURVE:
+        case schema::IFCTRIMMEDCURVE:
+        case schema::IFCGRADIENTCURVE:
+            // polylines are left out of the flat meshes unless they are exported
+            if (_settings._exportPolylines)
+            {
+                AddMeshBounds(expressID, matrix, bounds);
+            }
+            return;
+        case schema::IFCBOUNDINGBOX:
+        case schema::IFCTEXTLITERAL:
+        case schema::IFCTEXTLITERALWITHEXTENT:
+            return;
+        default:
+            AddMeshBounds(expressID, matrix, bounds);
+            return;
+        }
+    }
+
+    bool IfcGeometryProcessor::AddShellBounds(uint32_t shellID, const glm::dmat4 &matrix, IfcElementBounds &bounds)
+    {
+        auto lineType = _loader.GetLineType(shellID);
+        if (lineType != schema::IFCCONNECTEDFACESET && lineType != schema::IFCCLOSEDSHELL && lineType != schema::IFCOPENSHELL)
+        {
+            return false;
+        }
+
+        _loader.MoveToArgumentOffset(shellID, 0);
+        auto faces = _loader.GetSetArgument();
+        for (auto &faceToken : faces)
+        {
+            uint32_t faceID = _loader.GetRefArgument(faceToken);
+            // curved faces can bulge past their edges, those need the tessellated surface
+            if (_loader.GetLineType(faceID) != schema::IFCFACE)
+            {
+                return false;
+            }
+
+            _loader.MoveToArgumentOffset(faceID, 0);
+            auto faceBounds = _loader.GetSetArgument();
+            for (auto &boundToken : faceBounds)
+            {
+                IfcBound3D bound = _geometryLoader.GetBound(_loader.GetRefArgument(boundToken));
+                for (auto &pt : bound.curve.points)
+                {
+                    bounds.Merge(glm::dvec3(matrix * glm::dvec4(pt, 1)));
+                }
+            }
+        }
+        return true;
+    }
+
+    void IfcGeometryProcessor::AddMeshBounds(uint32_t expressID, const glm::dmat4 &matrix, IfcElementBounds &bounds)
+    {
+        // no shortcut for this item, it is tessellated like GetFlatMesh() would and the geometry dropped again
+        _booleanOperandDepth++;
+        IfcComposedMesh mesh = GetMesh(expressID);
+        _booleanOperandDepth--;
+
+        std::vector<std::pair<const IfcComposedMesh *, glm::dmat4>> stack = {{&mesh, matrix}};
+        while (!stack.empty())
+        {
+            auto [current, parentMatrix] = stack.back();
+            stack.pop_back();
+            glm::dmat4 currentMatrix = parentMatrix * current->transformation;
+
+            // retained geometry is normalized, its translation goes in front of the placement
+            glm::dmat4 normalization;
+            const IfcGeometry *geometry = FindOperand(current->expressID, _expressIDToGeometry, normalization, InheritedGeometries());
+            if (current->hasGeometry && geometry != nullptr)
+            {
+                if (!geometry->isPolygon || _settings._exportPolylines)
+                {
+                    glm::dmat4 pointMatrix = currentMatrix * normalization;
+                    for (uint32_t i = 0; i < geometry->numPoints; i++)
+                    {
+                        bounds.Merge(glm::dvec3(pointMatrix * glm::dvec4(geometry->GetPoint(i), 1)));
+                    }
+                }
+                if (!IsMappedGeometry(current->expressID) && !IsUniqueGeometry(current->expressID))
+                {
+                    _expressIDToGeometry.erase(current->expressID);
+                }
+            }
+
+            for (auto &child : current->children)
+            {
+                stack.emplace_back(&child, currentMatrix);
+            }
+        }
+    }
+
+    void IfcGeometryProcessor::AddBoxBounds(const IfcElementBounds &box, const glm::dmat4 &matrix, IfcElementBounds &bounds)
+    {
+        if (box.IsEmpty())
+        {
+            return;
+        }
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::dvec3 pt((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+            bounds.Merge(glm::dvec3(matrix * glm::dvec4(pt, 1)));
+        }
+    }
+
+    void IfcGeometryProcessor::AddComposedMeshToFlatMesh(IfcFlatMesh &flatMesh, const IfcComposedMesh &composedMesh, const glm::dmat4 &parentMatrix, const glm::dvec4 &color, bool hasColor)
+    {
+
+        glm::dvec4 newParentColor = color;
+        bool newHasColor = hasColor;
+        glm::dmat4 newMatrix = parentMatrix * composedMesh.transformation;
+
+        if (composedMesh.hasColor && !hasColor)
+        {
+            newHasColor = true;
+            newParentColor = composedMesh.color;
+        }
+
+        if (composedMesh.hasGeometry)
+        {
+            IfcPlacedGeometry geometry;
+            uint32_t geometryExpressID = composedMesh.expressID;
+            auto translation = glm::dmat4(1.0);
+
+            const IfcGeometryAlias *alias = FindAlias(composedMesh.expressID);
+            if (alias != nullptr && !IsRetainedAlias(*alias))
+            {
+                // what it pointed at was dropped, the item was tessellated again and is placed like a new one
+                _geometryAliases.erase(composedMesh.expressID);
+                alias = nullptr;
+            }
+            const IfcGeometry *inherited = _expressIDToGeometry.contains(composedMesh.expressID) ? nullptr : FindGeometry(composedMesh.expressID);
+            if (alias != nullptr)
+            {
+                // a copy of another geometry or retained itself, drop whatever GetMesh rebuilt for a copy
+                if (alias->geometryExpressID != composedMesh.expressID && !IsMappedGeometry(composedMesh.expressID))
+                {
+                    _expressIDToGeometry.erase(composedMesh.expressID);
+                }
+                geometryExpressID = alias->geometryExpressID;
+                translation = alias->translation;
+            }
+            else if (inherited != nullptr)
+            {
+                // lent by the processor that started the run, it was prepared when it was retained and is only read
+                if (inherited->isPolygon && !_settings._exportPolylines)
+                {
+                    return; // only triangles
+                }
+                translation = inherited->IsNormalized() ? glm::translate(glm::dvec3(inherited->normalizationCenter)) : glm::dmat4(1);
+                if (_settings._deduplicateGeometry)
+                {
+                    geometryExpressID = DeduplicateGeometry(composedMesh, translation);
+                }
+            }
+            else
+            {
+                if (!_isCoordinated && _settings._coordinateToOrigin)
+                {
+                    auto &geom = _expressIDToGeometry[composedMesh.expressID];
+                    if (geom.numPoints > 0)
+                    {
+                        auto pt = geom.GetPoint(0);
+                        auto transformedPt = newMatrix * glm::dvec4(pt, 1);
+                        _coordinationMatrix = glm::translate(-glm::dvec3(transformedPt));
+                        _isCoordinated = true;
+                    }
+                }
+
+                auto &geom = _expressIDToGeometry[composedMesh.expressID];
+                if (geom.isPolygon)
+                {
+                    if (!_settings._exportPolylines)
+                    {
+                        return; // only triangles
+                    }
+                }
+                if (geometry.testReverse())
+                    geom.ReverseFaces();
+
+                // welded before deduplication so the content hashes are taken over the final buffers, mapped geometry
+                // went through this when it was retained
+                translation = PrepareRetainedGeometry(geom);
+
+                if (_settings._deduplicateGeometry)
+                {
+                    geometryExpressID = DeduplicateGeometry(composedMesh, translation);
+                }
+
+                // built once per geometry that is handed out, copies found by deduplication reuse the LODs of the
+                // original; a lent original has them already
+                auto outputIt = _expressIDToGeometry.find(geometryExpressID);
+                if (_settings._lodLevels > 0 && outputIt != _expressIDToGeometry.end())
+                {
+                    outputIt->second.BuildLods(_settings._lodLevels);
+                }
+
+                // mapped geometries are read again by the booleans of later elements, they keep their doubles
+                if (_settings._float32Geometry && outputIt != _expressIDToGeometry.end() && !IsMappedGeometry(geometryExpressID))
+                {
+                    outputIt->second.CompactVertexData();
+                }
+            }
+
+            if (!composedMesh.hasColor)
+            {
+                geometry.color = newParentColor;
+            }
+            else
+            {
+                geometry.color = composedMesh.color;
+                newParentColor = composedMesh.color;
+                newHasColor = composedMesh.hasColor;
+            }
+
+            geometry.transformation = _coordinationMatrix * newMatrix * translation;
+
+            geometry.SetFlatTransformation();
+            geometry.geometryExpressID = geometryExpressID;
+
+            flatMesh.geometries.push_back(geometry);
+        }
+        else if (composedMesh.hasColor)
+        {
+            newParentColor = composedMesh.color;
+            newHasColor = composedMesh.hasColor;
+        }
+
+        for (auto &c : composedMesh.children)
+        {
+            AddComposedMeshToFlatMesh(flatMesh, c, newMatrix, newParentColor, newHasColor);
+        }
+    }
+
+    IfcGeometry IfcGeometryProcessor::BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, const std::string &op, const IfcGeometrySettings &_settings)
+    {
+        return _boolEngine.BoolProcess(firstGeoms, secondGeoms, op, _settings);
+    }
+
+    IfcGeometry IfcGeometryProcessor::FuseGeometries(std::vector<IfcGeometry> &geoms)
+    {
+        // a left fold in input order, the fused result depends on the order the operands are united in
+        IfcGeometry fused;
+        for (auto &geom : geoms)
+        {
+            std::vector<IfcGeometry> first(1);
+            std::vector<IfcGeometry> second(1);
+            first[0] = std::move(fused);
+            second[0] = std::move(geom);
+            fused = BoolProcess(first, second, "UNION", _settings);
+        }
+        return fused;
+    }
+
+    std::vector<uint32_t> IfcGeometryProcessor::Read2DArrayOfThreeIndices()
+    {
+        std::vector<uint32_t> result;
+
+        _loader.GetTokenType();
+
+        // while we have point set begin
+        while (_loader.GetTokenType() == parsing::IfcTokenType::SET_BEGIN)
+        {
+            result.push_back((uint32_t)_loader.GetIntArgument());
+            result.push_back((uint32_t)_loader.GetIntArgument());
+            result.push_back((uint32_t)_loader.GetIntArgument());
+
+            // read point set end
+            _loader.GetTokenType();
+        }
+
+        return result;
+    }
+
+    void IfcGeometryProcessor::ReadIndexedPolygonalFace(uint32_t expressID, std::vector<IfcBound3D> &bounds, const std::vector<glm::dvec3> &points)
+    {
+
+        spdlog::debug("[ReadIndexedPolygonalFace({})]", expressID);
+        auto lineType = _loader.GetLineType(expressID);
+
+        bounds.emplace_back();
+
+        switch (lineType)
+        {
+        case schema::IFCINDEXEDPOLYGONALFACEWITHVOIDS:
+        case schema::IFCINDEXEDPOLYGONALFACE:
+        {
+            _loader.MoveToArgumentOffset(expressID, 0);
+            auto indexIDs = _loader.GetSetArgument();
 
             IfcGeometry geometry;
             for (auto &indexID : indexIDs)
@@ -1902,7 +3681,7 @@ namespace webifc::geometry
             }
             else if (surface.CylinderSurface.Active)
             {
-                TriangulateCylindricalSurface(geometry, bounds3D, surface, _settings._circleSegments);
+                TriangulateCylindricalSurface(geometry, bounds3D, surface, _geometryLoader.GetCircleSegments(surface.CylinderSurface.Radius));
             }
             else if (surface.RevolutionSurface.Active)
             {
@@ -1924,7 +3703,7 @@ namespace webifc::geometry
         }
     }
 
-    fuzzybools::Geometry booleanManager::convertToEngine(Geometry geom)
+    fuzzybools::Geometry booleanManager::convertToEngine(const Geometry &geom)
     {
         fuzzybools::Geometry newGeom;
         newGeom.fvertexData = geom.fvertexData;
@@ -1944,13 +3723,13 @@ namespace webifc::geometry
         return newGeom;
     }
 
-    IfcGeometry booleanManager::convertToWebIfc(fuzzybools::Geometry geom)
+    IfcGeometry booleanManager::convertToWebIfc(fuzzybools::Geometry &&geom)
     {
         IfcGeometry newGeom;
-        newGeom.fvertexData = geom.fvertexData;
-        newGeom.vertexData = geom.vertexData;
-        newGeom.indexData = geom.indexData;
-        newGeom.planeData = geom.planeData;
+        newGeom.fvertexData = std::move(geom.fvertexData);
+        newGeom.vertexData = std::move(geom.vertexData);
+        newGeom.indexData = std::move(geom.indexData);
+        newGeom.planeData = std::move(geom.planeData);
         newGeom.numPoints = geom.numPoints;
         newGeom.numFaces = geom.numFaces;
         uint32_t id = 0;
@@ -1967,7 +3746,7 @@ namespace webifc::geometry
         return newGeom;
     }
 
-    IfcGeometry booleanManager::BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, std::string op, IfcGeometrySettings _settings)
+    IfcGeometry booleanManager::BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, const std::string &op, const IfcGeometrySettings &_settings)
     {
         spdlog::debug("[BoolProcess({})]");
         IfcGeometry finalResult;
@@ -1977,6 +3756,10 @@ namespace webifc::geometry
             IfcGeometry firstOperator = firstGeom;
             for (auto &secondGeom : secondGeoms)
             {
+                if (std::chrono::steady_clock::now() > _settings._booleanDeadline)
+                {
+                    break;
+                }
                 bool doit = true;
                 if (secondGeom.numFaces == 0)
                 {
@@ -1998,7 +3781,8 @@ namespace webifc::geometry
 
                 if (doit)
                 {
-                    IfcGeometry secondOperator;
+                    // plain operands are used as they are, their planes are built in place and reused for every first operand
+                    IfcGeometry halfSpaceOperator;
 
                     if (secondGeom.halfSpace)
                     {
@@ -2036,12 +3820,9 @@ namespace webifc::geometry
                                 scaleZ = glm::abs(dz);
                             }
                         }
-                        secondOperator.AddGeometry(secondGeom, trans, scaleX * 2, scaleY * 2, scaleZ * 2, secondGeom.halfSpaceOrigin);
-                    }
-                    else
-                    {
-                        secondOperator = secondGeom;
+                        halfSpaceOperator.AddGeometry(secondGeom, trans, scaleX * 2, scaleY * 2, scaleZ * 2, secondGeom.halfSpaceOrigin);
                     }
+                    IfcGeometry &secondOperator = secondGeom.halfSpace ? halfSpaceOperator : secondGeom;
 
 #ifdef CSG_DEBUG_OUTPUT
                     io::DumpIfcGeometry(secondOperator, "second.obj");
@@ -2076,14 +3857,14 @@ namespace webifc::geometry
         return finalResult;
     }
 
-    IfcGeometry booleanManager::Union(IfcGeometry firstOperator, IfcGeometry secondOperator)
+    IfcGeometry booleanManager::Union(const IfcGeometry &firstOperator, const IfcGeometry &secondOperator)
     {
         fuzzybools::Geometry firstEngGeom = convertToEngine(firstOperator);
         fuzzybools::Geometry secondEngGeom = convertToEngine(secondOperator);
         return convertToWebIfc(fuzzybools::Union(firstEngGeom, secondEngGeom));
     }
 
-    IfcGeometry booleanManager::Subtract(IfcGeometry firstOperator, IfcGeometry secondOperator)
+    IfcGeometry booleanManager::Subtract(const IfcGeometry &firstOperator, const IfcGeometry &secondOperator)
     {
         fuzzybools::Geometry firstEngGeom = convertToEngine(firstOperator);
         fuzzybools::Geometry secondEngGeom = convertToEngine(secondOperator);
@@ -2092,7 +3873,10 @@ namespace webifc::geometry
 
     IfcGeometryProcessor *IfcGeometryProcessor::Clone(const webifc::parsing::IfcLoader &newLoader) const
     {
-        IfcGeometryProcessor *newProcessor = new IfcGeometryProcessor(_settings, _expressIDToGeometry, *_geometryLoader.Clone(newLoader), _transformation, newLoader, _boolEngine, _schemaManager, _isCoordinated, _expressIdCyl, _expressIdRect, _coordinationMatrix, _predefinedCylinder, _predefinedCube);
+        std::unique_ptr<IfcGeometryLoader> geometryLoader(_geometryLoader.Clone(newLoader));
+        IfcGeometryProcessor *newProcessor = new IfcGeometryProcessor(_settings, {}, *geometryLoader, _transformation, newLoader, _boolEngine, _schemaManager, _isCoordinated, _expressIdCyl, _expressIdRect, _coordinationMatrix, _predefinedCylinder, _predefinedCube);
+        newProcessor->_inherited = _inherited;
+        newProcessor->_retainedGeometryBudget = _retainedGeometryBudget;
         return newProcessor;
     }
 
@@ -7,10 +7,17 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <cstdint>
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <chrono>
 #include "representation/geometry.h"
 #include "../parsing/IfcLoader.h"
 #include "../schema/IfcSchemaManager.h"
 #include "IfcGeometryLoader.h"
+#include "IfcGeometryCache.h"
+#include "IfcElementBVH.h"
 
 namespace fuzzybools
 {
@@ -33,18 +40,61 @@ namespace webifc::geometry
     double TOLERANCE_BACK_DEVIATION_DISTANCE = 1.0E-04;
     double TOLERANCE_INSIDE_OUTSIDE_PERIMETER = 1.0E-10;
     uint16_t _BOOLEAN_UNION_THRESHOLD = 150;
+    bool _deduplicateGeometry = false;
+    bool _float32Geometry = false;
+    uint16_t _lodLevels = 0;
+    // vertices closer than this (in metres) with the same normal are merged, 0 leaves the buffers as tessellated
+    double _vertexWeldTolerance = 0;
+    // per element limits, 0 for none: openings subtracted, triangles of the flat mesh and time spent on the openings
+    uint32_t _maxBooleanOperands = 0;
+    uint32_t _maxElementTriangles = 0;
+    double _elementTimeLimitMs = 0;
+    // set while the openings of an element are processed, BoolProcess() skips the remaining operands once it passed
+    std::chrono::steady_clock::time_point _booleanDeadline = std::chrono::steady_clock::time_point::max();
+  };
+
+  // where the output of a representation item went: another geometry with the same buffers, or the item itself once it
+  // is retained; a leaf item is not tessellated again for output, its composed mesh is rebuilt from the fields below
+  struct IfcGeometryAlias
+  {
+    uint32_t geometryExpressID;
+    glm::dmat4 translation;
+    bool leaf = false;
+    glm::dmat4 meshTransformation = glm::dmat4(1);
+    glm::dvec4 color = glm::dvec4(1);
+    bool hasColor = false;
+  };
+
+  // the composed mesh of an IfcRepresentationMap and the geometries it counted as mapped when it was tessellated
+  struct IfcMappedRepresentation
+  {
+    IfcComposedMesh mesh;
+    std::vector<uint32_t> geometryIDs;
+  };
+
+  // what a processor keeps from one element to the next, lent read only to the workers of a parallel run
+  struct IfcRetainedGeometry
+  {
+    std::unordered_map<uint32_t, IfcGeometry> geometries;
+    std::unordered_map<uint32_t, IfcMappedRepresentation> mappedRepresentations;
+    std::unordered_map<uint32_t, uint32_t> mappedGeometryIDs;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> geometryHashes;
+    std::unordered_map<uint32_t, IfcGeometryAlias> geometryAliases;
+    std::unordered_set<uint32_t> uniqueGeometryIDs;
+    std::unordered_map<uint32_t, uint64_t> uniqueGeometryHashes;
+    std::unordered_map<uint32_t, IfcElementBounds> mappedBounds;
   };
 
   class booleanManager
   {
   public:
-    IfcGeometry BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, std::string op, IfcGeometrySettings _settings);
+    IfcGeometry BoolProcess(const std::vector<IfcGeometry> &firstGeoms, std::vector<IfcGeometry> &secondGeoms, const std::string &op, const IfcGeometrySettings &_settings);
 
   private:
-    fuzzybools::Geometry convertToEngine(Geometry geom);
-    IfcGeometry convertToWebIfc(fuzzybools::Geometry geom);
-    IfcGeometry Union(IfcGeometry firstOperator, IfcGeometry secondOperator);
-    IfcGeometry Subtract(IfcGeometry firstOperator, IfcGeometry secondOperator);
+    fuzzybools::Geometry convertToEngine(const Geometry &geom);
+    IfcGeometry convertToWebIfc(fuzzybools::Geometry &&geom);
+    IfcGeometry Union(const IfcGeometry &firstOperator, const IfcGeometry &secondOperator);
+    IfcGeometry Subtract(const IfcGeometry &firstOperator, const IfcGeometry &secondOperator);
   };
 
   class IfcGeometryProcessor
@@ -55,19 +105,77 @@ namespace webifc::geometry
     IfcGeometryLoader& GetLoader();
     IfcFlatMesh GetFlatMesh(uint32_t expressID, bool applyLinearScalingFactor = true);
     IfcComposedMesh GetMesh(uint32_t expressID);
+    // returns how many elements were handed to the callback, fewer than expressIDs.size() only when cancelled or when
+    // stop, asked with the number handed out so far before each element, returns true
+    size_t GetFlatMeshes(const std::vector<uint32_t> &expressIDs, uint32_t threads, const std::function<void(IfcFlatMesh &, size_t, size_t)> &callback, const std::function<bool(size_t)> &stop = nullptr);
+    uint64_t EstimateCost(uint32_t expressID) const;
+    IfcElementBounds GetElementBounds(uint32_t expressID);
+    std::vector<IfcElementBounds> GetElementBounds(const std::vector<uint32_t> &expressIDs, uint32_t threads);
+    void BuildElementIndex(const std::vector<uint32_t> &expressIDs, uint32_t threads);
+    IfcElementBVH &GetElementIndex();
+    std::optional<IfcRayHit> Raycast(const glm::dvec3 &origin, const glm::dvec3 &dir, double maxDistance = DBL_MAX);
+    std::vector<uint32_t> PrioritizeElements(const std::vector<uint32_t> &expressIDs, IfcStreamPriority priority, const glm::dvec3 &point, uint32_t storeyID, uint32_t threads);
+    size_t GetFlatMeshesBudgeted(const std::vector<uint32_t> &expressIDs, size_t cursor, uint32_t threads, double timeBudgetMs, uint64_t byteBudget, const std::function<void(IfcFlatMesh &, size_t, size_t)> &callback);
     void SetTransformation(const std::array<double, 16> &val);
     std::array<double, 16> GetFlatCoordinationMatrix() const;
     glm::dmat4 GetCoordinationMatrix() const;
     void Clear();
+    void ResetCache();
+    // canonical geometries kept across Clear() for later copies to point at, least recently matched dropped first
+    void SetGeometryDeduplication(bool enabled, uint64_t retainedBytes);
+    void SetFloat32Geometry(bool enabled);
+    void SetGeometryLods(uint16_t levels);
+    void SetVertexWelding(double tolerance);
+    void SetGeometryCache(const std::string &path);
+    // elements over a limit (0 for none) get a cheaper representation and are listed in GetComplexityReport()
+    void SetComplexityLimits(uint32_t maxBooleanOperands, uint32_t maxTriangles, double timeLimitMs);
+    std::vector<IfcComplexityFallback> GetComplexityReport() const;
+    // checked by GetFlatMeshes() and GetFlatMeshesBudgeted() before each element, clones never get one
+    void SetCancellationToken(parsing::IfcCancellationToken *cancellation);
+    // a clone shares the retained geometry lent out by LendRetainedGeometry(), it does not copy any of its own
     IfcGeometryProcessor *Clone(const webifc::parsing::IfcLoader &loader) const;
+    const GeometryCopyStats &GetCopyStats() const;
+    const VertexWeldStats &GetWeldStats() const;
 
   protected:
     IfcGeometryProcessor(const IfcGeometrySettings &settings, std::unordered_map<uint32_t, IfcGeometry> expressIDToGeometry, const IfcGeometryLoader &geometryLoader, glm::dmat4 transformation, const parsing::IfcLoader &loader, booleanManager boolEngine, const schema::IfcSchemaManager &schemaManager, bool isCoordinated, uint32_t expressIdCyl, uint32_t expressIdRect, glm::dmat4 coordinationMatrix, IfcGeometry predefinedCylinder, IfcGeometry predefinedCube);
     IfcGeometrySettings _settings;
+    // GetMesh() looks up known geometry, BuildMesh() tessellates
+    IfcComposedMesh BuildMesh(uint32_t expressID);
+    // above zero while the meshes built are boolean operands, those always need the tessellated geometry of their items
+    uint32_t _booleanOperandDepth = 0;
     std::optional<glm::dvec4> GetStyleItemFromExpressId(uint32_t expressID);
     void AddFaceToGeometry(uint32_t expressID, IfcGeometry &geometry);
     IfcGeometry GetBrep(uint32_t expressID);
-    IfcGeometry BoolProcess(const std::vector<IfcGeometry> &firstGroups, std::vector<IfcGeometry> &secondGroups, std::string op, IfcGeometrySettings _settings);
+    IfcGeometry BoolProcess(const std::vector<IfcGeometry> &firstGroups, std::vector<IfcGeometry> &secondGroups, const std::string &op, const IfcGeometrySettings &_settings);
+    IfcGeometry FuseGeometries(std::vector<IfcGeometry> &geoms);
+    uint64_t EstimateItemCost(uint32_t expressID, uint32_t depth) const;
+    // EstimateCost() weights, relative to the cost of a single face
+    static constexpr uint64_t ITEM_COST = 16;
+    static constexpr uint64_t BOOLEAN_COST = 512;
+    // GetElementBounds() reads placements, profiles and point lists, only items without a shortcut are tessellated
+    void AddItemBounds(uint32_t expressID, const glm::dmat4 &matrix, IfcElementBounds &bounds, uint32_t depth);
+    bool AddShellBounds(uint32_t shellID, const glm::dmat4 &matrix, IfcElementBounds &bounds);
+    void AddMeshBounds(uint32_t expressID, const glm::dmat4 &matrix, IfcElementBounds &bounds);
+    static void AddBoxBounds(const IfcElementBounds &box, const glm::dmat4 &matrix, IfcElementBounds &bounds);
+    // boxes of IfcRepresentationMaps in their own coordinates, transformed for every IfcMappedItem
+    std::unordered_map<uint32_t, IfcElementBounds> _mappedBounds;
+    // elements already in the index get their box refitted whenever their flat mesh is generated
+    IfcElementBVH _elementIndex;
+    void UpdateElementIndex(const IfcFlatMesh &flatMesh);
+    // world space triangles of the elements Raycast() has tested, so repeated picks do not tessellate them again;
+    // they share the retention budget with the deduplicated geometries and go when the element is generated again
+    struct IfcRayMesh
+    {
+        std::vector<glm::dvec3> points;
+        // geometry and face of every triangle of points
+        std::vector<std::pair<uint32_t, uint32_t>> faces;
+    };
+    IfcRayMesh BuildRayMesh(uint32_t expressID);
+    std::unordered_map<uint32_t, IfcRayMesh> _rayMeshes;
+    IfcCacheLru _rayMeshLru;
+    // elements contained in a storey, in its spaces or aggregated into any of those
+    std::unordered_set<uint32_t> GetStoreyElements(uint32_t storeyID);
     std::unordered_map<uint32_t, IfcGeometry> _expressIDToGeometry;
     IfcSurface GetSurface(uint32_t expressID);
     IfcGeometryLoader _geometryLoader;
@@ -84,5 +192,56 @@ namespace webifc::geometry
     void ReadIndexedPolygonalFace(uint32_t expressID, std::vector<IfcBound3D> &bounds, const std::vector<glm::dvec3> &points);
     IfcGeometry _predefinedCylinder;
     IfcGeometry _predefinedCube;
+    // IfcRepresentationMaps are tessellated once and shared by every IfcMappedItem, Clear() keeps their geometry
+    // within the retention budget; a geometry may be in several maps, it counts how many hold it
+    std::unordered_map<uint32_t, IfcMappedRepresentation> _mappedRepresentations;
+    std::unordered_map<uint32_t, uint32_t> _mappedGeometryIDs;
+    void DropMappedRepresentation(uint32_t representationID);
+    // normalizes and welds a geometry for output, mapped geometry right when it is retained so booleans of every
+    // instance read the same buffers; returns the translation back to where it was tessellated
+    glm::dmat4 PrepareRetainedGeometry(IfcGeometry &geom);
+    // normalized geometries grouped by content hash, copies are replaced by the first geometry with the same buffers
+    uint32_t DeduplicateGeometry(const IfcComposedMesh &composedMesh, const glm::dmat4 &translation);
+    bool IsRetainedAlias(const IfcGeometryAlias &alias) const;
+    void DropUniqueGeometry(uint32_t expressID);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> _geometryHashes;
+    std::unordered_map<uint32_t, IfcGeometryAlias> _geometryAliases;
+    std::unordered_set<uint32_t> _uniqueGeometryIDs;
+    std::unordered_map<uint32_t, uint64_t> _uniqueGeometryHashes;
+    // the retained geometry is moved out for a parallel run and looked up there, by the processor that lent it and
+    // by its workers, until it is taken back; new entries go to the members above and win when the two are merged
+    std::shared_ptr<const IfcRetainedGeometry> _inherited;
+    std::shared_ptr<IfcRetainedGeometry> _lent;
+    void LendRetainedGeometry();
+    void ReturnRetainedGeometry();
+    const IfcGeometry *FindGeometry(uint32_t expressID) const;
+    const IfcGeometryAlias *FindAlias(uint32_t expressID) const;
+    bool IsMappedGeometry(uint32_t expressID) const;
+    bool IsUniqueGeometry(uint32_t expressID) const;
+    const std::unordered_map<uint32_t, IfcGeometry> *InheritedGeometries() const;
+    // unique geometries and mapped representations, a tag in the key tells them apart
+    IfcCacheLru _retainedGeometryLru;
+    static constexpr uint64_t RETAINED_UNIQUE = 0;
+    static constexpr uint64_t RETAINED_MAPPED = 1ull << 62;
+    uint64_t _retainedGeometryBudget = 0;
+    // IfcGeometry copies made by GetFlatMesh on this processor and its parallel workers
+    GeometryCopyStats _copyStats;
+    // vertices merged by the welding pass on this processor and its parallel workers
+    VertexWeldStats _weldStats;
+    // flat meshes and geometries of earlier runs over the same model, parallel workers never get one
+    std::unique_ptr<IfcGeometryCache> _geometryCache;
+    bool ReadCachedFlatMesh(uint32_t expressID, uint64_t matrixKey, IfcFlatMesh &flatMesh);
+    void CacheFlatMesh(const IfcFlatMesh &flatMesh, uint64_t matrixKey);
+    uint64_t FlatMeshMatrixKey(bool applyLinearScalingFactor) const;
+    parsing::IfcCancellationToken *_cancellation = nullptr;
+    // one entry per element, the latest one when an element is generated again
+    std::unordered_map<uint32_t, IfcComplexityFallback> _complexityFallbacks;
+    void ReportFallback(const IfcComplexityFallback &fallback);
+    // the unclipped body of an element whose openings were skipped
+    static IfcGeometry MergeGeometries(const std::vector<IfcGeometry> &geoms);
+    void ReplaceWithBoundingBox(IfcFlatMesh &flatMesh, uint64_t triangles);
+    // reports progress every PROGRESS_INTERVAL elements, true when the caller has to stop before element done
+    bool IsCancelled(size_t done, size_t total);
+    static constexpr size_t PROGRESS_INTERVAL = 64;
   };
 }
\ No newline at end of file
@@ -0,0 +1,529 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+#include <cfloat>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "IfcGltfExporter.h"
+#include "../../version.h"
+
+namespace
+{
+    constexpr uint32_t ARRAY_BUFFER = 34962;
+    constexpr uint32_t ELEMENT_ARRAY_BUFFER = 34963;
+    constexpr uint32_t COMPONENT_FLOAT = 5126;
+    constexpr uint32_t COMPONENT_UNSIGNED_INT = 5125;
+    // placements whose axes are further than this from orthogonal are baked, see IfcGltfExporter::BakedMesh
+    constexpr double SHEAR_TOLERANCE = 1e-6;
+    // size of the pieces both files are handed out in
+    constexpr size_t OUTPUT_BLOCK = 1 << 20;
+
+    // unit quaternion (x, y, z, w) of a rotation matrix, from its largest component for stability
+    glm::dvec4 RotationQuaternion(const glm::dmat3 &r)
+    {
+        glm::dvec4 q;
+        double trace = r[0][0] + r[1][1] + r[2][2];
+        if (trace > 0)
+        {
+            double s = std::sqrt(trace + 1) * 2;
+            q = glm::dvec4((r[1][2] - r[2][1]) / s, (r[2][0] - r[0][2]) / s, (r[0][1] - r[1][0]) / s, s / 4);
+        }
+        else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+        {
+            double s = std::sqrt(1 + r[0][0] - r[1][1] - r[2][2]) * 2;
+            q = glm::dvec4(s / 4, (r[1][0] + r[0][1]) / s, (r[2][0] + r[0][2]) / s, (r[1][2] - r[2][1]) / s);
+        }
+        else if (r[1][1] > r[2][2])
+        {
+            double s = std::sqrt(1 + r[1][1] - r[0][0] - r[2][2]) * 2;
+            q = glm::dvec4((r[1][0] + r[0][1]) / s, s / 4, (r[2][1] + r[1][2]) / s, (r[2][0] - r[0][2]) / s);
+        }
+        else
+        {
+            double s = std::sqrt(1 + r[2][2] - r[0][0] - r[1][1]) * 2;
+            q = glm::dvec4((r[2][0] + r[0][2]) / s, (r[2][1] + r[1][2]) / s, s / 4, (r[0][1] - r[1][0]) / s);
+        }
+        return q / glm::length(q);
+    }
+
+    // translation, rotation and scale of a placement, false when it has shear or a collapsed axis
+    bool Decompose(const glm::dmat4 &matrix, glm::dvec3 &translation, glm::dvec4 &rotation, glm::dvec3 &scale)
+    {
+        glm::dmat3 axes(matrix);
+        scale = glm::dvec3(glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]));
+        if (scale.x < SHEAR_TOLERANCE || scale.y < SHEAR_TOLERANCE || scale.z < SHEAR_TOLERANCE)
+        {
+            return false;
+        }
+        // a mirrored placement keeps a proper rotation with one negative scale
+        if (glm::determinant(axes) < 0)
+        {
+            scale.x = -scale.x;
+        }
+        glm::dmat3 r(axes[0] / scale.x, axes[1] / scale.y, axes[2] / scale.z);
+        if (std::abs(glm::dot(r[0], r[1])) > SHEAR_TOLERANCE || std::abs(glm::dot(r[0], r[2])) > SHEAR_TOLERANCE || std::abs(glm::dot(r[1], r[2])) > SHEAR_TOLERANCE)
+        {
+            return false;
+        }
+        rotation = RotationQuaternion(r);
+        translation = glm::dvec3(matrix[3]);
+        return true;
+    }
+
+    // the placement Decompose() took apart, the rotation is a unit quaternion (x, y, z, w)
+    glm::dmat4 Compose(const glm::dvec3 &translation, const glm::dvec4 &q, const glm::dvec3 &scale)
+    {
+        glm::dmat4 matrix(1);
+        matrix[0] = glm::dvec4(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.z * q.w), 2 * (q.x * q.z - q.y * q.w), 0) * scale.x;
+        matrix[1] = glm::dvec4(2 * (q.x * q.y - q.z * q.w), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.x * q.w), 0) * scale.y;
+        matrix[2] = glm::dvec4(2 * (q.x * q.z + q.y * q.w), 2 * (q.y * q.z - q.x * q.w), 1 - 2 * (q.x * q.x + q.y * q.y), 0) * scale.z;
+        matrix[3] = glm::dvec4(translation, 1);
+        return matrix;
+    }
+
+    template <typename T>
+    void WriteArray(std::ostream &out, const T &values, int count)
+    {
+        out << "[";
+        for (int i = 0; i < count; i++)
+        {
+            out << (i ? "," : "") << values[i];
+        }
+        out << "]";
+    }
+
+    // the .gltf text, handed to the output a block at a time so the whole of it is never held
+    struct JsonStream
+    {
+        std::ostringstream out;
+        const webifc::geometry::IfcGltfExporter::Output &output;
+
+        JsonStream(const webifc::geometry::IfcGltfExporter::Output &output) : output(output)
+        {
+            out << std::setprecision(9);
+        }
+
+        void Flush(bool force = false)
+        {
+            if (force || static_cast<size_t>(out.tellp()) >= OUTPUT_BLOCK)
+            {
+                std::string text = out.str();
+                output(text.data(), text.size());
+                out.str("");
+            }
+        }
+    };
+
+    // a relative file name in a JSON string
+    std::string EscapeJson(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+namespace webifc::geometry
+{
+
+    IfcGltfExporter::IfcGltfExporter(const Output &binary) : _binary(binary)
+    {
+    }
+
+    void IfcGltfExporter::AddMesh(IfcGeometryProcessor &processor, const IfcFlatMesh &mesh)
+    {
+        for (auto &placed : mesh.geometries)
+        {
+            IfcGeometry &geometry = processor.GetGeometry(placed.geometryExpressID);
+            // polylines and points have no triangles to draw
+            if (geometry.isPolygon || geometry.numPoints == 0 || geometry.indexData.empty())
+            {
+                continue;
+            }
+            uint32_t material = AddMaterial(placed.color);
+
+            Instance instance;
+            instance.expressID = mesh.expressID;
+            glm::dvec4 rotation;
+            glm::dvec3 scale;
+            if (!Decompose(placed.transformation, instance.translation, rotation, scale))
+            {
+                _baked.push_back({mesh.expressID, WriteGeometry(geometry, &placed.transformation), material});
+                continue;
+            }
+            instance.rotation = glm::vec4(rotation);
+            instance.scale = glm::vec3(scale);
+
+            auto viewIt = _geometryViews.find(placed.geometryExpressID);
+            if (viewIt == _geometryViews.end())
+            {
+                viewIt = _geometryViews.emplace(placed.geometryExpressID, WriteGeometry(geometry, nullptr)).first;
+            }
+            uint64_t key = (static_cast<uint64_t>(viewIt->second) << 32) | material;
+            auto groupIt = _groupIndices.find(key);
+            if (groupIt == _groupIndices.end())
+            {
+                groupIt = _groupIndices.emplace(key, static_cast<uint32_t>(_groups.size())).first;
+                _groups.push_back({viewIt->second, material, {}});
+            }
+            _groups[groupIt->second].instances.push_back(instance);
+        }
+    }
+
+    uint32_t IfcGltfExporter::AddMaterial(const glm::dvec4 &color)
+    {
+        // colours are merged at the 8 bit precision they end up with on screen
+        uint32_t key = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            key = (key << 8) | static_cast<uint32_t>(std::round(std::clamp(color[i], 0.0, 1.0) * 255));
+        }
+        auto it = _materialIndices.find(key);
+        if (it != _materialIndices.end())
+        {
+            return it->second;
+        }
+        _materials.push_back(color);
+        _materialIndices[key] = _materials.size() - 1;
+        return _materials.size() - 1;
+    }
+
+    uint32_t IfcGltfExporter::WriteGeometry(IfcGeometry &geometry, const glm::dmat4 *bake)
+    {
+        geometry.GetVertexData();
+        GeometryView view;
+        view.vertexCount = geometry.numPoints;
+        view.indexCount = geometry.indexData.size();
+        std::vector<float> baked;
+        std::vector<uint32_t> bakedIndices;
+        const float *vertices = geometry.fvertexData.data();
+        const uint32_t *indices = geometry.indexData.data();
+        if (bake != nullptr)
+        {
+            glm::dmat3 normalMatrix = glm::transpose(glm::inverse(glm::dmat3(*bake)));
+            baked.resize(geometry.fvertexData.size());
+            for (size_t i = 0; i + VERTEX_FORMAT_SIZE_FLOATS <= geometry.fvertexData.size(); i += VERTEX_FORMAT_SIZE_FLOATS)
+            {
+                glm::dvec3 p = *bake * glm::dvec4(vertices[i], vertices[i + 1], vertices[i + 2], 1);
+                glm::dvec3 n = normalMatrix * glm::dvec3(vertices[i + 3], vertices[i + 4], vertices[i + 5]);
+                double length = glm::length(n);
+                if (length > 0)
+                {
+                    n /= length;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    baked[i + k] = p[k];
+                    baked[i + 3 + k] = n[k];
+                }
+            }
+            vertices = baked.data();
+            // a mirroring placement turns the triangles inside out
+            if (glm::determinant(glm::dmat3(*bake)) < 0)
+            {
+                bakedIndices = geometry.indexData;
+                for (size_t i = 0; i + 2 < bakedIndices.size(); i += 3)
+                {
+                    std::swap(bakedIndices[i + 1], bakedIndices[i + 2]);
+                }
+                indices = bakedIndices.data();
+            }
+        }
+
+        view.min = glm::vec3(FLT_MAX);
+        view.max = glm::vec3(-FLT_MAX);
+        for (uint32_t i = 0; i < view.vertexCount; i++)
+        {
+            glm::vec3 p(vertices[i * VERTEX_FORMAT_SIZE_FLOATS], vertices[i * VERTEX_FORMAT_SIZE_FLOATS + 1], vertices[i * VERTEX_FORMAT_SIZE_FLOATS + 2]);
+            view.min = glm::min(view.min, p);
+            view.max = glm::max(view.max, p);
+        }
+
+        view.vertexOffset = _binarySize;
+        view.vertexBytes = static_cast<uint64_t>(view.vertexCount) * VERTEX_FORMAT_SIZE_FLOATS * sizeof(float);
+        Write(vertices, view.vertexBytes);
+        view.indexOffset = _binarySize;
+        view.indexBytes = static_cast<uint64_t>(view.indexCount) * sizeof(uint32_t);
+        Write(indices, view.indexBytes);
+
+        _views.push_back(view);
+        return _views.size() - 1;
+    }
+
+    void IfcGltfExporter::Write(const void *data, uint64_t size)
+    {
+        if (_pending.size() + size > OUTPUT_BLOCK)
+        {
+            FlushBinary();
+        }
+        // a geometry over a block goes out as it is instead of being copied
+        if (size >= OUTPUT_BLOCK)
+        {
+            _binary(static_cast<const char *>(data), size);
+        }
+        else
+        {
+            _pending.append(static_cast<const char *>(data), size);
+        }
+        _binarySize += size;
+    }
+
+    void IfcGltfExporter::FlushBinary()
+    {
+        if (!_pending.empty())
+        {
+            _binary(_pending.data(), _pending.size());
+            _pending.clear();
+        }
+    }
+
+    void IfcGltfExporter::Finish(const Output &output, const std::string &binaryUri)
+    {
+        // the node of an instanced group carries the whole placement of its first instance, so a loader without the
+        // extension still draws that one where it belongs, and the instance transforms are relative to it; a group with
+        // an instance that is not a translation, rotation and scale of the first gets a plain node per instance
+        struct InstanceData
+        {
+            bool instanced = false;
+            uint64_t translationOffset = 0;
+            uint64_t rotationOffset = 0;
+            uint64_t scaleOffset = 0;
+        };
+        std::vector<InstanceData> instanceData(_groups.size());
+        uint32_t instancedGroups = 0;
+        uint32_t nodeCount = _baked.size();
+        for (size_t g = 0; g < _groups.size(); g++)
+        {
+            auto &instances = _groups[g].instances;
+            nodeCount += instances.size();
+            if (instances.size() < 2)
+            {
+                continue;
+            }
+            auto &first = instances.front();
+            glm::dmat4 toFirst = glm::inverse(Compose(first.translation, first.rotation, first.scale));
+            std::vector<float> translations, rotations, scales;
+            translations.reserve(instances.size() * 3);
+            rotations.reserve(instances.size() * 4);
+            scales.reserve(instances.size() * 3);
+            bool relative = true;
+            for (auto &instance : instances)
+            {
+                glm::dvec3 translation, scale;
+                glm::dvec4 rotation;
+                if (!Decompose(toFirst * Compose(instance.translation, instance.rotation, instance.scale), translation, rotation, scale))
+                {
+                    relative = false;
+                    break;
+                }
+                translations.insert(translations.end(), {float(translation.x), float(translation.y), float(translation.z)});
+                rotations.insert(rotations.end(), {float(rotation.x), float(rotation.y), float(rotation.z), float(rotation.w)});
+                scales.insert(scales.end(), {float(scale.x), float(scale.y), float(scale.z)});
+            }
+            if (!relative)
+            {
+                continue;
+            }
+            instanceData[g].instanced = true;
+            instancedGroups++;
+            nodeCount -= instances.size() - 1;
+            instanceData[g].translationOffset = _binarySize;
+            Write(translations.data(), translations.size() * sizeof(float));
+            instanceData[g].rotationOffset = _binarySize;
+            Write(rotations.data(), rotations.size() * sizeof(float));
+            instanceData[g].scaleOffset = _binarySize;
+            Write(scales.data(), scales.size() * sizeof(float));
+        }
+        FlushBinary();
+
+        // the layout is fixed, so every index is known before it is written: mesh m draws group m, then the baked
+        // meshes follow; nodes go group by group, one per instance unless the group is instanced, then one per baked
+        // mesh; geometry view v has buffer views 2v and 2v + 1 and accessors 3v to 3v + 2 (positions, normals,
+        // indices), and the instanced groups follow with three buffer views and three accessors each
+        const uint32_t viewBufferViews = _views.size() * 2;
+        const uint32_t viewAccessors = _views.size() * 3;
+
+        JsonStream json(output);
+        json.out << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"web-ifc " << WEB_IFC_VERSION_NUMBER << "\"}";
+        // only used, not required: the file stays core glTF, see above
+        if (instancedGroups > 0)
+        {
+            json.out << ",\"extensionsUsed\":[\"EXT_mesh_gpu_instancing\"]";
+        }
+        json.out << ",\"scene\":0,\"scenes\":[{\"nodes\":[";
+        for (uint32_t i = 0; i < nodeCount; i++)
+        {
+            json.out << (i ? "," : "") << i;
+            json.Flush();
+        }
+        json.out << "]}]";
+
+        if (nodeCount > 0)
+        {
+            json.out << ",\"nodes\":[";
+            uint32_t node = 0;
+            uint32_t instanced = 0;
+            auto writeNode = [&](uint32_t mesh, const Instance &instance) {
+                json.out << (node++ ? "," : "") << "{\"mesh\":" << mesh << ",\"translation\":" << std::setprecision(17);
+                WriteArray(json.out, instance.translation, 3);
+                json.out << std::setprecision(9) << ",\"rotation\":";
+                WriteArray(json.out, instance.rotation, 4);
+                json.out << ",\"scale\":";
+                WriteArray(json.out, instance.scale, 3);
+            };
+            for (size_t g = 0; g < _groups.size(); g++)
+            {
+                auto &group = _groups[g];
+                if (!instanceData[g].instanced)
+                {
+                    for (auto &instance : group.instances)
+                    {
+                        writeNode(g, instance);
+                        json.out << ",\"name\":\"" << instance.expressID << "\"}";
+                        json.Flush();
+                    }
+                    continue;
+                }
+                writeNode(g, group.instances.front());
+                uint32_t accessor = viewAccessors + instanced++ * 3;
+                json.out << ",\"extensions\":{\"EXT_mesh_gpu_instancing\":{\"attributes\":{\"TRANSLATION\":" << accessor << ",\"ROTATION\":" << accessor + 1 << ",\"SCALE\":" << accessor + 2 << "}}}";
+                // the element behind each instance, in instance order
+                json.out << ",\"extras\":{\"expressIDs\":[";
+                for (size_t i = 0; i < group.instances.size(); i++)
+                {
+                    json.out << (i ? "," : "") << group.instances[i].expressID;
+                    json.Flush();
+                }
+                json.out << "]}}";
+            }
+            for (size_t b = 0; b < _baked.size(); b++)
+            {
+                json.out << (node++ ? "," : "") << "{\"mesh\":" << _groups.size() + b << ",\"name\":\"" << _baked[b].expressID << "\"}";
+                json.Flush();
+            }
+
+            json.out << "],\"meshes\":[";
+            auto writeMesh = [&](uint32_t view, uint32_t material, bool first) {
+                json.out << (first ? "" : ",") << "{\"primitives\":[{\"attributes\":{\"POSITION\":" << view * 3 << ",\"NORMAL\":" << view * 3 + 1 << "},\"indices\":" << view * 3 + 2 << ",\"material\":" << material << "}]}";
+                json.Flush();
+            };
+            uint32_t mesh = 0;
+            for (auto &group : _groups)
+            {
+                writeMesh(group.view, group.material, mesh++ == 0);
+            }
+            for (auto &baked : _baked)
+            {
+                writeMesh(baked.view, baked.material, mesh++ == 0);
+            }
+            json.out << "]";
+        }
+
+        if (!_materials.empty())
+        {
+            json.out << ",\"materials\":[";
+            for (size_t i = 0; i < _materials.size(); i++)
+            {
+                const glm::dvec4 &color = _materials[i];
+                json.out << (i ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":";
+                WriteArray(json.out, color, 4);
+                json.out << ",\"metallicFactor\":0,\"roughnessFactor\":1},\"doubleSided\":true";
+                if (color.a < 1)
+                {
+                    json.out << ",\"alphaMode\":\"BLEND\"";
+                }
+                json.out << "}";
+            }
+            json.out << "]";
+        }
+
+        if (_binarySize > 0)
+        {
+            auto writeAccessor = [&](uint32_t bufferView, uint64_t offset, uint32_t componentType, uint64_t count, const char *type, bool first) {
+                json.out << (first ? "" : ",") << "{\"bufferView\":" << bufferView << ",\"byteOffset\":" << offset << ",\"componentType\":" << componentType << ",\"count\":" << count << ",\"type\":\"" << type << "\"";
+            };
+            json.out << ",\"accessors\":[";
+            for (uint32_t v = 0; v < _views.size(); v++)
+            {
+                auto &view = _views[v];
+                writeAccessor(v * 2, 0, COMPONENT_FLOAT, view.vertexCount, "VEC3", v == 0);
+                json.out << ",\"min\":";
+                WriteArray(json.out, view.min, 3);
+                json.out << ",\"max\":";
+                WriteArray(json.out, view.max, 3);
+                json.out << "}";
+                writeAccessor(v * 2, 3 * sizeof(float), COMPONENT_FLOAT, view.vertexCount, "VEC3", false);
+                json.out << "}";
+                writeAccessor(v * 2 + 1, 0, COMPONENT_UNSIGNED_INT, view.indexCount, "SCALAR", false);
+                json.out << "}";
+                json.Flush();
+            }
+            uint32_t bufferView = viewBufferViews;
+            for (size_t g = 0; g < _groups.size(); g++)
+            {
+                if (!instanceData[g].instanced)
+                {
+                    continue;
+                }
+                uint64_t count = _groups[g].instances.size();
+                bool first = bufferView == 0;
+                writeAccessor(bufferView++, 0, COMPONENT_FLOAT, count, "VEC3", first);
+                json.out << "}";
+                writeAccessor(bufferView++, 0, COMPONENT_FLOAT, count, "VEC4", false);
+                json.out << "}";
+                writeAccessor(bufferView++, 0, COMPONENT_FLOAT, count, "VEC3", false);
+                json.out << "}";
+                json.Flush();
+            }
+
+            auto writeBufferView = [&](uint64_t offset, uint64_t length, uint32_t stride, uint32_t target, bool first) {
+                json.out << (first ? "" : ",") << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << length;
+                if (stride)
+                {
+                    json.out << ",\"byteStride\":" << stride;
+                }
+                if (target)
+                {
+                    json.out << ",\"target\":" << target;
+                }
+                json.out << "}";
+            };
+            json.out << "],\"bufferViews\":[";
+            for (uint32_t v = 0; v < _views.size(); v++)
+            {
+                auto &view = _views[v];
+                writeBufferView(view.vertexOffset, view.vertexBytes, VERTEX_FORMAT_SIZE_FLOATS * sizeof(float), ARRAY_BUFFER, v == 0);
+                writeBufferView(view.indexOffset, view.indexBytes, 0, ELEMENT_ARRAY_BUFFER, false);
+                json.Flush();
+            }
+            bool first = _views.empty();
+            for (size_t g = 0; g < _groups.size(); g++)
+            {
+                if (!instanceData[g].instanced)
+                {
+                    continue;
+                }
+                uint64_t count = _groups[g].instances.size();
+                writeBufferView(instanceData[g].translationOffset, count * 3 * sizeof(float), 0, 0, first);
+                writeBufferView(instanceData[g].rotationOffset, count * 4 * sizeof(float), 0, 0, false);
+                writeBufferView(instanceData[g].scaleOffset, count * 3 * sizeof(float), 0, 0, false);
+                first = false;
+                json.Flush();
+            }
+            json.out << "],\"buffers\":[{\"byteLength\":" << _binarySize << ",\"uri\":\"" << EscapeJson(binaryUri) << "\"}]";
+        }
+        json.out << "}";
+        json.Flush(true);
+    }
+
+}
@@ -0,0 +1,89 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "IfcGeometryProcessor.h"
+
+// Writes the flat meshes of a model as a glTF file and its binary buffer while they are streamed
+
+namespace webifc::geometry
+{
+
+    // the .bin buffer goes to its output the moment a geometry is first seen, only the description of the scene (buffer
+    // views, one transform per placement, materials) stays in memory until Finish() writes it as the .gltf file; a
+    // geometry placed more than once with the same colour becomes a single mesh drawn through EXT_mesh_gpu_instancing,
+    // which is used but not required, a loader without it draws the first placement only
+    class IfcGltfExporter
+    {
+    public:
+        using Output = std::function<void(const char *, size_t)>;
+        // binary receives the .bin file in consecutive pieces of at most about 1 MB
+        IfcGltfExporter(const Output &binary);
+        // the geometries of the mesh must still be held by the processor, call it before Clear()
+        void AddMesh(IfcGeometryProcessor &processor, const IfcFlatMesh &mesh);
+        // appends the instance transforms to the .bin file, then hands out the .gltf file in pieces, which refers to the
+        // .bin file by binaryUri
+        void Finish(const Output &json, const std::string &binaryUri);
+
+    private:
+        // an interleaved position and normal buffer view and an index buffer view in the binary chunk
+        struct GeometryView
+        {
+            uint64_t vertexOffset = 0;
+            uint64_t vertexBytes = 0;
+            uint64_t indexOffset = 0;
+            uint64_t indexBytes = 0;
+            uint32_t vertexCount = 0;
+            uint32_t indexCount = 0;
+            glm::vec3 min = glm::vec3(0);
+            glm::vec3 max = glm::vec3(0);
+        };
+        struct Instance
+        {
+            uint32_t expressID;
+            glm::dvec3 translation;
+            // quaternion as x, y, z, w, the order glTF stores it in
+            glm::vec4 rotation;
+            glm::vec3 scale;
+        };
+        // every placement of one geometry with one material
+        struct MeshGroup
+        {
+            uint32_t view;
+            uint32_t material;
+            std::vector<Instance> instances;
+        };
+        // placements with shear cannot be expressed as translation, rotation and scale, their vertices are
+        // transformed and written as a geometry of their own
+        struct BakedMesh
+        {
+            uint32_t expressID;
+            uint32_t view;
+            uint32_t material;
+        };
+        uint32_t AddMaterial(const glm::dvec4 &color);
+        uint32_t WriteGeometry(IfcGeometry &geometry, const glm::dmat4 *bake);
+        void Write(const void *data, uint64_t size);
+        void FlushBinary();
+        Output _binary;
+        // written to _binary in blocks, which keeps the number of calls into the output low
+        std::string _pending;
+        uint64_t _binarySize = 0;
+        std::vector<GeometryView> _views;
+        std::unordered_map<uint32_t, uint32_t> _geometryViews;
+        std::vector<glm::dvec4> _materials;
+        std::unordered_map<uint32_t, uint32_t> _materialIndices;
+        std::vector<MeshGroup> _groups;
+        std::unordered_map<uint64_t, uint32_t> _groupIndices;
+        std::vector<BakedMesh> _baked;
+    };
+
+}
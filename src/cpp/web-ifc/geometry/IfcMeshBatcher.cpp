@@ -0,0 +1,116 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+#include <algorithm>
+#include <glm/gtx/transform.hpp>
+#include "IfcMeshBatcher.h"
+
+namespace webifc::geometry
+{
+
+    IfcMeshBatcher::IfcMeshBatcher(uint32_t maxVertices, const std::function<void(IfcMeshBatch &)> &callback)
+        : _maxVertices(std::max(1u, maxVertices)), _callback(callback)
+    {
+    }
+
+    void IfcMeshBatcher::AddMesh(IfcGeometryProcessor &processor, const IfcFlatMesh &mesh)
+    {
+        for (auto &placed : mesh.geometries)
+        {
+            IfcGeometry &geometry = processor.GetGeometry(placed.geometryExpressID);
+            // polylines and points are not drawn with triangles, they stay with the per element stream
+            if (geometry.isPolygon || geometry.numPoints == 0 || geometry.indexData.empty())
+            {
+                continue;
+            }
+            geometry.GetVertexData();
+
+            uint32_t key = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                key = (key << 8) | static_cast<uint32_t>(std::round(std::clamp(placed.color[i], 0.0, 1.0) * 255));
+            }
+            auto batchIt = _batchIndices.find(key);
+            if (batchIt == _batchIndices.end())
+            {
+                batchIt = _batchIndices.emplace(key, static_cast<uint32_t>(_batches.size())).first;
+                _batches.emplace_back();
+                _batches.back().color = placed.color;
+            }
+            IfcMeshBatch &batch = _batches[batchIt->second];
+
+            uint32_t base = batch.vertexData.size() / VERTEX_FORMAT_SIZE_FLOATS;
+            if (base > 0 && base + geometry.numPoints > _maxVertices)
+            {
+                Emit(batch);
+                base = 0;
+            }
+            if (base == 0)
+            {
+                batch.transformation = glm::translate(glm::dvec3(placed.transformation * glm::dvec4(geometry.GetVertex(0), 1)));
+            }
+
+            glm::dmat4 matrix = glm::inverse(batch.transformation) * placed.transformation;
+            glm::dmat3 normalMatrix = glm::transpose(glm::inverse(glm::dmat3(placed.transformation)));
+            const std::vector<float> &vertices = geometry.fvertexData;
+            for (size_t i = 0; i + VERTEX_FORMAT_SIZE_FLOATS <= vertices.size(); i += VERTEX_FORMAT_SIZE_FLOATS)
+            {
+                glm::dvec3 p = matrix * glm::dvec4(vertices[i], vertices[i + 1], vertices[i + 2], 1);
+                glm::dvec3 n = normalMatrix * glm::dvec3(vertices[i + 3], vertices[i + 4], vertices[i + 5]);
+                double length = glm::length(n);
+                if (length > 0)
+                {
+                    n /= length;
+                }
+                batch.vertexData.insert(batch.vertexData.end(), {(float)p.x, (float)p.y, (float)p.z, (float)n.x, (float)n.y, (float)n.z});
+            }
+
+            // a mirroring placement turns the triangles inside out once they are transformed
+            bool mirrored = glm::determinant(glm::dmat3(placed.transformation)) < 0;
+            uint32_t firstIndex = batch.indexData.size();
+            for (size_t i = 0; i + 2 < geometry.indexData.size(); i += 3)
+            {
+                batch.indexData.push_back(base + geometry.indexData[i]);
+                batch.indexData.push_back(base + geometry.indexData[mirrored ? i + 2 : i + 1]);
+                batch.indexData.push_back(base + geometry.indexData[mirrored ? i + 1 : i + 2]);
+            }
+
+            // the geometries of one element usually follow each other, they share a range
+            if (!batch.ranges.empty() && batch.ranges.back().expressID == mesh.expressID && batch.ranges.back().firstIndex + batch.ranges.back().indexCount == firstIndex)
+            {
+                batch.ranges.back().indexCount += batch.indexData.size() - firstIndex;
+            }
+            else
+            {
+                batch.ranges.push_back({mesh.expressID, firstIndex, static_cast<uint32_t>(batch.indexData.size() - firstIndex)});
+            }
+        }
+    }
+
+    void IfcMeshBatcher::Flush()
+    {
+        for (auto &batch : _batches)
+        {
+            if (!batch.indexData.empty())
+            {
+                Emit(batch);
+            }
+        }
+    }
+
+    void IfcMeshBatcher::Emit(IfcMeshBatch &batch)
+    {
+        IfcPlacedGeometry placed;
+        placed.transformation = batch.transformation;
+        placed.SetFlatTransformation();
+        batch.flatTransformation = placed.flatTransformation;
+        _callback(batch);
+        // the colour and the slot stay, the buffers start over
+        batch.vertexData.clear();
+        batch.indexData.clear();
+        batch.ranges.clear();
+    }
+
+}
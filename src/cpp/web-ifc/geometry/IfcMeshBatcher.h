@@ -0,0 +1,59 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "IfcGeometryProcessor.h"
+
+// Merges streamed flat meshes into a few large buffers per colour, so a viewer needs one draw call per batch
+
+namespace webifc::geometry
+{
+
+    // the triangles of one element inside a batch, indices [firstIndex, firstIndex + indexCount)
+    struct IfcBatchRange
+    {
+        uint32_t expressID = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    struct IfcMeshBatch
+    {
+        glm::dvec4 color = glm::dvec4(1);
+        // positions and normals in the same layout as IfcGeometry::fvertexData, relative to transformation
+        std::vector<float> vertexData;
+        std::vector<uint32_t> indexData;
+        // a translation to the first vertex added, which keeps the float coordinates small far from the origin
+        glm::dmat4 transformation = glm::dmat4(1);
+        std::array<double, 16> flatTransformation;
+        // in index order, one per element and batch
+        std::vector<IfcBatchRange> ranges;
+    };
+
+    // geometries are transformed into their batch as they are added, so the processor may Clear() after every element;
+    // a batch goes to the callback once the next geometry would take it past maxVertices, the rest on Flush()
+    class IfcMeshBatcher
+    {
+    public:
+        IfcMeshBatcher(uint32_t maxVertices, const std::function<void(IfcMeshBatch &)> &callback);
+        void AddMesh(IfcGeometryProcessor &processor, const IfcFlatMesh &mesh);
+        void Flush();
+
+    private:
+        void Emit(IfcMeshBatch &batch);
+        uint32_t _maxVertices;
+        std::function<void(IfcMeshBatch &)> _callback;
+        // open batches in the order their colour was first seen, looked up by colour and opacity at 8 bit precision
+        std::vector<IfcMeshBatch> _batches;
+        std::unordered_map<uint32_t, uint32_t> _batchIndices;
+    };
+
+}
@@ -91,7 +91,7 @@ namespace fuzzybools
         template <typename T>
         bool IntersectRay(const glm::dvec3& origin, const glm::dvec3& dir, T callback)
         {
-            static std::vector<uint32_t> stack;
+            thread_local std::vector<uint32_t> stack;
             stack.clear();
 
             if (nodes.empty())
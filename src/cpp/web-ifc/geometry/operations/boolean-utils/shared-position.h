@@ -87,7 +87,7 @@ namespace fuzzybools
 
         Line()
         {
-            static size_t idcounter = 0;
+            thread_local size_t idcounter = 0;
             idcounter++;
             globalID = idcounter;
         }
@@ -226,7 +226,7 @@ namespace fuzzybools
 
         Point()
         {
-            static size_t idcounter = 0;
+            thread_local size_t idcounter = 0;
             idcounter++;
             globalID = idcounter;
         }
@@ -267,7 +267,7 @@ namespace fuzzybools
 
         Plane()
         {
-            static size_t idcounter = 0;
+            thread_local size_t idcounter = 0;
             idcounter++;
             globalID = idcounter;
         }
@@ -1249,7 +1249,7 @@ namespace fuzzybools
 
             std::set<std::pair<size_t, size_t>> edges;
             std::set<std::pair<size_t, size_t>> defaultEdges;
-            static int i = 0;
+            thread_local int i = 0;
             i++;
 
             for (auto &line : p.lines)
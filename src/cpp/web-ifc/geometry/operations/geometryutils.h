@@ -506,30 +506,24 @@ namespace webifc::geometry
 		return geom;
 	}
 
-	inline IfcGeometry Extrude(IfcProfile profile, glm::dvec3 dir, double distance, glm::dvec3 cuttingPlaneNormal = glm::dvec3(0), glm::dvec3 cuttingPlanePos = glm::dvec3(0))
+	inline IfcGeometry Extrude(const IfcProfile &profile, glm::dvec3 dir, double distance, glm::dvec3 cuttingPlaneNormal = glm::dvec3(0), glm::dvec3 cuttingPlanePos = glm::dvec3(0))
 	{
 		spdlog::debug("[Extrude({})]");
 
-		std::vector<bool> holesIndicesHash;
+		std::vector<std::vector<glm::dvec3>> profile_vector;
+		std::vector<glm::dvec3> profile_contour(profile.curve.points.begin(), profile.curve.points.end());
 
 		// check if first point is equal to last point, otherwise the outer loop of the shape is not closed
 		glm::dvec3 lastToFirstPoint = profile.curve.points.front() - profile.curve.points.back();
 		if (glm::length(lastToFirstPoint) > 1e-8)
 		{
-			profile.curve.points.push_back(profile.curve.points.front());
-		}
-
-		std::vector<std::vector<glm::dvec3>> profile_vector;
-		std::vector<glm::dvec3> profile_contour;
-		for (size_t i = 0; i < profile.curve.points.size(); i++)
-		{
-			profile_contour.push_back(profile.curve.points[i]);
+			profile_contour.push_back(profile.curve.points.front());
 		}
 		profile_vector.push_back(profile_contour);
 		for (size_t i = 0; i < profile.holes.size(); i++)
 		{
 			std::vector<glm::dvec3> hole_contour;
-			IfcCurve hole = profile.holes[i];
+			const IfcCurve &hole = profile.holes[i];
 			int pointCount = hole.points.size();
 			for (int j = 0; j < pointCount; j++)
 			{
@@ -666,29 +660,230 @@ namespace webifc::geometry
 		return bimGeometry::areaOfTriangle2D(a, b, c);
 	}
 
+	// Moller-Trumbore, distance is along dir (which does not need to be normalized) and the triangle is hit from both sides
+	inline bool RayTriangleDistance(const glm::dvec3 &origin, const glm::dvec3 &dir, const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c, double &distance)
+	{
+		glm::dvec3 ab = b - a;
+		glm::dvec3 ac = c - a;
+		glm::dvec3 p = glm::cross(dir, ac);
+		double det = glm::dot(ab, p);
+		if (std::fabs(det) < 1e-14)
+		{
+			return false;
+		}
+		double invDet = 1.0 / det;
+		glm::dvec3 s = origin - a;
+		double u = glm::dot(s, p) * invDet;
+		if (u < 0 || u > 1)
+		{
+			return false;
+		}
+		glm::dvec3 q = glm::cross(s, ab);
+		double v = glm::dot(dir, q) * invDet;
+		if (v < 0 || u + v > 1)
+		{
+			return false;
+		}
+		distance = glm::dot(ac, q) * invDet;
+		return distance >= 0;
+	}
+
+	// triangles cross when an edge of one passes through the other, point is the mean of those crossings;
+	// coplanar triangles never cross, so faces that only touch are not reported
+	inline bool TriangleTriangleIntersection(const glm::dvec3 &a0, const glm::dvec3 &a1, const glm::dvec3 &a2, const glm::dvec3 &b0, const glm::dvec3 &b1, const glm::dvec3 &b2, glm::dvec3 &point)
+	{
+		glm::dvec3 sum(0);
+		uint32_t crossings = 0;
+		auto testEdge = [&](const glm::dvec3 &p, const glm::dvec3 &q, const glm::dvec3 &c0, const glm::dvec3 &c1, const glm::dvec3 &c2)
+		{
+			double t;
+			if (RayTriangleDistance(p, q - p, c0, c1, c2, t) && t <= 1)
+			{
+				sum += p + (q - p) * t;
+				crossings++;
+			}
+		};
+		testEdge(a0, a1, b0, b1, b2);
+		testEdge(a1, a2, b0, b1, b2);
+		testEdge(a2, a0, b0, b1, b2);
+		testEdge(b0, b1, a0, a1, a2);
+		testEdge(b1, b2, a0, a1, a2);
+		testEdge(b2, b0, a0, a1, a2);
+		if (crossings == 0)
+		{
+			return false;
+		}
+		point = sum / static_cast<double>(crossings);
+		return true;
+	}
+
+	// Ericson, Real-Time Collision Detection 5.1.5
+	inline glm::dvec3 ClosestPointOnTriangle(const glm::dvec3 &p, const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c)
+	{
+		glm::dvec3 ab = b - a;
+		glm::dvec3 ac = c - a;
+		glm::dvec3 ap = p - a;
+		double d1 = glm::dot(ab, ap);
+		double d2 = glm::dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0)
+		{
+			return a;
+		}
+		glm::dvec3 bp = p - b;
+		double d3 = glm::dot(ab, bp);
+		double d4 = glm::dot(ac, bp);
+		if (d3 >= 0 && d4 <= d3)
+		{
+			return b;
+		}
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0)
+		{
+			return a + ab * (d1 / (d1 - d3));
+		}
+		glm::dvec3 cp = p - c;
+		double d5 = glm::dot(ab, cp);
+		double d6 = glm::dot(ac, cp);
+		if (d6 >= 0 && d5 <= d6)
+		{
+			return c;
+		}
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0)
+		{
+			return a + ac * (d2 / (d2 - d6));
+		}
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+		{
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+		double denom = 1.0 / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	// Ericson, Real-Time Collision Detection 5.1.9
+	inline double SegmentSegmentDistance(const glm::dvec3 &p1, const glm::dvec3 &q1, const glm::dvec3 &p2, const glm::dvec3 &q2, glm::dvec3 &c1, glm::dvec3 &c2)
+	{
+		glm::dvec3 d1 = q1 - p1;
+		glm::dvec3 d2 = q2 - p2;
+		glm::dvec3 r = p1 - p2;
+		double a = glm::dot(d1, d1);
+		double e = glm::dot(d2, d2);
+		double f = glm::dot(d2, r);
+		double s = 0;
+		double t = 0;
+		// segments shorter than this are treated as points
+		constexpr double degenerate = 1e-20;
+		if (a <= degenerate && e <= degenerate)
+		{
+			c1 = p1;
+			c2 = p2;
+			return glm::distance(c1, c2);
+		}
+		if (a <= degenerate)
+		{
+			t = std::clamp(f / e, 0.0, 1.0);
+		}
+		else
+		{
+			double c = glm::dot(d1, r);
+			if (e <= degenerate)
+			{
+				s = std::clamp(-c / a, 0.0, 1.0);
+			}
+			else
+			{
+				double b = glm::dot(d1, d2);
+				double denom = a * e - b * b;
+				s = denom != 0 ? std::clamp((b * f - c * e) / denom, 0.0, 1.0) : 0.0;
+				t = (b * s + f) / e;
+				if (t < 0)
+				{
+					t = 0;
+					s = std::clamp(-c / a, 0.0, 1.0);
+				}
+				else if (t > 1)
+				{
+					t = 1;
+					s = std::clamp((b - c) / a, 0.0, 1.0);
+				}
+			}
+		}
+		c1 = p1 + d1 * s;
+		c2 = p2 + d2 * t;
+		return glm::distance(c1, c2);
+	}
+
+	// distance between two triangles that do not cross, closest is the pair of points it is measured between
+	inline double TriangleTriangleDistance(const std::array<glm::dvec3, 3> &a, const std::array<glm::dvec3, 3> &b, glm::dvec3 &closestA, glm::dvec3 &closestB)
+	{
+		double best = DBL_MAX;
+		auto consider = [&](const glm::dvec3 &pa, const glm::dvec3 &pb)
+		{
+			double distance = glm::distance(pa, pb);
+			if (distance < best)
+			{
+				best = distance;
+				closestA = pa;
+				closestB = pb;
+			}
+		};
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			consider(a[i], ClosestPointOnTriangle(a[i], b[0], b[1], b[2]));
+			consider(ClosestPointOnTriangle(b[i], a[0], a[1], a[2]), b[i]);
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				glm::dvec3 ca, cb;
+				SegmentSegmentDistance(a[i], a[(i + 1) % 3], b[j], b[(j + 1) % 3], ca, cb);
+				consider(ca, cb);
+			}
+		}
+		return best;
+	}
+
 	inline double RandomDouble(double lo, double hi)
 	{
 		return lo + static_cast<double>(rand()) / (static_cast<double>(RAND_MAX / (hi - lo)));
 	}
 
-	inline std::optional<glm::dvec3> GetOriginRec(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, glm::dmat4 mat)
+	// the geometry of an item and the matrix that takes its vertices back to where they were tessellated: retained
+	// geometry is normalized once when it is retained, before anything reads it, so every reader gets the same doubles;
+	// shared holds what a parallel run lends its workers, read only
+	inline const IfcGeometry *FindOperand(uint32_t expressID, const std::unordered_map<uint32_t, IfcGeometry> &geometryMap, glm::dmat4 &normalization, const std::unordered_map<uint32_t, IfcGeometry> *shared = nullptr)
+	{
+		auto geomIt = geometryMap.find(expressID);
+		if (geomIt == geometryMap.end())
+		{
+			if (shared == nullptr || (geomIt = shared->find(expressID)) == shared->end())
+			{
+				return nullptr;
+			}
+		}
+		normalization = geomIt->second.IsNormalized() ? glm::translate(glm::dmat4(1), glm::dvec3(geomIt->second.normalizationCenter)) : glm::dmat4(1);
+		return &geomIt->second;
+	}
+
+	inline std::optional<glm::dvec3> GetOriginRec(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, glm::dmat4 mat, const std::unordered_map<uint32_t, IfcGeometry> *shared = nullptr)
 	{
 		glm::dmat4 newMat = mat * mesh.transformation;
 
 		bool transformationBreaksWinding = MatrixFlipsTriangles(newMat);
 
-		auto geomIt = geometryMap.find(mesh.expressID);
+		glm::dmat4 normalization;
+		const IfcGeometry *operand = FindOperand(mesh.expressID, geometryMap, normalization, shared);
 
-		if (geomIt != geometryMap.end())
+		if (operand != nullptr)
 		{
-			auto meshGeom = geomIt->second;
+			const IfcGeometry &meshGeom = *operand;
 
 			if (meshGeom.numFaces)
 			{
 				for (uint32_t i = 0; i < meshGeom.numFaces; i++)
 				{
 					bimGeometry::Face f = meshGeom.GetFace(i);
-					glm::dvec3 a = newMat * glm::dvec4(meshGeom.GetPoint(f.i0), 1);
+					glm::dvec3 a = newMat * normalization * glm::dvec4(meshGeom.GetPoint(f.i0), 1);
 
 					return a;
 				}
@@ -697,7 +892,7 @@ namespace webifc::geometry
 
 		for (auto &c : mesh.children)
 		{
-			auto v = GetOriginRec(c, geometryMap, newMat);
+			auto v = GetOriginRec(c, geometryMap, newMat, shared);
 			if (v.has_value())
 			{
 				return v;
@@ -707,9 +902,9 @@ namespace webifc::geometry
 		return std::nullopt;
 	}
 
-	inline glm::dvec3 GetOrigin(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap)
+	inline glm::dvec3 GetOrigin(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, const std::unordered_map<uint32_t, IfcGeometry> *shared = nullptr)
 	{
-		auto v = GetOriginRec(mesh, geometryMap, glm::dmat4(1));
+		auto v = GetOriginRec(mesh, geometryMap, glm::dmat4(1), shared);
 
 		if (v.has_value())
 		{
@@ -721,27 +916,31 @@ namespace webifc::geometry
 		}
 	}
 
-	inline void flattenRecursive(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, std::vector<IfcGeometry> &geoms, glm::dmat4 mat)
+	inline void flattenRecursive(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, std::vector<IfcGeometry> &geoms, glm::dmat4 mat, const std::unordered_map<uint32_t, IfcGeometry> *shared = nullptr)
 	{
 		glm::dmat4 newMat = mat * mesh.transformation;
 
 		bool transformationBreaksWinding = MatrixFlipsTriangles(newMat);
 
-		auto geomIt = geometryMap.find(mesh.expressID);
+		glm::dmat4 normalization;
+		const IfcGeometry *operand = FindOperand(mesh.expressID, geometryMap, normalization, shared);
 
-		if (geomIt != geometryMap.end())
+		if (operand != nullptr)
 		{
-			auto meshGeom = geomIt->second;
+			// operands are read in place, only the transformed result is allocated
+			const IfcGeometry &meshGeom = *operand;
 
 			if (meshGeom.part.size() > 0)
 			{
 				for (uint32_t i = 0; i < meshGeom.part.size(); i++)
 				{
 
-					IfcGeometry newMeshGeom = meshGeom.part[i];
+					const IfcGeometry &newMeshGeom = meshGeom.part[i];
 					if (newMeshGeom.numFaces)
 					{
 						IfcGeometry newGeom;
+						newGeom.vertexData.reserve(static_cast<size_t>(newMeshGeom.numFaces) * 3 * VERTEX_FORMAT_SIZE_FLOATS);
+						newGeom.indexData.reserve(static_cast<size_t>(newMeshGeom.numFaces) * 3);
 						newGeom.halfSpace = newMeshGeom.halfSpace;
 						if (newGeom.halfSpace)
 						{
@@ -768,7 +967,7 @@ namespace webifc::geometry
 							}
 						}
 
-						geoms.push_back(newGeom);
+						geoms.push_back(std::move(newGeom));
 					}
 				}
 			}
@@ -777,6 +976,8 @@ namespace webifc::geometry
 				if (meshGeom.numFaces)
 				{
 					IfcGeometry newGeom;
+					newGeom.vertexData.reserve(static_cast<size_t>(meshGeom.numFaces) * 3 * VERTEX_FORMAT_SIZE_FLOATS);
+					newGeom.indexData.reserve(static_cast<size_t>(meshGeom.numFaces) * 3);
 					newGeom.halfSpace = meshGeom.halfSpace;
 					if (newGeom.halfSpace)
 					{
@@ -786,12 +987,14 @@ namespace webifc::geometry
 						newGeom.halfSpaceZ = newMat * glm::dvec4(meshGeom.halfSpaceZ, 1);
 					}
 
+					// only the vertices are normalized, the half space fields and the parts keep their coordinates
+					glm::dmat4 pointMat = newMat * normalization;
 					for (uint32_t i = 0; i < meshGeom.numFaces; i++)
 					{
 						bimGeometry::Face f = meshGeom.GetFace(i);
-						glm::dvec3 a = newMat * glm::dvec4(meshGeom.GetPoint(f.i0), 1);
-						glm::dvec3 b = newMat * glm::dvec4(meshGeom.GetPoint(f.i1), 1);
-						glm::dvec3 c = newMat * glm::dvec4(meshGeom.GetPoint(f.i2), 1);
+						glm::dvec3 a = pointMat * glm::dvec4(meshGeom.GetPoint(f.i0), 1);
+						glm::dvec3 b = pointMat * glm::dvec4(meshGeom.GetPoint(f.i1), 1);
+						glm::dvec3 c = pointMat * glm::dvec4(meshGeom.GetPoint(f.i2), 1);
 
 						if (transformationBreaksWinding)
 						{
@@ -803,21 +1006,21 @@ namespace webifc::geometry
 						}
 					}
 
-					geoms.push_back(newGeom);
+					geoms.push_back(std::move(newGeom));
 				}
 			}
 		}
 
 		for (auto &c : mesh.children)
 		{
-			flattenRecursive(c, geometryMap, geoms, newMat);
+			flattenRecursive(c, geometryMap, geoms, newMat, shared);
 		}
 	}
 
-	inline std::vector<IfcGeometry> flatten(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, glm::dmat4 mat = glm::dmat4(1))
+	inline std::vector<IfcGeometry> flatten(IfcComposedMesh &mesh, std::unordered_map<uint32_t, IfcGeometry> &geometryMap, glm::dmat4 mat = glm::dmat4(1), const std::unordered_map<uint32_t, IfcGeometry> *shared = nullptr)
 	{
 		std::vector<IfcGeometry> geoms;
-		flattenRecursive(mesh, geometryMap, geoms, mat);
+		flattenRecursive(mesh, geometryMap, geoms, mat, shared);
 		return geoms;
 	}
 
@@ -0,0 +1,383 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.  */
+
+// Quadric error metric edge collapse (Garland & Heckbert), used to build the LODs of finished geometry
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "../representation/IfcGeometry.h"
+
+namespace webifc::geometry
+{
+
+	// symmetric 4x4 error quadric of a set of planes, only the 10 unique coefficients are stored
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0;
+		double b2 = 0, bc = 0, bd = 0;
+		double c2 = 0, cd = 0;
+		double d2 = 0;
+
+		void AddPlane(const glm::dvec3 &n, double d, double weight)
+		{
+			a2 += weight * n.x * n.x; ab += weight * n.x * n.y; ac += weight * n.x * n.z; ad += weight * n.x * d;
+			b2 += weight * n.y * n.y; bc += weight * n.y * n.z; bd += weight * n.y * d;
+			c2 += weight * n.z * n.z; cd += weight * n.z * d;
+			d2 += weight * d * d;
+		}
+
+		Quadric operator+(const Quadric &o) const
+		{
+			Quadric q;
+			q.a2 = a2 + o.a2; q.ab = ab + o.ab; q.ac = ac + o.ac; q.ad = ad + o.ad;
+			q.b2 = b2 + o.b2; q.bc = bc + o.bc; q.bd = bd + o.bd;
+			q.c2 = c2 + o.c2; q.cd = cd + o.cd;
+			q.d2 = d2 + o.d2;
+			return q;
+		}
+
+		double Error(const glm::dvec3 &p) const
+		{
+			return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+				 + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+				 + c2 * p.z * p.z + 2 * cd * p.z
+				 + d2;
+		}
+
+		// point of minimal error, fails when the planes do not pin down a single point (flat or straight regions)
+		bool Minimum(glm::dvec3 &p) const
+		{
+			glm::dmat3 a(a2, ab, ac, ab, b2, bc, ac, bc, c2);
+			double det = glm::determinant(a);
+			if (std::abs(det) < 1e-9)
+			{
+				return false;
+			}
+			p = -(glm::inverse(a) * glm::dvec3(ad, bd, cd));
+			return true;
+		}
+	};
+
+	struct MeshSimplifySettings
+	{
+		// fraction of the input triangles to keep
+		double targetRatio = 0.5;
+		// largest allowed collapse error, as a squared distance
+		double maxError = 1e-4;
+		// edges between faces whose normals differ by more than this angle are kept
+		double creaseAngle = 0.5235987755982988; // 30 degrees
+	};
+
+	// simplifies a triangle soup (the output of AddFace, every face with its own three points) by welding
+	// coincident points and collapsing the cheapest edges first, boundary and crease edges are held in place
+	// by constraint planes; the result is emitted with flat face normals like the input
+	inline IfcGeometry SimplifyGeometry(const IfcGeometry &geom, const MeshSimplifySettings &settings)
+	{
+		constexpr double FEATURE_WEIGHT = 1000.0;
+		constexpr double MIN_NORMAL_DOT = 0.2;
+
+		// weld points that are exactly the same, AddFace duplicates every shared corner
+		std::vector<glm::dvec3> positions;
+		std::vector<std::array<uint32_t, 3>> faces;
+		{
+			glm::dvec3 bmin(std::numeric_limits<double>::max());
+			glm::dvec3 bmax(std::numeric_limits<double>::lowest());
+			for (uint32_t i = 0; i < geom.numPoints; i++)
+			{
+				bmin = glm::min(bmin, geom.GetPoint(i));
+				bmax = glm::max(bmax, geom.GetPoint(i));
+			}
+			double step = std::max(glm::length(bmax - bmin), 1.0) * 1e-9;
+
+			struct KeyHash
+			{
+				size_t operator()(const std::array<int64_t, 3> &k) const
+				{
+					return std::hash<int64_t>()(k[0]) ^ (std::hash<int64_t>()(k[1]) * 31) ^ (std::hash<int64_t>()(k[2]) * 1031);
+				}
+			};
+			std::unordered_map<std::array<int64_t, 3>, uint32_t, KeyHash> welded;
+			std::vector<uint32_t> remap(geom.numPoints);
+			for (uint32_t i = 0; i < geom.numPoints; i++)
+			{
+				glm::dvec3 p = geom.GetPoint(i);
+				std::array<int64_t, 3> key = {std::llround(p.x / step), std::llround(p.y / step), std::llround(p.z / step)};
+				auto [it, inserted] = welded.emplace(key, static_cast<uint32_t>(positions.size()));
+				if (inserted)
+				{
+					positions.push_back(p);
+				}
+				remap[i] = it->second;
+			}
+
+			faces.reserve(geom.numFaces);
+			for (uint32_t i = 0; i < geom.numFaces; i++)
+			{
+				bimGeometry::Face f = geom.GetFace(i);
+				std::array<uint32_t, 3> face = {remap[f.i0], remap[f.i1], remap[f.i2]};
+				if (face[0] != face[1] && face[1] != face[2] && face[0] != face[2])
+				{
+					faces.push_back(face);
+				}
+			}
+		}
+
+		auto faceNormal = [&](const std::array<uint32_t, 3> &f) {
+			return glm::cross(positions[f[1]] - positions[f[0]], positions[f[2]] - positions[f[0]]);
+		};
+
+		std::vector<Quadric> quadrics(positions.size());
+		std::vector<std::vector<uint32_t>> vertexFaces(positions.size());
+		std::unordered_map<uint64_t, std::vector<uint32_t>> edgeFaces;
+		auto edgeKey = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); };
+
+		for (uint32_t i = 0; i < faces.size(); i++)
+		{
+			glm::dvec3 n = faceNormal(faces[i]);
+			double length = glm::length(n);
+			if (length > 0)
+			{
+				n /= length;
+				for (uint32_t corner : faces[i])
+				{
+					quadrics[corner].AddPlane(n, -glm::dot(n, positions[faces[i][0]]), 1.0);
+				}
+			}
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				vertexFaces[faces[i][j]].push_back(i);
+				edgeFaces[edgeKey(faces[i][j], faces[i][(j + 1) % 3])].push_back(i);
+			}
+		}
+
+		// boundary, crease and non manifold edges get a heavy plane through the edge, perpendicular to each face
+		double creaseCos = std::cos(settings.creaseAngle);
+		for (auto &[key, adjacent] : edgeFaces)
+		{
+			bool feature = adjacent.size() != 2;
+			if (!feature)
+			{
+				glm::dvec3 n0 = faceNormal(faces[adjacent[0]]);
+				glm::dvec3 n1 = faceNormal(faces[adjacent[1]]);
+				double lengths = glm::length(n0) * glm::length(n1);
+				feature = lengths == 0 || glm::dot(n0, n1) / lengths < creaseCos;
+			}
+			if (!feature)
+			{
+				continue;
+			}
+			uint32_t a = static_cast<uint32_t>(key >> 32);
+			uint32_t b = static_cast<uint32_t>(key & 0xFFFFFFFF);
+			glm::dvec3 edge = positions[b] - positions[a];
+			for (uint32_t faceIndex : adjacent)
+			{
+				glm::dvec3 n = glm::cross(edge, faceNormal(faces[faceIndex]));
+				double length = glm::length(n);
+				if (length == 0)
+				{
+					continue;
+				}
+				n /= length;
+				double d = -glm::dot(n, positions[a]);
+				quadrics[a].AddPlane(n, d, FEATURE_WEIGHT);
+				quadrics[b].AddPlane(n, d, FEATURE_WEIGHT);
+			}
+		}
+		edgeFaces.clear();
+
+		struct Collapse
+		{
+			double cost;
+			uint32_t from, to;
+			uint32_t fromVersion, toVersion;
+			glm::dvec3 target;
+			bool operator>(const Collapse &other) const { return cost > other.cost; }
+		};
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+		std::vector<uint32_t> versions(positions.size(), 0);
+		std::vector<bool> vertexAlive(positions.size(), true);
+		std::vector<bool> faceAlive(faces.size(), true);
+
+		auto pushCollapse = [&](uint32_t from, uint32_t to) {
+			Quadric q = quadrics[from] + quadrics[to];
+			glm::dvec3 mid = (positions[from] + positions[to]) * 0.5;
+			glm::dvec3 target;
+			// the optimum is only trusted near the edge, far away points come from nearly degenerate quadrics
+			if (!q.Minimum(target) || glm::distance(target, mid) > glm::distance(positions[from], positions[to]))
+			{
+				target = mid;
+				for (const glm::dvec3 &candidate : {positions[from], positions[to]})
+				{
+					if (q.Error(candidate) < q.Error(target))
+					{
+						target = candidate;
+					}
+				}
+			}
+			queue.push({std::max(0.0, q.Error(target)), from, to, versions[from], versions[to], target});
+		};
+
+		for (auto &face : faces)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				if (face[j] < face[(j + 1) % 3])
+				{
+					pushCollapse(face[j], face[(j + 1) % 3]);
+				}
+			}
+		}
+
+		size_t liveFaces = faces.size();
+		size_t targetFaces = static_cast<size_t>(std::ceil(faces.size() * settings.targetRatio));
+		std::vector<uint32_t> neighbours;
+		std::vector<uint32_t> counted;
+		while (liveFaces > targetFaces && !queue.empty())
+		{
+			Collapse collapse = queue.top();
+			queue.pop();
+			uint32_t from = collapse.from;
+			uint32_t to = collapse.to;
+			if (!vertexAlive[from] || !vertexAlive[to] || versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion)
+			{
+				continue;
+			}
+			if (collapse.cost > settings.maxError)
+			{
+				break;
+			}
+
+			// link condition: the two ends may only share the neighbours of the faces on the edge itself
+			uint32_t sharedFaces = 0;
+			neighbours.clear();
+			for (uint32_t faceIndex : vertexFaces[from])
+			{
+				if (!faceAlive[faceIndex]) continue;
+				auto &f = faces[faceIndex];
+				if (std::find(f.begin(), f.end(), to) != f.end()) sharedFaces++;
+				for (uint32_t corner : f)
+				{
+					if (corner != from && corner != to) neighbours.push_back(corner);
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			uint32_t sharedNeighbours = 0;
+			counted.clear();
+			for (uint32_t faceIndex : vertexFaces[to])
+			{
+				if (!faceAlive[faceIndex]) continue;
+				for (uint32_t corner : faces[faceIndex])
+				{
+					if (corner != from && corner != to && std::binary_search(neighbours.begin(), neighbours.end(), corner) && std::find(counted.begin(), counted.end(), corner) == counted.end())
+					{
+						counted.push_back(corner);
+						sharedNeighbours++;
+					}
+				}
+			}
+			if (sharedFaces == 0 || sharedNeighbours != sharedFaces)
+			{
+				continue;
+			}
+
+			// reject collapses that flip or squash any of the remaining faces
+			bool valid = true;
+			for (uint32_t end : {from, to})
+			{
+				for (uint32_t faceIndex : vertexFaces[end])
+				{
+					if (!faceAlive[faceIndex]) continue;
+					auto f = faces[faceIndex];
+					if (std::find(f.begin(), f.end(), from) != f.end() && std::find(f.begin(), f.end(), to) != f.end()) continue;
+					glm::dvec3 before = faceNormal(f);
+					for (auto &corner : f)
+					{
+						if (corner == end) corner = static_cast<uint32_t>(positions.size());
+					}
+					glm::dvec3 p[3];
+					for (uint32_t j = 0; j < 3; j++)
+					{
+						p[j] = f[j] == positions.size() ? collapse.target : positions[f[j]];
+					}
+					glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+					double lengths = glm::length(before) * glm::length(after);
+					if (lengths == 0 || glm::dot(before, after) / lengths < MIN_NORMAL_DOT)
+					{
+						valid = false;
+						break;
+					}
+				}
+				if (!valid) break;
+			}
+			if (!valid)
+			{
+				continue;
+			}
+
+			// collapse `from` into `to`
+			positions[to] = collapse.target;
+			quadrics[to] = quadrics[to] + quadrics[from];
+			for (uint32_t faceIndex : vertexFaces[from])
+			{
+				if (!faceAlive[faceIndex]) continue;
+				auto &f = faces[faceIndex];
+				if (std::find(f.begin(), f.end(), to) != f.end())
+				{
+					faceAlive[faceIndex] = false;
+					liveFaces--;
+					continue;
+				}
+				for (auto &corner : f)
+				{
+					if (corner == from) corner = to;
+				}
+				vertexFaces[to].push_back(faceIndex);
+			}
+			vertexAlive[from] = false;
+			std::vector<uint32_t>().swap(vertexFaces[from]);
+			versions[to]++;
+
+			auto &toFaces = vertexFaces[to];
+			toFaces.erase(std::remove_if(toFaces.begin(), toFaces.end(), [&](uint32_t faceIndex) { return !faceAlive[faceIndex]; }), toFaces.end());
+			neighbours.clear();
+			for (uint32_t faceIndex : toFaces)
+			{
+				for (uint32_t corner : faces[faceIndex])
+				{
+					if (corner != to) neighbours.push_back(corner);
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			for (uint32_t neighbour : neighbours)
+			{
+				pushCollapse(to, neighbour);
+			}
+		}
+
+		IfcGeometry result;
+		result.vertexData.reserve(liveFaces * 3 * VERTEX_FORMAT_SIZE_FLOATS);
+		result.indexData.reserve(liveFaces * 3);
+		for (uint32_t i = 0; i < faces.size(); i++)
+		{
+			if (faceAlive[i])
+			{
+				result.AddFace(positions[faces[i][0]], positions[faces[i][1]], positions[faces[i][2]]);
+			}
+		}
+		return result;
+	}
+
+}
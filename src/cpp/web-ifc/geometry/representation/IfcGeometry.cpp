@@ -4,8 +4,13 @@
 
 // Implementation for IfcGeometry
 
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
 #include "IfcGeometry.h"
 #include "../operations/geometryutils.h"
+#include "../operations/mesh_simplify.h"
 
 namespace webifc::geometry {
 
@@ -142,6 +147,31 @@ namespace webifc::geometry {
 			return totalVolume;
 		}
 	
+	GeometryCopyStats &GetThreadGeometryCopyStats()
+	{
+		static thread_local GeometryCopyStats stats;
+		return stats;
+	}
+
+	static void CountGeometryCopy(const IfcGeometry &geom)
+	{
+		// parts are IfcGeometry as well and count themselves
+		GeometryCopyStats &stats = GetThreadGeometryCopyStats();
+		stats.copies++;
+		stats.bytes += geom.vertexData.size() * sizeof(double) + geom.fvertexData.size() * sizeof(float) + (geom.indexData.size() + geom.planeData.size()) * sizeof(uint32_t) + geom.planes.size() * sizeof(Plane);
+	}
+
+	GeometryCopyCounter::GeometryCopyCounter(const GeometryCopyCounter &other)
+	{
+		CountGeometryCopy(static_cast<const IfcGeometry &>(other));
+	}
+
+	GeometryCopyCounter &GeometryCopyCounter::operator=(const GeometryCopyCounter &other)
+	{
+		CountGeometryCopy(static_cast<const IfcGeometry &>(other));
+		return *this;
+	}
+
 	void IfcGeometry::ReverseFace(uint32_t index)
 	{
 			bimGeometry::Face f = GetFace(index);
@@ -158,6 +188,11 @@ namespace webifc::geometry {
 		}
 	}
 
+	bool IfcGeometry::IsNormalized() const
+	{
+		return normalized;
+	}
+
 	glm::dmat4 IfcGeometry::Normalize()
 	{
 		glm::dvec3 center = normalizationCenter;
@@ -210,10 +245,265 @@ namespace webifc::geometry {
 		return  resultMat;
 	}
 
+	uint64_t IfcGeometry::ContentHash() const
+	{
+		// FNV-1a over the raw vertex and index buffers, only exact copies are expected to collide
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&hash](const void *data, size_t size)
+		{
+			const uint8_t *bytes = static_cast<const uint8_t *>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		mix(vertexData.data(), vertexData.size() * sizeof(double));
+		mix(indexData.data(), indexData.size() * sizeof(uint32_t));
+		hash ^= (isPolygon ? 1 : 0) | (halfSpace ? 2 : 0);
+		return hash;
+	}
+
+	bool IfcGeometry::SameContent(const IfcGeometry &other) const
+	{
+		if (isPolygon != other.isPolygon || halfSpace != other.halfSpace || !part.empty() || !other.part.empty() || indexData != other.indexData)
+		{
+			return false;
+		}
+		if (!compact && !other.compact)
+		{
+			return vertexData == other.vertexData;
+		}
+		// a compacted geometry only has its float buffer left, so that is what both sides are compared on
+		const IfcGeometry &compactGeom = compact ? *this : other;
+		const IfcGeometry &otherGeom = compact ? other : *this;
+		if (otherGeom.compact)
+		{
+			return compactGeom.fvertexData == otherGeom.fvertexData;
+		}
+		if (compactGeom.fvertexData.size() != otherGeom.vertexData.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < otherGeom.vertexData.size(); i++)
+		{
+			if (compactGeom.fvertexData[i] != static_cast<float>(otherGeom.vertexData[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void IfcGeometry::CompactVertexData()
+	{
+		// keeps only the float buffer handed out by GetVertexData(), GetPoint() reads that one afterwards at float precision
+		// so this is only meant for finished (normalized, post boolean) geometry
+		if (compact)
+		{
+			return;
+		}
+		GetVertexData();
+		std::vector<double>().swap(vertexData);
+		for (auto &lod : lods)
+		{
+			lod.CompactVertexData();
+		}
+		compact = true;
+	}
+
+	void IfcGeometry::BuildLods(uint32_t levels)
+	{
+		// every level keeps about half of the triangles of the previous one, with an error bound that grows with it
+		// relative to the size of the geometry; levels that no longer reduce anything are not stored
+		constexpr uint32_t MIN_LOD_FACES = 64;
+		if (lodsBuilt || compact || isPolygon || halfSpace)
+		{
+			return;
+		}
+		lodsBuilt = true;
+		if (numFaces < MIN_LOD_FACES)
+		{
+			return;
+		}
+
+		glm::dvec3 center;
+		glm::dvec3 extents;
+		GetCenterExtents(center, extents);
+		double size = glm::length(extents);
+
+		MeshSimplifySettings settings;
+		double tolerance = 0.005;
+		const IfcGeometry *source = this;
+		for (uint32_t level = 0; level < levels && source->numFaces >= MIN_LOD_FACES; level++)
+		{
+			settings.maxError = (size * tolerance) * (size * tolerance);
+			IfcGeometry lod = SimplifyGeometry(*source, settings);
+			if (lod.numFaces == 0 || lod.numFaces > source->numFaces * 0.9)
+			{
+				break;
+			}
+			lod.normalizationCenter = normalizationCenter;
+			lod.normalized = normalized;
+			lod.lodsBuilt = true;
+			lods.push_back(std::move(lod));
+			source = &lods.back();
+			tolerance *= 4;
+		}
+	}
+
+	IfcGeometry &IfcGeometry::GetLod(uint32_t lod)
+	{
+		// 0 is this geometry, levels that were not built fall back to the coarsest one available
+		if (lod == 0 || lods.empty())
+		{
+			return *this;
+		}
+		return lods[std::min<size_t>(lod, lods.size()) - 1];
+	}
+
+	uint32_t IfcGeometry::GetLodCount() const
+	{
+		return static_cast<uint32_t>(lods.size()) + 1;
+	}
+
+	VertexWeldStats IfcGeometry::WeldVertices(double tolerance)
+	{
+		// AddFace() gives every triangle three vertices of its own, this merges the ones closer than tolerance that
+		// also share their normal, so flat shaded faces end up sharing indices; candidates are found through a hash of
+		// grid cells of size tolerance, a vertex is compared with the vertices already kept in its own and the 26
+		// neighbouring cells
+		constexpr double NORMAL_TOLERANCE = 1e-4;
+		VertexWeldStats stats;
+		if (welded || compact || isPolygon || numPoints == 0 || !(tolerance > 0))
+		{
+			return stats;
+		}
+		welded = true;
+
+		auto cellKey = [](int64_t x, int64_t y, int64_t z)
+		{
+			return static_cast<uint64_t>(x) * 73856093ull ^ static_cast<uint64_t>(y) * 19349663ull ^ static_cast<uint64_t>(z) * 83492791ull;
+		};
+
+		std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+		cells.reserve(numPoints);
+		std::vector<uint32_t> remap(numPoints);
+		std::vector<double> weldedVertexData;
+		weldedVertexData.reserve(vertexData.size());
+		uint32_t weldedPoints = 0;
+		const double toleranceSq = tolerance * tolerance;
+		for (uint32_t i = 0; i < numPoints; i++)
+		{
+			const double *vertex = &vertexData[i * VERTEX_FORMAT_SIZE_FLOATS];
+			glm::dvec3 point(vertex[0], vertex[1], vertex[2]);
+			glm::dvec3 normal(vertex[3], vertex[4], vertex[5]);
+			int64_t cx = static_cast<int64_t>(std::floor(point.x / tolerance));
+			int64_t cy = static_cast<int64_t>(std::floor(point.y / tolerance));
+			int64_t cz = static_cast<int64_t>(std::floor(point.z / tolerance));
+
+			uint32_t match = UINT32_MAX;
+			for (int64_t dx = -1; dx <= 1 && match == UINT32_MAX; dx++)
+			{
+				for (int64_t dy = -1; dy <= 1 && match == UINT32_MAX; dy++)
+				{
+					for (int64_t dz = -1; dz <= 1 && match == UINT32_MAX; dz++)
+					{
+						auto it = cells.find(cellKey(cx + dx, cy + dy, cz + dz));
+						if (it == cells.end())
+						{
+							continue;
+						}
+						for (uint32_t candidate : it->second)
+						{
+							const double *kept = &weldedVertexData[candidate * VERTEX_FORMAT_SIZE_FLOATS];
+							glm::dvec3 pointDelta = glm::dvec3(kept[0], kept[1], kept[2]) - point;
+							glm::dvec3 normalDelta = glm::dvec3(kept[3], kept[4], kept[5]) - normal;
+							if (glm::dot(pointDelta, pointDelta) <= toleranceSq && glm::dot(normalDelta, normalDelta) <= NORMAL_TOLERANCE * NORMAL_TOLERANCE)
+							{
+								match = candidate;
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			if (match == UINT32_MAX)
+			{
+				match = weldedPoints++;
+				weldedVertexData.insert(weldedVertexData.end(), vertex, vertex + VERTEX_FORMAT_SIZE_FLOATS);
+				cells[cellKey(cx, cy, cz)].push_back(match);
+			}
+			remap[i] = match;
+		}
+
+		// triangles thinner than the tolerance collapse onto a repeated index and are dropped with their plane
+		bool keepPlanes = planeData.size() == numFaces;
+		std::vector<uint32_t> weldedIndexData;
+		std::vector<uint32_t> weldedPlaneData;
+		weldedIndexData.reserve(indexData.size());
+		for (uint32_t f = 0; f < numFaces; f++)
+		{
+			uint32_t a = remap[indexData[f * 3 + 0]];
+			uint32_t b = remap[indexData[f * 3 + 1]];
+			uint32_t c = remap[indexData[f * 3 + 2]];
+			if (a == b || b == c || a == c)
+			{
+				continue;
+			}
+			weldedIndexData.push_back(a);
+			weldedIndexData.push_back(b);
+			weldedIndexData.push_back(c);
+			if (keepPlanes)
+			{
+				weldedPlaneData.push_back(planeData[f]);
+			}
+		}
+
+		stats.geometries = 1;
+		stats.verticesBefore = numPoints;
+		stats.verticesAfter = weldedPoints;
+		stats.bytesSaved = static_cast<uint64_t>(numPoints - weldedPoints) * VERTEX_FORMAT_SIZE_FLOATS * sizeof(float);
+
+		vertexData = std::move(weldedVertexData);
+		indexData = std::move(weldedIndexData);
+		if (keepPlanes)
+		{
+			planeData = std::move(weldedPlaneData);
+		}
+		numPoints = weldedPoints;
+		numFaces = static_cast<uint32_t>(indexData.size() / 3);
+		std::vector<float>().swap(fvertexData);
+		return stats;
+	}
+
+	bool IfcGeometry::IsCompact() const
+	{
+		return compact;
+	}
+
+	glm::dvec3 IfcGeometry::GetVertex(size_t index) const
+	{
+		return GetPoint(index);
+	}
+
+	glm::dvec3 IfcGeometry::GetPoint(size_t index) const
+	{
+		if (!compact)
+		{
+			return Geometry::GetPoint(index);
+		}
+		return glm::dvec3(
+			fvertexData[index * VERTEX_FORMAT_SIZE_FLOATS + 0],
+			fvertexData[index * VERTEX_FORMAT_SIZE_FLOATS + 1],
+			fvertexData[index * VERTEX_FORMAT_SIZE_FLOATS + 2]);
+	}
+
 	uint32_t IfcGeometry::GetVertexData()
 	{
 		// unfortunately webgl can't do doubles
-		if (fvertexData.size() != vertexData.size())
+		if (!compact && fvertexData.size() != vertexData.size())
 		{
 			fvertexData.resize(vertexData.size());
 			for (size_t i = 0; i < vertexData.size(); i++)
@@ -246,24 +536,135 @@ namespace webifc::geometry {
 		return (uint32_t)indexData.size();
 	}
 
+	void IfcGeometry::BuildQuantizedData()
+	{
+		// positions become 16 bit fractions of the bounding box of the normalized vertices, GetDequantizationMatrix()
+		// maps them back; normals are octahedron encoded into one byte per axis (x in the low byte, y in the high one)
+		auto component = [this](size_t i) -> double { return compact ? fvertexData[i] : vertexData[i]; };
+		qvertexData.clear();
+		if (numPoints == 0)
+		{
+			return;
+		}
+
+		glm::dvec3 minPt(std::numeric_limits<double>::max());
+		glm::dvec3 maxPt(std::numeric_limits<double>::lowest());
+		for (size_t i = 0; i < numPoints; i++)
+		{
+			glm::dvec3 pt(component(i * VERTEX_FORMAT_SIZE_FLOATS + 0), component(i * VERTEX_FORMAT_SIZE_FLOATS + 1), component(i * VERTEX_FORMAT_SIZE_FLOATS + 2));
+			minPt = glm::min(minPt, pt);
+			maxPt = glm::max(maxPt, pt);
+		}
+		quantizationMin = minPt;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double extent = maxPt[axis] - minPt[axis];
+			quantizationStep[axis] = extent > 0 ? extent / 65535.0 : 1.0;
+		}
+
+		auto toByte = [](double v) { return static_cast<uint16_t>(std::lround((std::clamp(v, -1.0, 1.0) * 0.5 + 0.5) * 255.0)); };
+		qvertexData.resize(static_cast<size_t>(numPoints) * QUANTIZED_VERTEX_SIZE);
+		for (size_t i = 0; i < numPoints; i++)
+		{
+			size_t source = i * VERTEX_FORMAT_SIZE_FLOATS;
+			uint16_t *target = &qvertexData[i * QUANTIZED_VERTEX_SIZE];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				double q = std::round((component(source + axis) - quantizationMin[axis]) / quantizationStep[axis]);
+				target[axis] = static_cast<uint16_t>(std::clamp(q, 0.0, 65535.0));
+			}
+
+			glm::dvec3 normal(component(source + 3), component(source + 4), component(source + 5));
+			double l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+			double ox = 0;
+			double oy = 0;
+			if (l1 > 0)
+			{
+				ox = normal.x / l1;
+				oy = normal.y / l1;
+				if (normal.z < 0)
+				{
+					double fx = (1 - std::abs(oy)) * (ox >= 0 ? 1 : -1);
+					double fy = (1 - std::abs(ox)) * (oy >= 0 ? 1 : -1);
+					ox = fx;
+					oy = fy;
+				}
+			}
+			target[3] = static_cast<uint16_t>(toByte(ox) | (toByte(oy) << 8));
+		}
+	}
+
+	uint32_t IfcGeometry::GetQuantizedVertexData()
+	{
+		if (qvertexData.size() != static_cast<size_t>(numPoints) * QUANTIZED_VERTEX_SIZE)
+		{
+			BuildQuantizedData();
+		}
+		if (qvertexData.empty())
+		{
+			return 0;
+		}
+		return (uint32_t)(size_t)&qvertexData[0];
+	}
+
+	uint32_t IfcGeometry::GetQuantizedVertexDataSize()
+	{
+		return numPoints * QUANTIZED_VERTEX_SIZE;
+	}
+
+	uint32_t IfcGeometry::GetQuantizedIndexData()
+	{
+		// 16 bit indices only exist below 65536 vertices, larger geometries have to use GetIndexData()
+		if (GetQuantizedIndexDataSize() == 0)
+		{
+			return 0;
+		}
+		if (qindexData.size() != indexData.size())
+		{
+			qindexData.assign(indexData.begin(), indexData.end());
+		}
+		return (uint32_t)(size_t)&qindexData[0];
+	}
+
+	uint32_t IfcGeometry::GetQuantizedIndexDataSize()
+	{
+		return numPoints < 65536 ? (uint32_t)indexData.size() : 0;
+	}
+
+	std::array<double, 16> IfcGeometry::GetDequantizationMatrix()
+	{
+		// column major, like GetFlatCoordinationMatrix(), applies before the flatTransformation of the placed geometry
+		GetQuantizedVertexData();
+		return {
+			quantizationStep.x, 0, 0, 0,
+			0, quantizationStep.y, 0, 0,
+			0, 0, quantizationStep.z, 0,
+			quantizationMin.x, quantizationMin.y, quantizationMin.z, 1};
+	}
+
 	SweptDiskSolid IfcGeometry::GetSweptDiskSolid()
 	{
 		return sweptDiskSolid;
 	}
 
-	void IfcGeometry::AddPart(IfcGeometry geom)
+	void IfcGeometry::AddPart(const IfcGeometry &geom)
 	{
 		part.push_back(geom);
 	}
 
-	void IfcGeometry::AddPart(Geometry geom)
+	void IfcGeometry::AddPart(IfcGeometry &&geom)
+	{
+		part.push_back(std::move(geom));
+	}
+
+	void IfcGeometry::AddPart(const Geometry &geom)
 	{
 		IfcGeometry newGeom;
 		newGeom.MergeGeometry(geom);
-		part.push_back(newGeom);
+		part.push_back(std::move(newGeom));
 	}
 
-	void IfcGeometry::AddGeometry(Geometry geom, glm::dmat4 trans, double scx, double scy, double scz, glm::dvec3 origin)
+	void IfcGeometry::AddGeometry(const Geometry &geom, const glm::dmat4 &trans, double scx, double scy, double scz, glm::dvec3 origin)
 	{
 		for (uint32_t i = 0; i < geom.numFaces; i++)
 		{
@@ -291,7 +692,7 @@ namespace webifc::geometry {
 		AddPart(geom);
 	}
 
-	void IfcGeometry::MergeGeometry(Geometry geom)
+	void IfcGeometry::MergeGeometry(const Geometry &geom)
 	{
 		for (uint32_t i = 0; i < geom.numFaces; i++)
 		{
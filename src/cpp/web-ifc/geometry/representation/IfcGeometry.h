@@ -7,6 +7,7 @@
 #pragma once
 
 #include <vector>
+#include <array>
 #include <string>
 #include <cstdint>
 #include <glm/glm.hpp>
@@ -21,6 +22,8 @@
 namespace webifc::geometry {
 
 	constexpr int VERTEX_FORMAT_SIZE_FLOATS = bimGeometry::VERTEX_FORMAT_SIZE_FLOATS;
+	// x, y, z as 16 bit fractions of the bounding box and the oct encoded normal as two 8 bit values
+	constexpr int QUANTIZED_VERTEX_SIZE = 4;
 
     struct Plane : bimGeometry::Plane
     {
@@ -45,7 +48,35 @@ namespace webifc::geometry {
 		double Volume(const glm::dmat4& trans = glm::dmat4(1));
 	};
 
-	struct IfcGeometry : Geometry
+	// number and size of the IfcGeometry copies made on the calling thread
+	struct GeometryCopyStats
+	{
+		uint64_t copies = 0;
+		uint64_t bytes = 0;
+	};
+
+	GeometryCopyStats &GetThreadGeometryCopyStats();
+
+	// vertices of the geometries passed through IfcGeometry::WeldVertices(), bytes are those of the float32 vertex buffer
+	struct VertexWeldStats
+	{
+		uint64_t geometries = 0;
+		uint64_t verticesBefore = 0;
+		uint64_t verticesAfter = 0;
+		uint64_t bytesSaved = 0;
+	};
+
+	// empty base of IfcGeometry that records every copy of it in GetThreadGeometryCopyStats(), moves are not counted
+	struct GeometryCopyCounter
+	{
+		GeometryCopyCounter() = default;
+		GeometryCopyCounter(const GeometryCopyCounter &other);
+		GeometryCopyCounter(GeometryCopyCounter &&other) = default;
+		GeometryCopyCounter &operator=(const GeometryCopyCounter &other);
+		GeometryCopyCounter &operator=(GeometryCopyCounter &&other) = default;
+	};
+
+	struct IfcGeometry : Geometry, GeometryCopyCounter
 	{
 		bool halfSpace = false;
 		std::vector<IfcGeometry>  part;
@@ -56,20 +87,50 @@ namespace webifc::geometry {
 		Vec normalizationCenter = Vec(0, 0, 0);
 
 		void ReverseFaces();
-		void AddPart(IfcGeometry geom);
-		void AddPart(Geometry geom);
-		void AddGeometry(Geometry geom, glm::dmat4 trans = glm::dmat4(1), double scx = 1, double scy = 1, double scz = 1, glm::dvec3 origin = glm::dvec3(0, 0, 0));
-		void MergeGeometry(Geometry geom);
+		void AddPart(const IfcGeometry &geom);
+		void AddPart(IfcGeometry &&geom);
+		void AddPart(const Geometry &geom);
+		void AddGeometry(const Geometry &geom, const glm::dmat4 &trans = glm::dmat4(1), double scx = 1, double scy = 1, double scz = 1, glm::dvec3 origin = glm::dvec3(0, 0, 0));
+		void MergeGeometry(const Geometry &geom);
 		uint32_t GetVertexData();
 		uint32_t GetVertexDataSize();
 		uint32_t GetIndexData();
 		uint32_t GetIndexDataSize();
+		uint32_t GetQuantizedVertexData();
+		uint32_t GetQuantizedVertexDataSize();
+		uint32_t GetQuantizedIndexData();
+		uint32_t GetQuantizedIndexDataSize();
+		std::array<double, 16> GetDequantizationMatrix();
 		SweptDiskSolid GetSweptDiskSolid();
 		glm::dmat4 Normalize();
+		bool IsNormalized() const;
+		uint64_t ContentHash() const;
+		bool SameContent(const IfcGeometry &other) const;
+		void CompactVertexData();
+		bool IsCompact() const;
+		// position of a vertex from whichever buffer is left, the float one once compacted
+		glm::dvec3 GetPoint(size_t index) const;
+		glm::dvec3 GetVertex(size_t index) const;
+		void BuildLods(uint32_t levels);
+		IfcGeometry &GetLod(uint32_t lod);
+		uint32_t GetLodCount() const;
+		VertexWeldStats WeldVertices(double tolerance);
 		SweptDiskSolid sweptDiskSolid;
+		// coarser versions of this geometry in the same (normalized) space, lods[0] is the first reduced level
+		std::vector<IfcGeometry> lods;
+		// compact copies of the vertex and index buffers, built on first request
+		std::vector<uint16_t> qvertexData;
+		std::vector<uint16_t> qindexData;
 		private:
+			friend class IfcGeometryCache;
 			void ReverseFace(uint32_t index);
+			void BuildQuantizedData();
+			glm::dvec3 quantizationMin = glm::dvec3(0);
+			glm::dvec3 quantizationStep = glm::dvec3(1);
 			bool normalized = false;
+			bool compact = false;
+			bool lodsBuilt = false;
+			bool welded = false;
 
 	};
 
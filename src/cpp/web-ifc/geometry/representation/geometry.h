@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <unordered_map>
 #include <cstdint>
+#include <cfloat>
 #include <glm/glm.hpp>
 
 #include "IfcCurve.h"
@@ -234,6 +235,54 @@ namespace webifc::geometry {
 		{
 			std::vector<IfcPlacedGeometry> geometries;
 			uint32_t expressID;
+			// the element went over a complexity limit and carries a cheaper representation, see IfcComplexityFallback
+			bool fallback = false;
+		};
+
+		// one placement of a geometry that is streamed only once, see StreamInstancedMeshes
+		struct IfcGeometryInstance
+		{
+			uint32_t elementExpressID;
+			uint32_t geometryExpressID;
+			std::array<double, 16> flatTransformation;
+			glm::dvec4 color;
+		};
+
+		// conservative axis aligned box of an element in the coordinates of its flat mesh, see GetElementBounds
+		struct IfcElementBounds
+		{
+			uint32_t expressID = 0;
+			glm::dvec3 min = glm::dvec3(DBL_MAX);
+			glm::dvec3 max = glm::dvec3(-DBL_MAX);
+
+			void Merge(const glm::dvec3 &point)
+			{
+				min = glm::min(min, point);
+				max = glm::max(max, point);
+			}
+
+			bool IsEmpty() const
+			{
+				return min.x > max.x;
+			}
+		};
+
+		// order PrioritizeElements() puts elements in: biggest box first, nearest box to a point first, or the
+		// elements of one storey first
+		enum IfcStreamPriority { PRIORITY_SIZE = 0, PRIORITY_DISTANCE = 1, PRIORITY_STOREY = 2 };
+
+		// the limit an element went over: too many openings or too slow to clip them leaves the element unclipped,
+		// too many triangles replaces it by its bounding box
+		enum IfcFallbackReason { FALLBACK_BOOLEAN_OPERANDS = 1, FALLBACK_TIME = 2, FALLBACK_TRIANGLES = 3 };
+
+		struct IfcComplexityFallback
+		{
+			uint32_t expressID = 0;
+			IfcFallbackReason reason = FALLBACK_BOOLEAN_OPERANDS;
+			// openings of the element, triangles it had when it went over the limit and time spent on the openings
+			uint32_t operands = 0;
+			uint64_t triangles = 0;
+			double milliseconds = 0;
 		};
 
 		struct IfcComposedMesh
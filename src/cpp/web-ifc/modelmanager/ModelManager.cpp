@@ -5,10 +5,12 @@
 #include <vector>
 #include <spdlog/spdlog.h>
 #include <sstream>
+#include <cstdio>
 #include "ModelManager.h"
 #include "../schema/IfcSchemaManager.h"
 #include "../geometry/IfcGeometryProcessor.h"
 #include "../parsing/IfcLoader.h"
+#include "../parallel/parallel.h"
 #include "../../version.h"
 
 webifc::manager::ModelManager::ModelManager(bool _mt_enabled)
@@ -29,9 +31,11 @@ void webifc::manager::ModelManager::CloseAllModels()
             continue;
         delete _loaders[i];
         delete _geometryProcessors[i];
+        delete _cancellationTokens[i];
     }
     _loaders.clear();
     _geometryProcessors.clear();
+    _cancellationTokens.clear();
 }
 
 void webifc::manager::ModelManager::SetLogLevel(uint8_t levelArg)
@@ -47,11 +51,65 @@ webifc::geometry::IfcGeometryProcessor *webifc::manager::ModelManager::GetGeomet
     if (!_geometryProcessors.contains(modelID))
     {
         webifc::geometry::IfcGeometryProcessor *processor = new webifc::geometry::IfcGeometryProcessor(*GetIfcLoader(modelID), _schemaManager, GetSettings(modelID).CIRCLE_SEGMENTS, GetSettings(modelID).COORDINATE_TO_ORIGIN, GetSettings(modelID).TOLERANCE_PLANE_INTERSECTION, GetSettings(modelID).TOLERANCE_PLANE_DEVIATION, GetSettings(modelID).TOLERANCE_BACK_DEVIATION_DISTANCE, GetSettings(modelID).TOLERANCE_INSIDE_OUTSIDE_PERIMETER, GetSettings(modelID).TOLERANCE_SCALAR_EQUALITY, GetSettings(modelID).PLANE_REFIT_ITERATIONS, GetSettings(modelID).BOOLEAN_UNION_THRESHOLD);
+        if (GetSettings(modelID).PREFETCH_CARTESIAN_POINTS)
+            processor->GetLoader().PrefetchCartesianPoints();
+        processor->GetLoader().SetChordTolerance(GetSettings(modelID).CIRCLE_CHORD_TOLERANCE, GetSettings(modelID).MAX_CIRCLE_SEGMENTS);
+        processor->GetLoader().SetCacheBudget(GetSettings(modelID).CACHE_RETENTION_BYTES);
+        processor->SetGeometryDeduplication(GetSettings(modelID).DEDUPLICATE_GEOMETRY, GetSettings(modelID).CACHE_RETENTION_BYTES);
+        processor->SetFloat32Geometry(GetSettings(modelID).FLOAT32_GEOMETRY);
+        processor->SetGeometryLods(GetSettings(modelID).GEOMETRY_LODS);
+        processor->SetVertexWelding(GetSettings(modelID).VERTEX_WELD_TOLERANCE);
+        processor->SetComplexityLimits(GetSettings(modelID).ELEMENT_MAX_BOOLEAN_OPERANDS, GetSettings(modelID).ELEMENT_MAX_TRIANGLES, GetSettings(modelID).ELEMENT_TIME_LIMIT_MS);
+        processor->SetCancellationToken(GetCancellationToken(modelID));
+        if (!GetSettings(modelID).GEOMETRY_CACHE_PATH.empty())
+        {
+            char name[17];
+            snprintf(name, sizeof(name), "%016llx", (unsigned long long)GeometryCacheKey(modelID));
+            processor->SetGeometryCache(GetSettings(modelID).GEOMETRY_CACHE_PATH + "/" + name + ".wgc");
+        }
         _geometryProcessors[modelID] = processor;
     }
     return _geometryProcessors.at(modelID);
 }
 
+// the tape content plus every setting that changes the generated geometry, a different key is a different cache file
+uint64_t webifc::manager::ModelManager::GeometryCacheKey(uint32_t modelID) const
+{
+    const LoaderSettings &settings = GetSettings(modelID);
+    uint64_t key = GetIfcLoader(modelID)->GetContentHash();
+    auto mix = [&key](const auto &value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+        for (size_t i = 0; i < sizeof(value); i++)
+        {
+            key ^= bytes[i];
+            key *= 1099511628211ULL;
+        }
+    };
+    for (char c : WEB_IFC_VERSION_NUMBER)
+    {
+        mix(c);
+    }
+    mix(settings.COORDINATE_TO_ORIGIN);
+    mix(settings.CIRCLE_SEGMENTS);
+    mix(settings.CIRCLE_CHORD_TOLERANCE);
+    mix(settings.MAX_CIRCLE_SEGMENTS);
+    mix(settings.TOLERANCE_PLANE_INTERSECTION);
+    mix(settings.TOLERANCE_PLANE_DEVIATION);
+    mix(settings.TOLERANCE_BACK_DEVIATION_DISTANCE);
+    mix(settings.TOLERANCE_INSIDE_OUTSIDE_PERIMETER);
+    mix(settings.TOLERANCE_SCALAR_EQUALITY);
+    mix(settings.PLANE_REFIT_ITERATIONS);
+    mix(settings.BOOLEAN_UNION_THRESHOLD);
+    mix(settings.DEDUPLICATE_GEOMETRY);
+    mix(settings.FLOAT32_GEOMETRY);
+    mix(settings.GEOMETRY_LODS);
+    mix(settings.VERTEX_WELD_TOLERANCE);
+    mix(settings.ELEMENT_MAX_BOOLEAN_OPERANDS);
+    mix(settings.ELEMENT_MAX_TRIANGLES);
+    mix(settings.ELEMENT_TIME_LIMIT_MS);
+    return key;
+}
+
 webifc::parsing::IfcLoader *webifc::manager::ModelManager::GetIfcLoader(uint32_t modelID) const
 {
     if (!IsModelOpen(modelID))
@@ -59,6 +117,13 @@ webifc::parsing::IfcLoader *webifc::manager::ModelManager::GetIfcLoader(uint32_t
     return _loaders[modelID];
 }
 
+webifc::parsing::IfcCancellationToken *webifc::manager::ModelManager::GetCancellationToken(uint32_t modelID) const
+{
+    if (!IsModelOpen(modelID))
+        return {};
+    return _cancellationTokens[modelID];
+}
+
 const webifc::manager::LoaderSettings &webifc::manager::ModelManager::GetSettings(uint32_t modelID) const
 {
     if (!IsModelOpen(modelID))
@@ -66,6 +131,14 @@ const webifc::manager::LoaderSettings &webifc::manager::ModelManager::GetSetting
     return _settings[modelID];
 }
 
+uint32_t webifc::manager::ModelManager::GetGeometryThreads(uint32_t modelID) const
+{
+    if (!mt_enabled || !IsModelOpen(modelID))
+        return 1;
+    uint16_t threads = GetSettings(modelID).GEOMETRY_THREADS;
+    return threads == 0 ? webifc::parallel::GetHardwareThreads() : threads;
+}
+
 const webifc::schema::IfcSchemaManager &webifc::manager::ModelManager::GetSchemaManager() const
 {
     return _schemaManager;
@@ -86,8 +159,10 @@ void webifc::manager::ModelManager::CloseModel(uint32_t modelID)
         return;
     delete _loaders[modelID];
     delete _geometryProcessors[modelID];
+    delete _cancellationTokens[modelID];
     _loaders[modelID] = nullptr;
     _geometryProcessors[modelID] = nullptr;
+    _cancellationTokens[modelID] = nullptr;
 }
 
 uint32_t webifc::manager::ModelManager::CreateModel(LoaderSettings settings)
@@ -104,7 +179,11 @@ uint32_t webifc::manager::ModelManager::CreateModel(LoaderSettings settings)
         header_shown = true;
     }
     webifc::parsing::IfcLoader *loader = new webifc::parsing::IfcLoader(settings.TAPE_SIZE, settings.MEMORY_LIMIT, settings.LINEWRITER_BUFFER, _schemaManager);
+    loader->SetStrictValidation(settings.STRICT_VALIDATION);
+    webifc::parsing::IfcCancellationToken *cancellation = new webifc::parsing::IfcCancellationToken();
+    loader->SetCancellationToken(cancellation);
     _loaders.push_back(loader);
+    _cancellationTokens.push_back(cancellation);
     _settings.push_back(settings);
     return _loaders.size() - 1;
 }
\ No newline at end of file
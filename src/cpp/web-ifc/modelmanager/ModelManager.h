@@ -9,6 +9,7 @@
 #include "../parsing/IfcLoader.h"
 #include <vector>
 #include <map>
+#include <string>
 #include <optional>
 
 namespace webifc::manager
@@ -18,6 +19,8 @@ namespace webifc::manager
     {
         bool COORDINATE_TO_ORIGIN = false;
         uint16_t CIRCLE_SEGMENTS = 12;
+        double CIRCLE_CHORD_TOLERANCE = 0; // metres, when set arcs get as many segments as this deviation needs instead of CIRCLE_SEGMENTS
+        uint16_t MAX_CIRCLE_SEGMENTS = 128; // cap on the points of a full circle in chord tolerance mode
         uint32_t TAPE_SIZE = 67108864; // probably no need for anyone other than web-ifc devs to change this
         uint32_t MEMORY_LIMIT = 2147483648;
         uint16_t LINEWRITER_BUFFER = 10000;
@@ -28,6 +31,18 @@ namespace webifc::manager
         double TOLERANCE_SCALAR_EQUALITY = 1.0E-04;
         uint16_t PLANE_REFIT_ITERATIONS = 1;
         uint16_t BOOLEAN_UNION_THRESHOLD = 150;
+        bool STRICT_VALIDATION = false;
+        bool PREFETCH_CARTESIAN_POINTS = false;
+        bool DEDUPLICATE_GEOMETRY = false;
+        bool FLOAT32_GEOMETRY = false;
+        uint16_t GEOMETRY_LODS = 0; // number of simplified levels built for every geometry
+        double VERTEX_WELD_TOLERANCE = 0; // metres, vertices this close with the same normal share an index, 0 disables welding
+        uint16_t GEOMETRY_THREADS = 0; // 0 uses every hardware thread when threading is enabled
+        std::string GEOMETRY_CACHE_PATH = ""; // directory holding one geometry cache file per model and settings, empty disables the cache
+        uint32_t ELEMENT_MAX_BOOLEAN_OPERANDS = 0; // openings of one element, above this it is left unclipped, 0 for no limit
+        uint32_t ELEMENT_MAX_TRIANGLES = 0; // triangles of one element, above this it is replaced by its bounding box, 0 for no limit
+        double ELEMENT_TIME_LIMIT_MS = 0; // time spent on the openings of one element, past it the element is left unclipped, 0 for no limit
+        uint32_t CACHE_RETENTION_BYTES = 67108864; // placements, profiles, curves, points and mapped representations kept between elements by each geometry thread, 0 drops them after every element
     };
 
     class ModelManager
@@ -37,7 +52,10 @@ namespace webifc::manager
         ~ModelManager();
         webifc::geometry::IfcGeometryProcessor *GetGeometryProcessor(uint32_t modelID);
         const LoaderSettings &GetSettings(uint32_t modelID) const;
+        uint32_t GetGeometryThreads(uint32_t modelID) const;
         webifc::parsing::IfcLoader *GetIfcLoader(uint32_t modelID) const;
+        // one per model, shared by its loader and geometry processor
+        webifc::parsing::IfcCancellationToken *GetCancellationToken(uint32_t modelID) const;
         const webifc::schema::IfcSchemaManager &GetSchemaManager() const;
         bool IsModelOpen(uint32_t modelID) const;
         void CloseModel(uint32_t modelID);
@@ -46,9 +64,11 @@ namespace webifc::manager
         void CloseAllModels();
 
     private:
+        uint64_t GeometryCacheKey(uint32_t modelID) const;
         const webifc::schema::IfcSchemaManager _schemaManager;
         std::vector<webifc::parsing::IfcLoader *> _loaders;
         std::vector<LoaderSettings> _settings;
+        std::vector<webifc::parsing::IfcCancellationToken *> _cancellationTokens;
         std::map<uint32_t, webifc::geometry::IfcGeometryProcessor *> _geometryProcessors;
         bool header_shown = false;
         bool mt_enabled;
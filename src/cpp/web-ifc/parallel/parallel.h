@@ -0,0 +1,219 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.  */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// single threaded wasm builds have no thread support at all, everything else (native, web-ifc-mt) does
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define WEBIFC_THREADS_AVAILABLE 0
+#else
+#define WEBIFC_THREADS_AVAILABLE 1
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#endif
+
+namespace webifc::parallel
+{
+
+	inline uint32_t GetHardwareThreads()
+	{
+#if WEBIFC_THREADS_AVAILABLE
+		return std::max(1u, std::thread::hardware_concurrency());
+#else
+		return 1;
+#endif
+	}
+
+#if WEBIFC_THREADS_AVAILABLE
+	// threads started on first use and kept for the lifetime of the process, so a stream of many small parallel
+	// loops does not pay for thread creation each time and never holds more threads than it asked for at once
+	// (web-ifc-mt takes them from the fixed PTHREAD_POOL_SIZE)
+	class ThreadPool
+	{
+	public:
+		static ThreadPool &Shared()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		// runs fn(worker) for worker 1 .. threads - 1 on pool threads and fn(0) on the calling thread, returns once
+		// all of them have; called from inside another Run (on a pool thread or from fn(0) on the calling thread) it
+		// runs fn(0) alone, the pool threads may all be held by the outer loop and a nested one would wait forever
+		template <typename F>
+		void Run(uint32_t threads, F &&fn)
+		{
+			threads = std::min(threads, GetHardwareThreads());
+			if (threads <= 1 || _insidePool)
+			{
+				fn(0);
+				return;
+			}
+
+			std::mutex doneMutex;
+			std::condition_variable doneCondition;
+			uint32_t running = threads - 1;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				while (_threads.size() < threads - 1)
+				{
+					_threads.emplace_back([this]() { Work(); });
+				}
+				for (uint32_t w = 1; w < threads; w++)
+				{
+					_jobs.emplace_back([&, w]() {
+						fn(w);
+						std::lock_guard<std::mutex> doneLock(doneMutex);
+						if (--running == 0) doneCondition.notify_one();
+					});
+				}
+			}
+			_condition.notify_all();
+
+			_insidePool = true;
+			fn(0);
+			_insidePool = false;
+			std::unique_lock<std::mutex> doneLock(doneMutex);
+			doneCondition.wait(doneLock, [&]() { return running == 0; });
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_condition.notify_all();
+			for (auto &thread : _threads) thread.join();
+		}
+
+	private:
+		void Work()
+		{
+			_insidePool = true;
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (true)
+			{
+				_condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+				if (_jobs.empty()) return;
+				std::function<void()> job = std::move(_jobs.front());
+				_jobs.erase(_jobs.begin());
+				lock.unlock();
+				job();
+				lock.lock();
+			}
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::vector<std::function<void()>> _jobs;
+		std::vector<std::thread> _threads;
+		bool _stop = false;
+		// set on pool threads for good and on a calling thread while it runs its share
+		static inline thread_local bool _insidePool = false;
+	};
+#else
+	class ThreadPool
+	{
+	public:
+		static ThreadPool &Shared()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		template <typename F>
+		void Run(uint32_t, F &&fn)
+		{
+			fn(0);
+		}
+	};
+#endif
+
+	// splits [0, count) into contiguous ranges and runs fn(begin, end) for each of them, one range per thread of the
+	// shared pool; small workloads (or builds without threads) run inline on the calling thread
+	template <typename F>
+	void ParallelFor(const size_t count, F &&fn, const size_t minPerThread = 1024)
+	{
+		if (count == 0) return;
+		size_t threads = std::min<size_t>(GetHardwareThreads(), (count + minPerThread - 1) / minPerThread);
+#if WEBIFC_THREADS_AVAILABLE
+		if (threads > 1)
+		{
+			// ranges are claimed rather than assigned, a pool that runs fewer workers (nested, or busy) still covers all
+			size_t chunk = (count + threads - 1) / threads;
+			std::atomic<size_t> next = 0;
+			ThreadPool::Shared().Run(threads, [&](uint32_t) {
+				for (size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+				{
+					fn(begin, std::min(count, begin + chunk));
+				}
+			});
+			return;
+		}
+#endif
+		fn(0, count);
+	}
+
+	// runs fn(index, worker) for every index in [0, count) on up to `threads` workers of the shared pool, the calling thread being worker 0
+	// indices are dealt round robin (worker w owns w, w + threads, ...), every worker runs its own share front to back
+	// and then steals from the back of the other shares, so items sorted most expensive first are started first
+	// and the cheap tail is what gets balanced between the threads
+	template <typename F>
+	void WorkStealingFor(const size_t count, const uint32_t threads, F &&fn)
+	{
+		if (count == 0) return;
+		size_t workerCount = std::min<size_t>(std::max<uint32_t>(threads, 1), count);
+#if WEBIFC_THREADS_AVAILABLE
+		if (workerCount > 1)
+		{
+			struct Slice
+			{
+				std::mutex mutex;
+				size_t begin = 0;
+				size_t end = 0;
+			};
+			// slices are ranges of rounds, round r of worker w is index r * workerCount + w
+			std::unique_ptr<Slice[]> slices(new Slice[workerCount]);
+			for (size_t w = 0; w < workerCount; w++)
+			{
+				slices[w].end = (count - w + workerCount - 1) / workerCount;
+			}
+
+			auto work = [&](uint32_t worker) {
+				while (true)
+				{
+					size_t index = count;
+					{
+						std::lock_guard<std::mutex> lock(slices[worker].mutex);
+						if (slices[worker].begin < slices[worker].end) index = slices[worker].begin++ * workerCount + worker;
+					}
+					for (size_t victim = 1; index == count && victim < workerCount; victim++)
+					{
+						size_t owner = (worker + victim) % workerCount;
+						std::lock_guard<std::mutex> lock(slices[owner].mutex);
+						if (slices[owner].begin < slices[owner].end) index = --slices[owner].end * workerCount + owner;
+					}
+					if (index == count) return;
+					fn(index, worker);
+				}
+			};
+
+			// a worker the pool does not run leaves its share to be stolen by the others
+			ThreadPool::Shared().Run(workerCount, work);
+			return;
+		}
+#endif
+		for (size_t i = 0; i < count; i++) fn(i, 0);
+	}
+
+}
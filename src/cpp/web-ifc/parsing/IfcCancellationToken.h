@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace webifc::parsing
+{
+
+  // what a long running operation got through so far, fields it cannot know stay 0
+  struct IfcProgress
+  {
+    uint64_t bytes = 0;
+    uint64_t elements = 0;
+    uint64_t totalElements = 0;
+  };
+
+  // shared by a long running operation (loading, saving, streaming) and whoever wants to follow or stop it; Cancel()
+  // may be called from any thread or from the progress callback, the operation notices it at its next chunk, batch
+  // of lines or element and returns what it has done so far
+  class IfcCancellationToken
+  {
+    public:
+      void Cancel()
+      {
+        _cancelled.store(true, std::memory_order_relaxed);
+      }
+
+      void Reset()
+      {
+        _cancelled.store(false, std::memory_order_relaxed);
+      }
+
+      bool IsCancelled() const
+      {
+        return _cancelled.load(std::memory_order_relaxed);
+      }
+
+      void SetProgressCallback(const std::function<void(const IfcProgress &)> &callback)
+      {
+        _progressCallback = callback;
+      }
+
+      // only called from the thread that started the operation, returns true when it has to stop
+      bool Report(const IfcProgress &progress)
+      {
+        if (_progressCallback) _progressCallback(progress);
+        return IsCancelled();
+      }
+
+    private:
+      std::atomic<bool> _cancelled = false;
+      std::function<void(const IfcProgress &)> _progressCallback;
+  };
+
+}
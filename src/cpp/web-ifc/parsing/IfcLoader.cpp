@@ -20,8 +20,9 @@ namespace webifc::parsing {
   std::string generateStringUUID();
   std::string expandIfcGuid(const std::string_view &guid);
   std::string compressIfcGuid(const std::string& guid);
+  bool attributeAcceptsToken(const schema::IfcAttributeInfo &info, const IfcTokenType t);
  
-   IfcLoader::IfcLoader(uint32_t tapeSize, uint64_t memoryLimit,uint32_t lineWriterBuffer, const schema::IfcSchemaManager &schemaManager) :_lineWriterBuffer(lineWriterBuffer), _schemaManager(schemaManager)
+   IfcLoader::IfcLoader(uint32_t tapeSize, uint64_t memoryLimit,uint32_t lineWriterBuffer, const schema::IfcSchemaManager &schemaManager) :_lineWriterBuffer(lineWriterBuffer), _schemaManager(schemaManager), _lines(_ownedLines), _headerLines(_ownedHeaderLines), _ifcTypeToExpressID(_ownedIfcTypeToExpressID)
    { 
      uint64_t maxChunks;
      if (memoryLimit > 0) maxChunks = memoryLimit/tapeSize; 
@@ -48,8 +49,11 @@ namespace webifc::parsing {
    
    void IfcLoader::LoadFile(const std::function<uint32_t(char *, size_t, size_t)> &requestData)
    { 
-     _tokenStream->SetTokenSource(requestData);
+     _tokenStream->SetTokenSource(requestData, _cancellation);
+     if (_cancellation != nullptr && _cancellation->IsCancelled()) return;
      ParseLines();
+     if (_cancellation != nullptr && _cancellation->IsCancelled()) return;
+     if (_strictValidation) ValidateAllLines();
    }
 
    IFC_SCHEMA IfcLoader::GetSchema() const
@@ -75,8 +79,11 @@ namespace webifc::parsing {
    
    void IfcLoader::LoadFile(std::istream &requestData)
    { 
-     _tokenStream->SetTokenSource(requestData);
+     _tokenStream->SetTokenSource(requestData, _cancellation);
+     if (_cancellation != nullptr && _cancellation->IsCancelled()) return;
      ParseLines();
+     if (_cancellation != nullptr && _cancellation->IsCancelled()) return;
+     if (_strictValidation) ValidateAllLines();
    }
    
    void IfcLoader::SaveFile(const std::function<void(char *, size_t)> &outputData, bool orderLinesByExpressID) const
@@ -92,6 +99,9 @@ namespace webifc::parsing {
       output << "******************************************************/" << std::endl;
       
       uint32_t linesWritten = 0;
+      uint64_t linesDone = 0;
+      uint64_t bytesWritten = 0;
+      const uint64_t totalLines = _headerLines.size() + _lines.size();
       for (uint8_t z=0; z < 2; z++)
       {
         std::vector<IfcLine*>* currentLines;
@@ -197,13 +207,21 @@ namespace webifc::parsing {
           }
         
           linesWritten++;
+          linesDone++;
           if (linesWritten > _lineWriterBuffer ) 
           {
             std::string tmp = output.str();
             outputData((char*)tmp.c_str(),tmp.size());
+            bytesWritten += tmp.size();
             output.str("");
             output.clear();
             linesWritten=0;
+            // a cancelled save leaves the output without its closing sections
+            if (_cancellation != nullptr && _cancellation->Report({bytesWritten, linesDone, totalLines}))
+            {
+              if (z == 1) delete currentLines;
+              return;
+            }
           }
         }
         if (z==0) output << "ENDSEC;"<<std::endl<<"DATA;"<<std::endl;
@@ -220,6 +238,11 @@ namespace webifc::parsing {
 		 },orderLinesByExpressID);
    }
       
+   void IfcLoader::SetCancellationToken(IfcCancellationToken *cancellation)
+   {
+     _cancellation = cancellation;
+   }
+
    bool IfcLoader::IsAtEnd() const
    {
      return _tokenStream->IsAtEnd();
@@ -227,9 +250,11 @@ namespace webifc::parsing {
   
    void IfcLoader::ParseLines() 
    {
+        _schemaResolved = false;
   			uint32_t currentIfcType = 0;
   			uint32_t currentExpressID = 0;
   			uint32_t currentTapeOffset = 0;
+  			uint64_t linesParsed = 0;
   			while (!_tokenStream->IsAtEnd())
   			{
           IfcTokenType t = static_cast<IfcTokenType>(_tokenStream->Read<char>());
@@ -256,6 +281,7 @@ namespace webifc::parsing {
               currentIfcType = 0;
   					}
   					currentTapeOffset = _tokenStream->GetReadOffset();
+  					if (_cancellation != nullptr && ++linesParsed % PROGRESS_INTERVAL == 0 && _cancellation->Report({currentTapeOffset, linesParsed, 0})) return;
   					break;
   				}
   				case IfcTokenType::UNKNOWN:
@@ -320,6 +346,7 @@ namespace webifc::parsing {
    IfcLoader::~IfcLoader()
    { 
       delete _tokenStream;
+      if (_isClone) return;
       for (const auto & [key, value] : _lines) delete value;
       for (size_t i=0; i < _headerLines.size();i++) delete _headerLines[i];
       _lines.clear();
@@ -461,6 +488,7 @@ namespace webifc::parsing {
       l->ifcType = type;
       l->tapeOffset = start;
       _headerLines.push_back(l);
+      if (type == schema::FILE_SCHEMA) _schemaResolved = false;
   }
   
   IfcTokenType IfcLoader::GetTokenType(uint32_t tapeOffset) const
@@ -501,6 +529,12 @@ namespace webifc::parsing {
    {
      return _tokenStream->GetTotalSize();
    }
+
+   uint64_t IfcLoader::GetContentHash() const
+   {
+     // covers every token of the model, so edits made after loading change it as well
+     return _tokenStream->ContentHash();
+   }
      
    const std::vector<uint32_t> IfcLoader::GetSetArgument() const
    { 
@@ -751,8 +785,203 @@ namespace webifc::parsing {
       return compressIfcGuid(generateStringUUID());
     }
 
-    IfcLoader * IfcLoader::Clone() {
-      return new IfcLoader(_maxExpressId, _lineWriterBuffer,_schemaManager,  _tokenStream->Clone(), _lines, _headerLines, _ifcTypeToExpressID);
+    void IfcLoader::SetStrictValidation(const bool strict)
+    {
+      _strictValidation = strict;
+    }
+
+    const schema::IfcEntityAttributes * IfcLoader::GetEntityAttributes(const uint32_t ifcType) const
+    {
+      if (!_schemaResolved)
+      {
+        if (GetHeaderLinesWithType(schema::FILE_SCHEMA).empty()) return nullptr;
+        _schema = GetSchema();
+        _schemaResolved = true;
+      }
+      return _schemaManager.GetEntityAttributes(_schema, ifcType);
+    }
+
+    const schema::IfcAttributeInfo * IfcLoader::GetAttributeInfo(const uint32_t expressID, const uint32_t attributeIndex) const
+    {
+      const auto lineIt = _lines.find(expressID);
+      if (lineIt == _lines.end()) return nullptr;
+      auto attributes = GetEntityAttributes(lineIt->second->ifcType);
+      if (attributes == nullptr || attributeIndex >= attributes->attributes.size()) return nullptr;
+      return &attributes->attributes[attributeIndex];
+    }
+
+    uint32_t IfcLoader::GetRefAttribute(const uint32_t expressID, const uint32_t attributeIndex) const
+    {
+      auto info = GetAttributeInfo(expressID, attributeIndex);
+      if (info != nullptr && info->kind != schema::IfcAttributeKind::REF && info->kind != schema::IfcAttributeKind::SELECT)
+      {
+        spdlog::error("[GetRefAttribute({})] attribute {} is not a reference", expressID, attributeIndex);
+        return 0;
+      }
+      MoveToArgumentOffset(expressID, attributeIndex);
+      // without a table entry (or when asked to be strict) fall back to the checked decode
+      if (info == nullptr || _strictValidation) return GetOptionalRefArgument();
+      // the schema already told us what to expect, anything else is either $ or a typed select value
+      if (GetTokenType() != IfcTokenType::REF) return 0;
+      return _tokenStream->Read<uint32_t>();
+    }
+
+    double IfcLoader::GetDoubleAttribute(const uint32_t expressID, const uint32_t attributeIndex, const double defaultValue) const
+    {
+      auto info = GetAttributeInfo(expressID, attributeIndex);
+      if (info != nullptr && info->kind != schema::IfcAttributeKind::REAL && info->kind != schema::IfcAttributeKind::INTEGER)
+      {
+        spdlog::error("[GetDoubleAttribute({})] attribute {} is not numeric", expressID, attributeIndex);
+        return defaultValue;
+      }
+      MoveToArgumentOffset(expressID, attributeIndex);
+      if (_strictValidation && info != nullptr)
+      {
+        IfcTokenType t = GetTokenType();
+        StepBack();
+        if (!attributeAcceptsToken(*info, t)) spdlog::error("[GetDoubleAttribute({})] unexpected token for attribute {}", expressID, attributeIndex);
+      }
+      return GetOptionalDoubleParam(defaultValue);
+    }
+
+    const std::vector<uint32_t> IfcLoader::GetRefSetAttribute(const uint32_t expressID, const uint32_t attributeIndex) const
+    {
+      std::vector<uint32_t> refs;
+      auto info = GetAttributeInfo(expressID, attributeIndex);
+      if (info != nullptr && info->kind != schema::IfcAttributeKind::SET)
+      {
+        spdlog::error("[GetRefSetAttribute({})] attribute {} is not a set", expressID, attributeIndex);
+        return refs;
+      }
+      MoveToArgumentOffset(expressID, attributeIndex);
+      if (GetTokenType() != IfcTokenType::SET_BEGIN)
+      {
+        if (_strictValidation && (info == nullptr || !info->optional)) spdlog::error("[GetRefSetAttribute({})] expected a set for attribute {}", expressID, attributeIndex);
+        return refs;
+      }
+      StepBack();
+      for (auto offset : GetSetArgument())
+      {
+        if (GetTokenType(offset) == IfcTokenType::REF) refs.push_back(_tokenStream->Read<uint32_t>());
+      }
+      return refs;
+    }
+
+    IfcTokenType IfcLoader::SkipArgument() const
+    {
+      IfcTokenType t = GetTokenType();
+      switch (t)
+      {
+        case IfcTokenType::SET_BEGIN:
+          StepBack();
+          GetSetArgument();
+          break;
+        case IfcTokenType::LABEL:
+        {
+          // typed value, e.g. IFCLABEL('x'), the value itself follows as a set
+          uint16_t length = _tokenStream->Read<uint16_t>();
+          _tokenStream->Forward(length);
+          GetSetArgument();
+          break;
+        }
+        case IfcTokenType::STRING:
+        case IfcTokenType::ENUM:
+        case IfcTokenType::REAL:
+        case IfcTokenType::INTEGER:
+        {
+          uint16_t length = _tokenStream->Read<uint16_t>();
+          _tokenStream->Forward(length);
+          break;
+        }
+        case IfcTokenType::REF:
+          _tokenStream->Read<uint32_t>();
+          break;
+        default:
+          break;
+      }
+      return t;
+    }
+
+    bool IfcLoader::ValidateLine(const uint32_t expressID) const
+    {
+      const auto lineIt = _lines.find(expressID);
+      if (lineIt == _lines.end()) return false;
+      auto attributes = GetEntityAttributes(lineIt->second->ifcType);
+      if (attributes == nullptr)
+      {
+        spdlog::error("[ValidateLine({})] no schema information for line type", expressID);
+        return false;
+      }
+
+      // skip the express id, the type label and the opening bracket of the argument list
+      _tokenStream->MoveTo(lineIt->second->tapeOffset);
+      _tokenStream->Read<char>();
+      _tokenStream->Read<uint32_t>();
+      _tokenStream->Read<char>();
+      uint16_t length = _tokenStream->Read<uint16_t>();
+      _tokenStream->Forward(length);
+      _tokenStream->Read<char>();
+
+      bool valid = true;
+      uint32_t count = 0;
+      while (true)
+      {
+        IfcTokenType t = SkipArgument();
+        if (t == IfcTokenType::SET_END || t == IfcTokenType::LINE_END) break;
+        if (count < attributes->attributes.size() && !attributeAcceptsToken(attributes->attributes[count], t))
+        {
+          spdlog::error("[ValidateLine({})] unexpected value for attribute {}", expressID, count);
+          valid = false;
+        }
+        count++;
+      }
+      if (count != attributes->attributes.size())
+      {
+        spdlog::error("[ValidateLine({})] expected {} attributes, found {}", expressID, attributes->attributes.size(), count);
+        valid = false;
+      }
+      return valid;
+    }
+
+    uint32_t IfcLoader::ValidateAllLines() const
+    {
+      uint32_t invalidLines = 0;
+      for (const auto & [expressID, line] : _lines)
+      {
+        if (line->ifcType == 0) continue;
+        if (!ValidateLine(expressID)) invalidLines++;
+      }
+      if (invalidLines > 0) spdlog::warn("[ValidateAllLines()] {} lines do not match the schema", invalidLines);
+      return invalidLines;
+    }
+
+    bool attributeAcceptsToken(const schema::IfcAttributeInfo &info, const IfcTokenType t)
+    {
+      if (t == IfcTokenType::EMPTY) return info.optional;
+      switch (info.kind)
+      {
+        case schema::IfcAttributeKind::STRING: return t == IfcTokenType::STRING;
+        case schema::IfcAttributeKind::ENUM: return t == IfcTokenType::ENUM;
+        case schema::IfcAttributeKind::REAL: return t == IfcTokenType::REAL || t == IfcTokenType::INTEGER;
+        case schema::IfcAttributeKind::INTEGER: return t == IfcTokenType::INTEGER;
+        case schema::IfcAttributeKind::REF: return t == IfcTokenType::REF;
+        case schema::IfcAttributeKind::SELECT: return t == IfcTokenType::REF || t == IfcTokenType::LABEL || t == IfcTokenType::ENUM;
+        case schema::IfcAttributeKind::SET: return t == IfcTokenType::SET_BEGIN;
+        default: return true;
+      }
+    }
+
+    IfcLoader * IfcLoader::Clone() const {
+      IfcLoader * clone = new IfcLoader(_maxExpressId, _lineWriterBuffer,_schemaManager,  _tokenStream->Clone(), _lines, _headerLines, _ifcTypeToExpressID);
+      clone->_strictValidation = _strictValidation;
+      clone->_isClone = true;
+      return clone;
+    }
+
+    bool IfcLoader::PrepareForClones() const
+    {
+      // clones share the tape chunks, so nothing may be loaded or evicted while they are reading
+      return _tokenStream->LoadAll();
     }
 
     IfcLoader::IfcLoader(uint32_t maxExpressId,uint32_t lineWriterBuffer, const schema::IfcSchemaManager &schemaManager, IfcTokenStream * tokenStream, std::unordered_map<uint32_t,IfcLine*> &lines, std::vector<IfcLine*> &headerLines,std::unordered_map<uint32_t, std::vector<uint32_t>> &ifcTypeToExpressID)
@@ -57,6 +57,7 @@ namespace webifc::parsing
       IFC_SCHEMA GetSchema() const;
       void Push(void *v, const uint64_t size);
       uint64_t GetTotalSize() const;
+      uint64_t GetContentHash() const;
       void UpdateLineTape(const uint32_t expressID, const uint32_t type, const uint32_t start);
       void AddHeaderLineTape(const uint32_t type, const uint32_t start);
       uint32_t GetCurrentLineExpressID() const;
@@ -64,7 +65,16 @@ namespace webifc::parsing
       void PushDouble(double input);
       void PushInt(int input);
       std::string GenerateUUID() const;
-      IfcLoader* Clone();
+      IfcLoader* Clone() const;
+      bool PrepareForClones() const;
+      uint32_t GetRefAttribute(const uint32_t expressID, const uint32_t attributeIndex) const;
+      double GetDoubleAttribute(const uint32_t expressID, const uint32_t attributeIndex, const double defaultValue = 0) const;
+      const std::vector<uint32_t> GetRefSetAttribute(const uint32_t expressID, const uint32_t attributeIndex) const;
+      bool ValidateLine(const uint32_t expressID) const;
+      uint32_t ValidateAllLines() const;
+      void SetStrictValidation(const bool strict);
+      // checked while the file is read and parsed and while it is saved, clones never report to it
+      void SetCancellationToken(IfcCancellationToken *cancellation);
 
       uint32_t GetNextExpressID(uint32_t expressId) const;
       template <typename T> void Push(T input)
@@ -83,11 +93,25 @@ namespace webifc::parsing
       const uint32_t _lineWriterBuffer;
       const schema::IfcSchemaManager &_schemaManager;
       IfcTokenStream * _tokenStream;
-      std::unordered_map<uint32_t,IfcLine*> _lines;
-      std::vector<IfcLine*> _headerLines;
-      std::unordered_map<uint32_t, std::vector<uint32_t>> _ifcTypeToExpressID;
+      // clones read the line index of the loader they were made from, only the original owns it
+      std::unordered_map<uint32_t,IfcLine*> _ownedLines;
+      std::vector<IfcLine*> _ownedHeaderLines;
+      std::unordered_map<uint32_t, std::vector<uint32_t>> _ownedIfcTypeToExpressID;
+      std::unordered_map<uint32_t,IfcLine*> &_lines;
+      std::vector<IfcLine*> &_headerLines;
+      std::unordered_map<uint32_t, std::vector<uint32_t>> &_ifcTypeToExpressID;
+      bool _isClone = false;
+      bool _strictValidation = false;
+      IfcCancellationToken *_cancellation = nullptr;
+      // lines parsed or saved between two progress reports
+      static constexpr uint32_t PROGRESS_INTERVAL = 16384;
+      mutable bool _schemaResolved = false;
+      mutable IFC_SCHEMA _schema = IFC2X3;
       void ParseLines();
       void ArgumentOffset(const uint32_t argumentIndex) const;      
+      const schema::IfcAttributeInfo * GetAttributeInfo(const uint32_t expressID, const uint32_t attributeIndex) const;
+      const schema::IfcEntityAttributes * GetEntityAttributes(const uint32_t ifcType) const;
+      IfcTokenType SkipArgument() const;
       
 	};
 }
\ No newline at end of file
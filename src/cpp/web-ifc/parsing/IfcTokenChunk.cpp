@@ -55,6 +55,17 @@ namespace webifc::parsing
       return std::string_view((char*)_chunkData+ptr,size);
   }
   
+  uint64_t IfcTokenStream::IfcTokenChunk::Hash(uint64_t hash)
+  {
+      if (!_loaded) Load();
+      for (size_t i = 0; i < _currentSize; i++)
+      {
+        hash ^= _chunkData[i];
+        hash *= 1099511628211ull;
+      }
+      return hash;
+  }
+
   void IfcTokenStream::IfcTokenChunk::Push(void *v, const size_t size)
   {
       if (_chunkData == nullptr) _chunkData =  new uint8_t[_chunkSize];
@@ -18,13 +18,13 @@ namespace webifc::parsing
 
   IfcTokenStream::~IfcTokenStream() 
   {
-    for (size_t i=0; i < _chunks.size();i++)  _chunks[i].Clear(true);
+    if (_ownsChunks) for (size_t i=0; i < _chunks.size();i++)  _chunks[i].Clear(true);
     _chunks.clear();
     std::vector<IfcTokenChunk>().swap(_chunks);
     delete _fileStream;
   }
 
-  void IfcTokenStream::SetTokenSource(const std::function<uint32_t(char *, size_t, size_t)> &requestData) 
+  void IfcTokenStream::SetTokenSource(const std::function<uint32_t(char *, size_t, size_t)> &requestData, IfcCancellationToken *cancellation) 
   {
       _fileStream = new IfcFileStream(requestData,_chunkSize);
       size_t tokenOffset=0;
@@ -37,14 +37,15 @@ namespace webifc::parsing
           if (cSize > _chunkSize) _chunkSize = cSize;
           _chunks.push_back(chunk);
           _activeChunks++;
+          if (cancellation != nullptr && cancellation->Report({_fileStream->GetRef(), 0, 0})) break;
       }
       _cChunk = &_chunks.front();
       _fileStream->Clear();
   }
 
-  void IfcTokenStream::SetTokenSource(std::istream &requestData)
+  void IfcTokenStream::SetTokenSource(std::istream &requestData, IfcCancellationToken *cancellation)
   { 
-     SetTokenSource([&](char* dest, size_t sourceOffset, size_t destSize) { requestData.seekg(sourceOffset); requestData.read(dest, destSize); return requestData.gcount();});
+     SetTokenSource([&](char* dest, size_t sourceOffset, size_t destSize) { requestData.seekg(sourceOffset); requestData.read(dest, destSize); return requestData.gcount();}, cancellation);
   }
   
   std::string_view IfcTokenStream::ReadString() 
@@ -160,11 +161,44 @@ namespace webifc::parsing
   }
 
   IfcTokenStream * IfcTokenStream::Clone() {
-    IfcTokenStream * newStream = new IfcTokenStream(_activeChunks,_maxChunks,_chunks,_fileStream->Clone());
+    // chunks keep loading through the original file stream, a clone never opens the data source itself
+    IfcTokenStream * newStream = new IfcTokenStream(_activeChunks,_maxChunks,_chunks,nullptr);
+    newStream->_chunkSize = _chunkSize;
+    newStream->_ownsChunks = false;
     return newStream;
   }
 
-  IfcTokenStream::IfcTokenStream(size_t activeChunks, uint64_t maxChunks, std::vector<IfcTokenStream::IfcTokenChunk> &chunks,IfcTokenStream::IfcFileStream * fileStream) : _activeChunks(activeChunks), _maxChunks(maxChunks), _chunks(chunks),  _cChunk(&chunks[0]), _fileStream(fileStream)
+  bool IfcTokenStream::LoadAll()
+  {
+    if (_maxChunks != 0 && _chunks.size() > _maxChunks) return false;
+    for (auto &chunk : _chunks)
+    {
+      if (!chunk.IsLoaded())
+      {
+        chunk.Load();
+        _activeChunks++;
+      }
+    }
+    return true;
+  }
+
+  uint64_t IfcTokenStream::ContentHash()
+  {
+    // FNV-1a over the whole tape, chunks that were evicted are loaded again like any other read would
+    uint64_t hash = 14695981039346656037ull;
+    for (auto &chunk : _chunks)
+    {
+      if (!chunk.IsLoaded())
+      {
+        checkMemory();
+        _activeChunks++;
+      }
+      hash = chunk.Hash(hash);
+    }
+    return hash;
+  }
+
+  IfcTokenStream::IfcTokenStream(size_t activeChunks, uint64_t maxChunks, std::vector<IfcTokenStream::IfcTokenChunk> &chunks,IfcTokenStream::IfcFileStream * fileStream) : _activeChunks(activeChunks), _maxChunks(maxChunks), _chunks(chunks),  _cChunk(_chunks.empty() ? nullptr : &_chunks[0]), _fileStream(fileStream)
   {}
 
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <string_view>
 #include <cstring>
 #include <cstdint>
+#include "IfcCancellationToken.h"
  
 namespace webifc::parsing
 {
@@ -36,8 +37,9 @@ namespace webifc::parsing
       public:
         IfcTokenStream(const size_t chunkSize, const uint64_t maxChunks);
         ~IfcTokenStream();
-        void SetTokenSource(const std::function<uint32_t(char *, size_t, size_t)> &requestData);
-        void SetTokenSource(std::istream &requestData);
+        // stops after the chunk in which cancellation is asked for, the tape then holds the part read so far
+        void SetTokenSource(const std::function<uint32_t(char *, size_t, size_t)> &requestData, IfcCancellationToken *cancellation = nullptr);
+        void SetTokenSource(std::istream &requestData, IfcCancellationToken *cancellation = nullptr);
         template <typename T> T Read()
         {
           if (!_cChunk->IsLoaded()) {
@@ -61,6 +63,8 @@ namespace webifc::parsing
         size_t GetReadOffset();
         size_t GetTotalSize();
         IfcTokenStream * Clone();
+        bool LoadAll();
+        uint64_t ContentHash();
 
       private:
         void checkMemory();
@@ -69,6 +73,7 @@ namespace webifc::parsing
         size_t _activeChunks = 0;
         size_t _chunkSize;
         uint64_t _maxChunks;
+        bool _ownsChunks = true;
         class IfcFileStream
         {
           public:
@@ -106,6 +111,7 @@ namespace webifc::parsing
               void Push(void *v, const size_t size);
               size_t GetMaxSize();
               std::string_view ReadString(const size_t ptr,const size_t size); 
+              uint64_t Hash(uint64_t hash);
               template <typename T> T Read(const size_t ptr)
               {
                 if (!_loaded) Load();
@@ -117,8 +123,8 @@ namespace webifc::parsing
               {
                 Push(&input,sizeof(T));
               }
-            private:
               void Load();
+            private:
               bool _loaded=false;
               size_t _currentSize=0;
               size_t _startRef=0;
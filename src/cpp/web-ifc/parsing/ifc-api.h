@@ -7,9 +7,10 @@
 #include <memory>
 
 #include "../modelmanager/ModelManager.h"
+#include "../parallel/parallel.h"
 
 
-constexpr bool MT_ENABLED = false;
+constexpr bool MT_ENABLED = WEBIFC_THREADS_AVAILABLE;
 
 /**
  * @brief A type alias for the variant holding all possible C++ values from an IFC token.
@@ -20,6 +20,7 @@ namespace webifc::schema {
             _crcTable[n] = c;
         }
         initSchemaData();
+        initAttributeData();
     }
 
     std::string_view IfcSchemaManager::GetSchemaName(IFC_SCHEMA schema)  const
@@ -57,5 +58,13 @@ namespace webifc::schema {
     {
         return _ifcElements;
     }
+
+    const IfcEntityAttributes * IfcSchemaManager::GetEntityAttributes(IFC_SCHEMA schema, const uint32_t typeCode) const
+    {
+        if (static_cast<size_t>(schema) >= _entityAttributes.size()) return nullptr;
+        auto it = _entityAttributes[schema].find(typeCode);
+        if (it == _entityAttributes[schema].end()) return nullptr;
+        return &it->second;
+    }
   
 }
\ No newline at end of file
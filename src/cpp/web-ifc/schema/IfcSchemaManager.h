@@ -9,10 +9,41 @@
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <unordered_map>
 #include <cstdint>
 
 
 namespace webifc::schema {
+
+    // declared kind of an entity attribute, as found in the EXPRESS schema
+    enum class IfcAttributeKind : uint8_t {
+        UNKNOWN = 0,
+        STRING,
+        ENUM,
+        REAL,
+        INTEGER,
+        REF,
+        SELECT,
+        SET,
+        DERIVED
+    };
+
+    struct IfcAttributeInfo {
+        IfcAttributeKind kind;
+        bool optional;
+    };
+
+    struct IfcInverseInfo {
+        uint32_t targetType;
+        uint32_t targetAttribute;
+        bool set;
+    };
+
+    struct IfcEntityAttributes {
+        std::vector<IfcAttributeInfo> attributes;
+        std::vector<IfcInverseInfo> inverses;
+    };
+
     class IfcSchemaManager {
         public:
             IfcSchemaManager();
@@ -22,12 +53,15 @@ namespace webifc::schema {
             std::string IfcTypeCodeToType(const uint32_t typeCode) const; 
             bool IsIfcElement(const uint32_t typeCode) const;
             const std::unordered_set<uint32_t> & GetIfcElementList() const;
+            const IfcEntityAttributes * GetEntityAttributes(IFC_SCHEMA schema, const uint32_t typeCode) const;
         private: 
             std::vector<uint32_t> _crcTable;
             std::unordered_set<uint32_t> _ifcElements;
             std::vector<IFC_SCHEMA> _schemas;
             std::vector<std::string_view> _schemaNames;
+            std::vector<std::unordered_map<uint32_t, IfcEntityAttributes>> _entityAttributes;
             void initSchemaData();
+            void initAttributeData();
             uint32_t IfcTypeToTypeCode(const void * name, const size_t len) const;
     };
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 import {Entity} from "./gen_functional_types_interfaces";
-import {generatePropAssignment,generateTapeAssignment,generateInitialiser,findSubClasses,sortEntities,generateClass,generateCppClass,crc32,makeCRCTable, parseElements, walkParents} from "./gen_functional_types_helpers"
+import {generatePropAssignment,generateTapeAssignment,generateInitialiser,findSubClasses,sortEntities,generateClass,generateCppClass,crc32,makeCRCTable, parseElements, walkParents, getAttributeKind, getInverseTargetIndex} from "./gen_functional_types_helpers"
 
 import schemaAliases from "./schema_aliases";
 
@@ -19,6 +19,7 @@ let cppPropertyNamesList: Array<String> = [];
 let cppPropertyTypes: Array<string> = [];
 let cppPropertyTypesList: Array<String> = [];
 let cppPropertyCounts: Array<String> = [];
+let cppAttributes: Array<string> = [];
 let chSchema: Array<string> = [];
 
 let completeifcElementList = new Set<string>();
@@ -34,6 +35,14 @@ cppPropertyNames.push("std::string getPropertyName(IFC_SCHEMA schema,uint32_t ty
 cppPropertyTypes.push("uint32_t getPropertyTypeCode(IFC_SCHEMA schema,uint32_t typeCode,uint32_t prop) {")
 cppPropertyCounts.push("uint32_t getPropertyCount(IFC_SCHEMA schema,uint32_t typeCode) {")
 
+cppAttributes.push("// per entity attribute tables - this is a generated file - please see schema generator in src/schema");
+cppAttributes.push("#include \"ifc-schema.h\"");
+cppAttributes.push("#include \"IfcSchemaManager.h\"");
+cppAttributes.push("namespace webifc::schema {");
+cppAttributes.push("void IfcSchemaManager::initAttributeData() {");
+cppAttributes.push("using K = IfcAttributeKind;");
+cppAttributes.push("_entityAttributes.resize(_schemas.size());");
+
 
 tsSchema.push('/**');
 tsSchema.push(' * Web-IFC IFC Schema Representation');
@@ -496,6 +505,9 @@ cppnewSchema.push("} // namespace " + schemaNameClean);
 
   for (var x=0; x < entities.length; x++) {
     let crcCode = crc32(entities[x].name.toUpperCase(),crcTable);
+    let attributes = entities[x].derivedProps.map((p) => `{K::${getAttributeKind(p,entities[x].ifcDerivedProps,types)},${p.optional}}`).join(",");
+    let inverses = entities[x].derivedInverseProps.map((p) => `{${p.type.toUpperCase()},${getInverseTargetIndex(p,entities)},${p.set}}`).join(",");
+    cppAttributes.push(`_entityAttributes[${schemaNameClean}][${crcCode}] = {{${attributes}},{${inverses}}};`);
     cppPropertyCounts.push("case  "+crcCode+": return "+entities[x].derivedProps.length+";")
     cppPropertyNames.push("case  "+crcCode+":")
     cppPropertyNames.push("switch (prop) { ")
@@ -605,8 +617,12 @@ cppPropertyTypes.push("}")
 
 cppPropertyCounts.push("}")
 
+cppAttributes.push("}");
+cppAttributes.push("}");
+
 fs.writeFileSync("../cpp/web-ifc/schema/ifc-schema.h", chSchema.join("\n")); 
 fs.writeFileSync("../cpp/web-ifc/schema/schema-functions.cpp", cppSchema.join("\n")); 
+fs.writeFileSync("../cpp/web-ifc/schema/schema-attributes.cpp", cppAttributes.join("\n")); 
 fs.writeFileSync("../cpp/web-ifc/schema/schema-names.h", [ ...cppPropertyNames, ...cppPropertyTypes, ...cppPropertyCounts].join("\n")); 
 fs.writeFileSync("../ts/ifc-schema.ts", tsSchema.join("\n")); 
 fs.writeFileSync("../cpp/web-ifc/schema/cpp-new-ifc-schema.cpp", cppnewSchema.join("\n"));
@@ -1,4 +1,4 @@
-import {Entity, Type, Prop} from "./gen_functional_types_interfaces";
+import {Entity, Type, Prop, InverseProp} from "./gen_functional_types_interfaces";
 
 export function generateInitialiser(type: Type, initialisersDone: Set<string>,buffer: Array<string>, crcTable:any,types: Type[],schemaName:string,schemaNo: number) 
 {
@@ -393,6 +393,49 @@ export function expTypeToTypeNum(expTypeName:string) : number
     return 5;
 }
 
+function typeNumToAttributeKind(typeNum:number) : string
+{
+    if (typeNum == 1) return "STRING";
+    else if (typeNum == 3) return "ENUM";
+    else if (typeNum == 4) return "REAL";
+    else if (typeNum == 10) return "INTEGER";
+    return "REF";
+}
+
+export function getAttributeKind(p:Prop, ifcDerivedProps:string[], types:Type[]) : string
+{
+    if (ifcDerivedProps.includes(p.name)) return "DERIVED";
+    if (p.set || p.dimensions > 0) return "SET";
+    if (p.primitive) return typeNumToAttributeKind(p.typeNum);
+    let type = types.find(t => t.name == p.type);
+    while (type)
+    {
+        if (type.isList) return "SET";
+        if (type.isEnum) return "ENUM";
+        if (type.isSelect) return "SELECT";
+        const baseName = type.typeName;
+        const baseType = types.find(t => t.name == baseName);
+        if (!baseType) return typeNumToAttributeKind(type.typeNum);
+        type = baseType;
+    }
+    // not a defined type, so it must be a reference to another entity
+    return "REF";
+}
+
+export function getInverseTargetIndex(prop:InverseProp, entities:Entity[]) : number
+{
+    for (let targetEntity of entities) 
+    {
+        if (targetEntity.name != prop.type) continue;
+        for (let j=0; j < targetEntity.derivedProps.length;j++)
+        {
+            if (targetEntity.derivedProps[j].name == prop.for) return j;
+        }
+        break;
+    }
+    return 0;
+}
+
 export function parseInverse(line:string,entity:Entity) 
 {
     let split = line.split(" ");
@@ -55,10 +55,20 @@ export const SET_END = 8;
 export const LINE_END = 9;
 export const INTEGER = 10;
 
+/** Orders for GetPrioritizedElementIDs */
+export const STREAM_PRIORITY_SIZE = 0;
+export const STREAM_PRIORITY_DISTANCE = 1;
+export const STREAM_PRIORITY_STOREY = 2;
+export const FALLBACK_BOOLEAN_OPERANDS = 1;
+export const FALLBACK_TIME = 2;
+export const FALLBACK_TRIANGLES = 3;
+
 /**
  * Settings for the IFCLoader
  * @property {boolean} COORDINATE_TO_ORIGIN - If true, the model will be translated to the origin.
  * @property {number} CIRCLE_SEGMENTS - Number of segments used to approximate circles.
+ * @property {number} CIRCLE_CHORD_TOLERANCE - Maximum distance (in metres) between a tessellated arc and the true curve. When above 0 every circle, arc and revolution gets the segment count this deviation requires for its radius and sweep instead of CIRCLE_SEGMENTS.
+ * @property {number} MAX_CIRCLE_SEGMENTS - Upper bound on the number of segments of a full circle when CIRCLE_CHORD_TOLERANCE is used, arcs get their share of it.
  * @property {number} MEMORY_LIMIT - Maximum memory (in bytes) to be reserved for IFC data in memory.
  * @property {number} TAPE_SIZE - Size of the internal buffer tape for the loader (in bytes or units).
  * @property {number} LINEWRITER_BUFFER - Number of lines to write to memory at a time when writing an IFC file.
@@ -69,10 +79,24 @@ export const INTEGER = 10;
  * @property {number} TOLERANCE_SCALAR_EQUALITY - Tolerance used to compare scalar values as equal.
  * @property {number} PLANE_REFIT_ITERATIONS - Number of iterations used when adjusting triangles to a plane.
  * @property {number} BOOLEAN_UNION_THRESHOLD - Minimum number of solids before triggering a boolean union operation.
+ * @property {boolean} PREFETCH_CARTESIAN_POINTS - If true, all IFCCARTESIANPOINT lines are decoded in one (multi-threaded where available) pass before geometry is generated.
+ * @property {boolean} STRICT_VALIDATION - If true, every line is checked against the schema attribute tables after loading and typed attribute reads report mismatches.
+ * @property {boolean} DEDUPLICATE_GEOMETRY - If true, geometries with identical normalized buffers share one geometryExpressID. Shared geometries count against CACHE_RETENTION_BYTES; once one is dropped, later copies are tessellated again and get a new geometryExpressID.
+ * @property {number} GEOMETRY_THREADS - Number of threads used to generate geometry in multi-threaded builds, 0 uses all available cores.
+ * @property {number} GEOMETRY_LODS - Number of simplified levels of detail built for every geometry (usually 2 or 3), 0 disables them. Levels are read with GetGeometry(modelID, geometryExpressID, lod).
+ * @property {number} VERTEX_WELD_TOLERANCE - Distance (in metres) below which vertices with the same normal are merged into one shared index, 0 keeps three vertices per triangle. The savings are reported by GetVertexWeldStats.
+ * @property {boolean} FLOAT32_GEOMETRY - If true, finished geometries only keep the float32 vertex buffer returned by GetVertexArray, roughly halving the memory held by cached geometry.
+ * @property {string} GEOMETRY_CACHE_PATH - Directory where generated geometry is stored, one file per model content and geometry settings. Opening the same model again reads meshes back instead of regenerating them. New geometry goes to a temporary file that replaces the cache file when the model is closed; when several models write the same file the last one closed wins. In node the path is on the host file system; in the browser the directory must be on a persistent file system (e.g. IDBFS) to survive a reload. Empty disables the cache.
+ * @property {number} ELEMENT_MAX_BOOLEAN_OPERANDS - Number of openings above which an element is streamed without them (unclipped), 0 for no limit.
+ * @property {number} ELEMENT_MAX_TRIANGLES - Number of triangles above which an element is streamed as its bounding box, 0 for no limit.
+ * @property {number} ELEMENT_TIME_LIMIT_MS - Milliseconds one element may spend on its openings before it is streamed without them, checked between openings, 0 for no limit. Elements over any limit have FlatMesh.fallback set and are listed by GetComplexityReport.
+ * @property {number} CACHE_RETENTION_BYTES - Bytes of placements, profiles, curves and points each geometry thread keeps from one element to the next, least recently used go first; mapped representations and shared geometries are held to the same budget. 0 drops placements and points after every element, and mapped representations are tessellated again for every IfcMappedItem.
  */
 export interface LoaderSettings {
   COORDINATE_TO_ORIGIN?: boolean;
   CIRCLE_SEGMENTS?: number;
+  CIRCLE_CHORD_TOLERANCE?: number;
+  MAX_CIRCLE_SEGMENTS?: number;
   MEMORY_LIMIT?: number;
   TAPE_SIZE?: number;
   LINEWRITER_BUFFER?: number;
@@ -83,6 +107,18 @@ export interface LoaderSettings {
   TOLERANCE_SCALAR_EQUALITY?: number;
   PLANE_REFIT_ITERATIONS?: number;
   BOOLEAN_UNION_THRESHOLD?: number;
+  STRICT_VALIDATION?: boolean;
+  PREFETCH_CARTESIAN_POINTS?: boolean;
+  DEDUPLICATE_GEOMETRY?: boolean;
+  GEOMETRY_THREADS?: number;
+  FLOAT32_GEOMETRY?: boolean;
+  GEOMETRY_LODS?: number;
+  VERTEX_WELD_TOLERANCE?: number;
+  GEOMETRY_CACHE_PATH?: string;
+  ELEMENT_MAX_BOOLEAN_OPERANDS?: number;
+  ELEMENT_MAX_TRIANGLES?: number;
+  ELEMENT_TIME_LIMIT_MS?: number;
+  CACHE_RETENTION_BYTES?: number;
 }
 
 export interface Vector<T> extends Iterable<T> {
@@ -112,9 +148,17 @@ export interface PlacedGeometry {
 export interface FlatMesh {
   geometries: Vector<PlacedGeometry>;
   expressID: number;
+  fallback: boolean;
   delete(): void;
 }
 
+export interface GeometryInstance {
+  elementExpressID: number;
+  geometryExpressID: number;
+  flatTransformation: Array<number>;
+  color: Color;
+}
+
 export interface Point {
   x: number;
   y: number;
@@ -162,10 +206,69 @@ export interface IfcGeometry {
   GetVertexDataSize(): number;
   GetIndexData(): number;
   GetIndexDataSize(): number;
+  GetQuantizedVertexData(): number;
+  GetQuantizedVertexDataSize(): number;
+  GetQuantizedIndexData(): number;
+  GetQuantizedIndexDataSize(): number;
+  GetDequantizationMatrix(): Array<number>;
   GetSweptDiskSolid(): SweptDiskSolid;
+  GetLodCount(): number;
   delete(): void;
 }
 
+export interface VertexWeldStats {
+  geometries: number;
+  verticesBefore: number;
+  verticesAfter: number;
+  bytesSaved: number;
+}
+
+export interface ComplexityFallback {
+  expressID: number;
+  reason: number;
+  operands: number;
+  triangles: number;
+  milliseconds: number;
+}
+
+// vertexData is interleaved position and normal, relative to flatTransformation; ranges holds expressID, first index and index count per element
+export interface MeshBatch {
+  color: Color;
+  vertexData: Float32Array;
+  indexData: Uint32Array;
+  flatTransformation: Array<number>;
+  ranges: Uint32Array;
+}
+
+export interface Vector3 {
+  x: number;
+  y: number;
+  z: number;
+}
+
+export interface RayHit {
+  expressID: number;
+  geometryExpressID: number;
+  triangle: number;
+  distance: number;
+  point: Vector3;
+}
+
+export interface Clash {
+  expressIDA: number;
+  expressIDB: number;
+  hard: boolean;
+  penetration: number;
+  distance: number;
+  point: Vector3;
+}
+
+export interface Progress {
+  bytes: number;
+  elements: number;
+  totalElements: number;
+}
+
 export interface Buffers {
   fvertexData: Array<number>;
   indexData: Array<number>;
@@ -449,6 +552,8 @@ export class IfcAPI {
     let s: LoaderSettings = {
       COORDINATE_TO_ORIGIN: false,
       CIRCLE_SEGMENTS: 12,
+      CIRCLE_CHORD_TOLERANCE: 0,
+      MAX_CIRCLE_SEGMENTS: 128,
       TAPE_SIZE: 67108864,
       MEMORY_LIMIT: 2147483648,
       LINEWRITER_BUFFER: 10000,
@@ -459,6 +564,18 @@ export class IfcAPI {
       TOLERANCE_SCALAR_EQUALITY: 1.0e-4,
       PLANE_REFIT_ITERATIONS: 1,
       BOOLEAN_UNION_THRESHOLD: 150,
+      STRICT_VALIDATION: false,
+      PREFETCH_CARTESIAN_POINTS: false,
+      DEDUPLICATE_GEOMETRY: false,
+      GEOMETRY_THREADS: 0,
+      FLOAT32_GEOMETRY: false,
+      GEOMETRY_LODS: 0,
+      VERTEX_WELD_TOLERANCE: 0,
+      GEOMETRY_CACHE_PATH: "",
+      ELEMENT_MAX_BOOLEAN_OPERANDS: 0,
+      ELEMENT_MAX_TRIANGLES: 0,
+      ELEMENT_TIME_LIMIT_MS: 0,
+      CACHE_RETENTION_BYTES: 67108864,
       ...settings,
     };
     return s;
@@ -479,7 +596,7 @@ export class IfcAPI {
    * Opens a model and returns a modelID number
    * @param data Buffer containing IFC data (bytes)
    * @param settings Settings for loading the model @see LoaderSettings
-   * @returns ModelID or -1 if model fails to open
+   * @returns ModelID or -1 if model fails to open or CancelOperation is called while it loads
    */
   OpenModel(data: Uint8Array, settings?: LoaderSettings): number {
     let s = this.CreateSettings(settings);
@@ -493,6 +610,7 @@ export class IfcAPI {
         return srcSize;
       }
     );
+    if (result == -1) return -1;
     this.deletedLines.set(result, new Set());
     var schemaName = this.GetHeaderLine(result, FILE_SCHEMA).arguments[0][0]
       .value;
@@ -511,7 +629,7 @@ export class IfcAPI {
    * Opens a model and returns a modelID number
    * @param callback a function of signature (offset:number, size: number) => Uint8Array that will retrieve the IFC data
    * @param settings Settings for loading the model @see LoaderSettings
-   * @returns ModelID or -1 if model fails to open
+   * @returns ModelID or -1 if model fails to open or CancelOperation is called while it loads
    */
   OpenModelFromCallback(
     callback: ModelLoadCallback,
@@ -528,6 +646,7 @@ export class IfcAPI {
         return srcSize;
       }
     );
+    if (result == -1) return -1;
     this.deletedLines.set(result, new Set());
     var schemaName = this.GetHeaderLine(result, FILE_SCHEMA).arguments[0][0]
       .value;
@@ -640,9 +759,13 @@ export class IfcAPI {
    * Retrieves the geometry of an element
    * @param modelID Model handle retrieved by OpenModel
    * @param geometryExpressID express ID of the element
+   * @param lod level of detail built with the GEOMETRY_LODS setting, 0 is the full geometry and levels past GetLodCount() return the coarsest one
    * @returns Geometry of the element as a list of vertices and indices
    */
-  GetGeometry(modelID: number, geometryExpressID: number): IfcGeometry {
+  GetGeometry(modelID: number, geometryExpressID: number, lod: number = 0): IfcGeometry {
+    if (lod > 0) {
+      return this.wasmModule.GetGeometryLod(modelID, geometryExpressID, lod);
+    }
     return this.wasmModule.GetGeometry(modelID, geometryExpressID);
   }
 
@@ -856,6 +979,16 @@ export class IfcAPI {
     return this.wasmModule.GetNextExpressID(modelID, expressID);
   }
 
+  /**
+   * Checks a line against the attribute table of its schema type
+   * @param modelID Model handle retrieved by OpenModel
+   * @param expressID express ID of the line
+   * @returns true if the number and kind of the line arguments match the schema
+   */
+  ValidateLine(modelID: number, expressID: number): boolean {
+    return this.wasmModule.ValidateLine(modelID, expressID);
+  }
+
   /**
    * Creates a new ifc entity
    * @param modelID Model handle retrieved by OpenModel
@@ -1294,6 +1427,24 @@ export class IfcAPI {
     return this.wasmModule.GetCoordinationMatrix(modelID) as Array<number>;
   }
 
+  /**
+   * Get how much the VERTEX_WELD_TOLERANCE setting reduced the geometry generated so far
+   * @param modelID model ID
+   * @returns number of welded geometries, their vertex count before and after welding and the float32 vertex bytes saved
+   */
+  GetVertexWeldStats(modelID: number): VertexWeldStats {
+    return this.wasmModule.GetVertexWeldStats(modelID);
+  }
+
+  /**
+   * Lists the elements that went over ELEMENT_MAX_BOOLEAN_OPERANDS, ELEMENT_MAX_TRIANGLES or ELEMENT_TIME_LIMIT_MS in the geometry generated so far
+   * @param modelID model ID
+   * @returns one entry per element in expressID order, with the limit it went over (FALLBACK_BOOLEAN_OPERANDS, FALLBACK_TIME or FALLBACK_TRIANGLES), its number of openings, its triangles and the time spent on its openings
+   */
+  GetComplexityReport(modelID: number): Array<ComplexityFallback> {
+    return this.wasmModule.GetComplexityReport(modelID);
+  }
+
   GetVertexArray(ptr: number, size: number): Float32Array {
     return this.getSubArray(this.wasmModule.HEAPF32, ptr, size);
   }
@@ -1302,6 +1453,19 @@ export class IfcAPI {
     return this.getSubArray(this.wasmModule.HEAPU32, ptr, size);
   }
 
+  /**
+   * Reads the compact buffers of a geometry: GetQuantizedVertexData holds 4 values per vertex, x, y and z as
+   * fractions of the geometry bounding box (multiply by GetDequantizationMatrix to get the same space as GetVertexData)
+   * and the octahedron encoded normal with x in the low and y in the high byte. GetQuantizedIndexData is only
+   * available for geometries with less than 65536 vertices, its size is 0 otherwise.
+   * @param ptr pointer returned by GetQuantizedVertexData or GetQuantizedIndexData
+   * @param size size returned by GetQuantizedVertexDataSize or GetQuantizedIndexDataSize
+   * @returns copy of the buffer
+   */
+  GetQuantizedArray(ptr: number, size: number): Uint16Array {
+    return new Uint16Array(this.wasmModule.HEAPU8.buffer, ptr, size).slice(0);
+  }
+
   getSubArray(heap: any, startPtr: number, sizeBytes: number) {
     return heap.subarray(startPtr / 4, startPtr / 4 + sizeBytes).slice(0);
   }
@@ -1364,6 +1528,207 @@ export class IfcAPI {
     this.wasmModule.StreamAllMeshesWithTypes(modelID, types, meshCallback);
   }
 
+  /**
+   * Streams meshes of a model with specific express id, sending every geometry only once
+   * @param modelID Model handle retrieved by OpenModel
+   * @param expressIDs expressIDs of elements to stream
+   * @param geometryCallback called the first time a geometry is used, GetGeometry(modelID, geometryExpressID) is valid during the callback
+   * @param instancesCallback called for each element with the placements of its geometries
+   */
+  StreamInstancedMeshes(
+    modelID: number,
+    expressIDs: Array<number>,
+    geometryCallback: (geometryExpressID: number) => void,
+    instancesCallback: (instances: Vector<GeometryInstance>, index: number, total: number) => void
+  ) {
+    this.wasmModule.StreamInstancedMeshes(modelID, expressIDs, geometryCallback, (instances: Vector<GeometryInstance>, index: number, total: number) => {
+      instances[Symbol.iterator] = function* () {
+        for (let i = 0; i < instances.size(); i++) yield instances.get(i);
+      };
+      instancesCallback(instances, index, total);
+    });
+  }
+
+  /**
+   * Streams all meshes of a model, sending every geometry only once
+   * @param modelID Model handle retrieved by OpenModel
+   * @param geometryCallback called the first time a geometry is used, GetGeometry(modelID, geometryExpressID) is valid during the callback
+   * @param instancesCallback called for each element with the placements of its geometries
+   */
+  StreamAllInstancedMeshes(
+    modelID: number,
+    geometryCallback: (geometryExpressID: number) => void,
+    instancesCallback: (instances: Vector<GeometryInstance>, index: number, total: number) => void
+  ) {
+    this.wasmModule.StreamAllInstancedMeshes(modelID, geometryCallback, (instances: Vector<GeometryInstance>, index: number, total: number) => {
+      instances[Symbol.iterator] = function* () {
+        for (let i = 0; i < instances.size(); i++) yield instances.get(i);
+      };
+      instancesCallback(instances, index, total);
+    });
+  }
+
+  /**
+   * Computes conservative axis aligned boxes of elements from their placements, profiles and point lists,
+   * without tessellating them or subtracting their openings
+   * @param modelID Model handle retrieved by OpenModel
+   * @param expressIDs expressIDs of the elements
+   * @returns seven numbers per element with geometry: expressID, minX, minY, minZ, maxX, maxY, maxZ, in the coordinates of the streamed meshes
+   */
+  GetElementBounds(modelID: number, expressIDs: Array<number>): Float64Array {
+    return this.wasmModule.GetElementBounds(modelID, expressIDs);
+  }
+
+  /**
+   * Computes conservative axis aligned boxes of all the elements StreamAllMeshes would stream, see GetElementBounds
+   * @param modelID Model handle retrieved by OpenModel
+   * @returns seven numbers per element with geometry: expressID, minX, minY, minZ, maxX, maxY, maxZ
+   */
+  GetAllElementBounds(modelID: number): Float64Array {
+    return this.wasmModule.GetAllElementBounds(modelID);
+  }
+
+  /**
+   * (Re)builds the spatial index of all the elements StreamAllMeshes would stream, from their bounds.
+   * The queries build it on first use, elements whose meshes are generated again are refitted automatically.
+   * @param modelID Model handle retrieved by OpenModel
+   * @returns number of indexed elements
+   */
+  BuildElementIndex(modelID: number): number {
+    return this.wasmModule.BuildElementIndex(modelID);
+  }
+
+  /**
+   * Gets the elements whose bounds overlap a box given in the coordinates of the streamed meshes
+   * @param modelID Model handle retrieved by OpenModel
+   * @param min minimum corner of the box
+   * @param max maximum corner of the box
+   * @returns expressIDs of the elements
+   */
+  QueryElementsInBox(modelID: number, min: Vector3, max: Vector3): Vector<number> {
+    let ids = this.wasmModule.QueryElementsInBox(modelID, min, max);
+    ids[Symbol.iterator] = function* () {
+      for (let i = 0; i < ids.size(); i++) yield ids.get(i);
+    };
+    return ids;
+  }
+
+  /**
+   * Gets the elements whose bounds are not fully outside a set of planes, such as the six planes of a camera frustum
+   * @param modelID Model handle retrieved by OpenModel
+   * @param planes four numbers per plane (a, b, c, d), a point is inside when a * x + b * y + c * z + d >= 0
+   * @returns expressIDs of the elements
+   */
+  QueryElementsInFrustum(modelID: number, planes: Array<number>): Vector<number> {
+    let ids = this.wasmModule.QueryElementsInFrustum(modelID, planes);
+    ids[Symbol.iterator] = function* () {
+      for (let i = 0; i < ids.size(); i++) yield ids.get(i);
+    };
+    return ids;
+  }
+
+  /**
+   * Finds the nearest element triangle hit by a ray, candidates are taken from the element index and tested against their meshes
+   * @param modelID Model handle retrieved by OpenModel
+   * @param origin origin of the ray in the coordinates of the streamed meshes
+   * @param dir direction of the ray
+   * @returns the hit element, geometry and triangle with the distance and point of the hit, or null when nothing is hit
+   */
+  RaycastElements(modelID: number, origin: Vector3, dir: Vector3): RayHit | null {
+    return this.wasmModule.RaycastElements(modelID, origin, dir);
+  }
+
+  /**
+   * Finds the elements whose meshes intersect (hard clashes) or come closer than a clearance, within one model or between two
+   * @param modelID Model handle retrieved by OpenModel
+   * @param expressIDs elements of the first set, all elements of the model when empty
+   * @param otherModelID model of the second set, the same model checks the first set against itself when otherExpressIDs is empty
+   * @param otherExpressIDs elements of the second set, all elements of the other model when empty
+   * @param tolerance hard clashes that do not go deeper than this are dropped as touching
+   * @param clearance elements closer than this are reported as clearance clashes, 0 skips the check
+   * @returns one entry per clashing pair, penetration is an estimate of the overlap of hard clashes, distance the gap of clearance clashes and point is in the coordinates of the first model
+   */
+  DetectClashes(modelID: number, expressIDs: Array<number> = [], otherModelID: number = modelID, otherExpressIDs: Array<number> = [], tolerance: number = 0, clearance: number = 0): Array<Clash> {
+    return this.wasmModule.DetectClashes(modelID, expressIDs, otherModelID, otherExpressIDs, tolerance, clearance);
+  }
+
+  /**
+   * Orders the elements StreamAllMeshes would stream so the most significant come first, to be streamed with StreamMeshesBudgeted
+   * @param modelID Model handle retrieved by OpenModel
+   * @param priority STREAM_PRIORITY_SIZE for the biggest bounds first, STREAM_PRIORITY_DISTANCE for the bounds nearest to point first or STREAM_PRIORITY_STOREY for the elements of storeyID first
+   * @param point camera position in the coordinates of the streamed meshes, used by STREAM_PRIORITY_DISTANCE
+   * @param storeyID expressID of an IfcBuildingStorey, used by STREAM_PRIORITY_STOREY
+   * @returns expressIDs in streaming order, elements without geometry last
+   */
+  GetPrioritizedElementIDs(modelID: number, priority: number, point: Vector3 = { x: 0, y: 0, z: 0 }, storeyID: number = 0): Uint32Array {
+    return this.wasmModule.GetPrioritizedElementIDs(modelID, priority, point, storeyID);
+  }
+
+  /**
+   * Streams meshes of a list of elements from a cursor until a time or memory budget is used up. The budget is checked before each mesh is handed out, so a call overruns it by at most one mesh; the first mesh is always handed out.
+   * @param modelID Model handle retrieved by OpenModel
+   * @param expressIDs elements to stream, usually from GetPrioritizedElementIDs
+   * @param cursor index in expressIDs to start from, 0 on the first call
+   * @param meshCallback callback function that is called for each mesh
+   * @param timeBudgetMs milliseconds to spend in this call, 0 for no limit
+   * @param byteBudget bytes of vertex and index data to hand out in this call, 0 for no limit
+   * @returns the cursor to pass to the next call, expressIDs.length once everything was streamed. After CancelOperation it points at the first mesh not handed out, so passing it again resumes the stream
+   */
+  StreamMeshesBudgeted(modelID: number, expressIDs: Array<number> | Uint32Array, cursor: number, meshCallback: (mesh: FlatMesh, index: number, total: number) => void, timeBudgetMs: number = 0, byteBudget: number = 0): number {
+    return this.wasmModule.StreamMeshesBudgeted(modelID, expressIDs, cursor, timeBudgetMs, byteBudget, meshCallback);
+  }
+
+  /**
+   * Streams the triangles of a model merged by colour into large batches, so each batch can be drawn with a single draw call. Polylines are left out, they are streamed per element as before
+   * @param modelID Model handle retrieved by OpenModel
+   * @param batchCallback function called with each batch once it is full, and with the remaining batches at the end
+   * @param expressIDs elements to batch, all elements except openings and spaces when empty
+   * @param maxVertices most vertices in one batch, a single geometry with more vertices gets a batch of its own
+   */
+  StreamMeshBatches(modelID: number, batchCallback: (batch: MeshBatch) => void, expressIDs: Array<number> = [], maxVertices: number = 262144) {
+    this.wasmModule.StreamMeshBatches(modelID, expressIDs, maxVertices, batchCallback);
+  }
+
+  /**
+   * Finds the element a triangle of a batch belongs to, for picking
+   * @param batch batch handed out by StreamMeshBatches
+   * @param triangle index of the triangle in batch.indexData, as reported by a raycaster
+   * @returns expressID of the element, 0 when the triangle is not in the batch
+   */
+  GetBatchExpressID(batch: MeshBatch, triangle: number): number {
+    let index = triangle * 3;
+    let low = 0;
+    let high = batch.ranges.length / 3;
+    while (low < high) {
+      let middle = (low + high) >> 1;
+      if (batch.ranges[middle * 3 + 1] <= index) low = middle + 1;
+      else high = middle;
+    }
+    if (low == 0) return 0;
+    let range = (low - 1) * 3;
+    return index < batch.ranges[range + 1] + batch.ranges[range + 2] ? batch.ranges[range] : 0;
+  }
+
+  /**
+   * Exports the meshes of a model as glTF: a .gltf file describing the scene and a .bin file holding its buffers, both handed out in consecutive pieces of about 1 MB. Geometry placed more than once with the same colour is written once and drawn through EXT_mesh_gpu_instancing, materials are shared by colour and each node is named after its element (instanced nodes list theirs in extras.expressIDs).
+   * The .bin pieces arrive while the elements are generated and the .gltf pieces at the end, so pass them on (e.g. to a file or a stream) rather than collecting them. Besides one element's geometry, the memory used grows with the scene description: a few dozen bytes per distinct geometry and per placement, and the .gltf file has a node or an instance for every placement. The .bin file has no size limit, but the .gltf file refers to it by binURI, so it only loads from where that name resolves.
+   * @param modelID Model handle retrieved by OpenModel
+   * @param gltfCallback function called with each consecutive piece of the .gltf file
+   * @param binCallback function called with each consecutive piece of the .bin file
+   * @param expressIDs elements to export, all elements except openings and spaces when empty
+   * @param binURI name of the .bin file relative to the .gltf file
+   * @returns false when the model is not open or the export was cancelled, the pieces handed out until then do not form a valid file
+   */
+  ExportGltf(modelID: number, gltfCallback: ModelSaveCallback, binCallback: ModelSaveCallback, expressIDs: Array<number> = [], binURI: string = "model.bin"): boolean {
+    let copy = (callback: ModelSaveCallback) => (srcPtr: number, srcSize: number) => {
+      let src = this.wasmModule.HEAPU8.subarray(srcPtr, srcPtr + srcSize);
+      let newBuffer = new Uint8Array(srcSize);
+      newBuffer.set(src);
+      callback(newBuffer);
+    };
+    return this.wasmModule.ExportGltf(modelID, expressIDs, binURI, copy(gltfCallback), copy(binCallback));
+  }
+
   /**
    * Checks if a specific model ID is open or closed
    * @param modelID Model handle retrieved by OpenModel
@@ -1482,6 +1847,22 @@ export class IfcAPI {
     this.isWasmPathAbsolute = absolute;
   }
 
+  /**
+   * Sets a callback that reports the progress of loading, saving and streaming. The fields an operation cannot know are 0: loading reports bytes read and lines parsed, saving bytes written out of totalElements lines, streaming meshes out of totalElements
+   * @param callback function called with the model handle and the progress, undefined removes it
+   */
+  SetProgressCallback(callback?: (modelID: number, progress: Progress) => void): void {
+    this.wasmModule.SetProgressCallback(callback);
+  }
+
+  /**
+   * Stops the loading, saving or streaming running on a model, usually called from the progress or mesh callback. A cancelled OpenModel returns -1 and a cancelled SaveModel returns the data written so far
+   * @param modelID Model handle retrieved by OpenModel, or the handle passed to the progress callback while the model loads
+   */
+  CancelOperation(modelID: number): void {
+    this.wasmModule.CancelOperation(modelID);
+  }
+
   /**
    * Sets the log level
    * @param level Log level to set
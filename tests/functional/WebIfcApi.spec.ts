@@ -1,4 +1,5 @@
 import * as fs from 'fs';
+import * as os from 'os';
 import * as path from 'path';
 import * as WebIFC from '../../dist/web-ifc-api-node.js';
 import {IFC2X3} from '../../dist/web-ifc-api-node.js';
@@ -9,6 +10,7 @@ import type {
     FlatMesh,
     IfcAPI,
     IfcGeometry,
+    MeshBatch,
     RawLineData
 } from '../../dist/web-ifc-api-node.js';
 
@@ -37,6 +39,29 @@ let expectedVertexAndIndexDatas: any = {
 let IFCEXTRUDEDAREASOLIDMeshesCount = 97;
 let givenCoordinationMatrix: number[] = [1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1];
 
+// an IFC2X3 model in metres holding the given DATA lines; #1-#6 are reserved for the origin placement (#2), the
+// length unit, the 3D model context (#5) and the project
+function stepModel(lines: string[]): Uint8Array {
+    return new TextEncoder().encode([
+        "ISO-10303-21;",
+        "HEADER;",
+        "FILE_DESCRIPTION((''),'2;1');",
+        "FILE_NAME('','',(''),(''),'','','');",
+        "FILE_SCHEMA(('IFC2X3'));",
+        "ENDSEC;",
+        "DATA;",
+        "#1=IFCCARTESIANPOINT((0.,0.,0.));",
+        "#2=IFCAXIS2PLACEMENT3D(#1,$,$);",
+        "#3=IFCSIUNIT(*,.LENGTHUNIT.,$,.METRE.);",
+        "#4=IFCUNITASSIGNMENT((#3));",
+        "#5=IFCGEOMETRICREPRESENTATIONCONTEXT($,'Model',3,1.E-05,#2,$);",
+        "#6=IFCPROJECT('0000000000000000000001',$,'P',$,$,$,$,(#5),#4);",
+        ...lines,
+        "ENDSEC;",
+        "END-ISO-10303-21;"
+    ].join("\n"));
+}
+
 
 
 beforeAll(async () => {
@@ -127,6 +152,9 @@ describe('WebIfcApi reading methods', () => {
     test('returns next expressID if it is the max ID', () => {
         expect(ifcApi.GetNextExpressID(modelID, 14312)).toBe(14313);
     })
+    test('can validate a line against the schema', () => {
+        expect(ifcApi.ValidateLine(modelID, expressId)).toBe(true);
+    })
     test('Can get max expressID', () => {
         const maxExpressId : number = ifcApi.GetMaxExpressID(modelID);
         expect(maxExpressId).toEqual(lastExpressId);
@@ -254,6 +282,476 @@ describe('WebIfcApi geometries', () => {
         });
         expect(count).toEqual(IFCEXTRUDEDAREASOLIDMeshesCount);
     })
+    test('streams every instanced geometry only once', () => {
+        let elements: number = 0;
+        let delivered = new Set<number>();
+        ifcApi.StreamAllInstancedMeshes(modelID, (geometryExpressID) => {
+            expect(delivered.has(geometryExpressID)).toBeFalsy();
+            delivered.add(geometryExpressID);
+        }, (instances) => {
+            elements++;
+            for (const instance of instances) {
+                expect(delivered.has(instance.geometryExpressID)).toBeTruthy();
+            }
+        });
+        expect(elements).toEqual(meshesCount);
+    })
+    test('float32 geometry returns the same vertex and index arrays', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let float32ModelID = ifcApi.OpenModel(exampleIFCData, { FLOAT32_GEOMETRY: true });
+        let flatMesh = ifcApi.GetFlatMesh(float32ModelID, geometries.get(expectedVertexAndIndexDatas.geometryIndex).expressID);
+        let geometry = ifcApi.GetGeometry(float32ModelID, flatMesh.geometries.get(0).geometryExpressID);
+        let geometryVertexArray = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+        let geometryIndexData = ifcApi.GetIndexArray(geometry.GetIndexData(), geometry.GetIndexDataSize());
+        expect(geometryIndexData.join(",")).toEqual(expectedVertexAndIndexDatas.indexDatas);
+        expect(geometryVertexArray.join(",")).toEqual(expectedVertexAndIndexDatas.vertexDatas);
+        ifcApi.CloseModel(float32ModelID);
+    })
+    test('levels of detail never have more triangles than the full geometry', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let lodModelID = ifcApi.OpenModel(exampleIFCData, { GEOMETRY_LODS: 2 });
+        ifcApi.StreamAllMeshes(lodModelID, (mesh: FlatMesh) => {
+            for (let i = 0; i < mesh.geometries.size(); i++) {
+                let geometryExpressID = mesh.geometries.get(i).geometryExpressID;
+                let geometry = ifcApi.GetGeometry(lodModelID, geometryExpressID);
+                let lod = ifcApi.GetGeometry(lodModelID, geometryExpressID, 2);
+                expect(geometry.GetLodCount()).toBeGreaterThanOrEqual(1);
+                expect(lod.GetIndexDataSize()).toBeLessThanOrEqual(geometry.GetIndexDataSize());
+            }
+        });
+        ifcApi.CloseModel(lodModelID);
+    })
+    test('vertex welding keeps the triangles and reports fewer vertices', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let weldModelID = ifcApi.OpenModel(exampleIFCData, { VERTEX_WELD_TOLERANCE: 1e-6 });
+        let expressID = geometries.get(expectedVertexAndIndexDatas.geometryIndex).expressID;
+        let flatMesh = ifcApi.GetFlatMesh(weldModelID, expressID);
+        let geometry = ifcApi.GetGeometry(weldModelID, flatMesh.geometries.get(0).geometryExpressID);
+        let stats = ifcApi.GetVertexWeldStats(weldModelID);
+        expect(stats.verticesAfter).toBeLessThan(stats.verticesBefore);
+        expect(stats.bytesSaved).toBe((stats.verticesBefore - stats.verticesAfter) * 6 * 4);
+        expect(geometry.GetVertexDataSize()).toBeLessThan(expectedVertexAndIndexDatas.vertexDatas.split(",").length);
+        expect(geometry.GetIndexDataSize()).toBe(expectedVertexAndIndexDatas.indexDatas.split(",").length);
+        ifcApi.CloseModel(weldModelID);
+    })
+    test('elements over the triangle limit are streamed as boxes and reported', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let limitedModelID = ifcApi.OpenModel(exampleIFCData, { ELEMENT_MAX_TRIANGLES: 12 });
+        let fallbacks: number[] = [];
+        ifcApi.StreamAllMeshes(limitedModelID, (mesh: FlatMesh) => {
+            if (!mesh.fallback) return;
+            fallbacks.push(mesh.expressID);
+            expect(mesh.geometries.size()).toBe(1);
+            let geometry = ifcApi.GetGeometry(limitedModelID, mesh.geometries.get(0).geometryExpressID);
+            expect(geometry.GetIndexDataSize()).toBe(36);
+        });
+        let report = ifcApi.GetComplexityReport(limitedModelID);
+        expect(fallbacks.length).toBeGreaterThan(0);
+        expect(report.map((entry) => entry.expressID).sort()).toEqual(fallbacks.sort());
+        for (let entry of report) {
+            expect(entry.reason).toBe(WebIFC.FALLBACK_TRIANGLES);
+            expect(entry.triangles).toBeGreaterThan(12);
+        }
+        ifcApi.CloseModel(limitedModelID);
+    })
+    test('elements over the opening or time limit are streamed unclipped and reported', () => {
+        const ifcData = stepModel([
+            "#7=IFCCARTESIANPOINT((0.,0.));",
+            "#8=IFCAXIS2PLACEMENT2D(#7,$);",
+            "#9=IFCRECTANGLEPROFILEDEF(.AREA.,$,#8,4.,1.);",
+            "#10=IFCDIRECTION((0.,0.,1.));",
+            "#11=IFCEXTRUDEDAREASOLID(#9,#2,#10,3.);",
+            "#12=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#11));",
+            "#13=IFCPRODUCTDEFINITIONSHAPE($,$,(#12));",
+            "#14=IFCLOCALPLACEMENT($,#2);",
+            "#15=IFCBUILDINGELEMENTPROXY('0000000000000000000002',$,'W',$,$,#14,#13,$,$);",
+            "#16=IFCCARTESIANPOINT((0.,0.,1.));",
+            "#17=IFCAXIS2PLACEMENT3D(#16,$,$);",
+            "#20=IFCCARTESIANPOINT((-1.,0.));",
+            "#21=IFCAXIS2PLACEMENT2D(#20,$);",
+            "#22=IFCRECTANGLEPROFILEDEF(.AREA.,$,#21,0.5,2.);",
+            "#23=IFCEXTRUDEDAREASOLID(#22,#17,#10,1.);",
+            "#24=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#23));",
+            "#25=IFCPRODUCTDEFINITIONSHAPE($,$,(#24));",
+            "#26=IFCLOCALPLACEMENT(#14,#2);",
+            "#27=IFCOPENINGELEMENT('0000000000000000000003',$,'O1',$,$,#26,#25,$);",
+            "#28=IFCRELVOIDSELEMENT('0000000000000000000004',$,$,$,#15,#27);",
+            "#30=IFCCARTESIANPOINT((1.,0.));",
+            "#31=IFCAXIS2PLACEMENT2D(#30,$);",
+            "#32=IFCRECTANGLEPROFILEDEF(.AREA.,$,#31,0.5,2.);",
+            "#33=IFCEXTRUDEDAREASOLID(#32,#17,#10,1.);",
+            "#34=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#33));",
+            "#35=IFCPRODUCTDEFINITIONSHAPE($,$,(#34));",
+            "#36=IFCLOCALPLACEMENT(#14,#2);",
+            "#37=IFCOPENINGELEMENT('0000000000000000000005',$,'O2',$,$,#36,#35,$);",
+            "#38=IFCRELVOIDSELEMENT('0000000000000000000006',$,$,$,#15,#37);"
+        ]);
+        let generate = (settings: LoaderSettings) => {
+            let id = ifcApi.OpenModel(ifcData, settings);
+            let meshes = new Map<number, { fallback: boolean, indices: number }>();
+            ifcApi.StreamAllMeshes(id, (mesh: FlatMesh) => {
+                let indices = 0;
+                for (let i = 0; i < mesh.geometries.size(); i++) {
+                    indices += ifcApi.GetGeometry(id, mesh.geometries.get(i).geometryExpressID).GetIndexDataSize();
+                }
+                meshes.set(mesh.expressID, { fallback: mesh.fallback, indices });
+            });
+            let report = ifcApi.GetComplexityReport(id);
+            ifcApi.CloseModel(id);
+            return { meshes, report };
+        };
+
+        // two openings are within a limit of two and cut the box
+        let clipped = generate({ ELEMENT_MAX_BOOLEAN_OPERANDS: 2 });
+        expect(clipped.report.length).toBe(0);
+        expect(clipped.meshes.get(15)!.fallback).toBe(false);
+        expect(clipped.meshes.get(15)!.indices).toBeGreaterThan(36);
+
+        let operands = generate({ ELEMENT_MAX_BOOLEAN_OPERANDS: 1 });
+        expect(operands.meshes.get(15)).toEqual({ fallback: true, indices: 36 });
+        expect(operands.report.length).toBe(1);
+        expect(operands.report[0].expressID).toBe(15);
+        expect(operands.report[0].reason).toBe(WebIFC.FALLBACK_BOOLEAN_OPERANDS);
+        expect(operands.report[0].operands).toBe(2);
+        expect(operands.report[0].triangles).toBe(12);
+
+        // a limit no element can meet runs out before the first opening
+        const timeLimitMs = 1e-6;
+        let timed = generate({ ELEMENT_TIME_LIMIT_MS: timeLimitMs });
+        expect(timed.meshes.get(15)).toEqual({ fallback: true, indices: 36 });
+        expect(timed.report.length).toBe(1);
+        expect(timed.report[0].expressID).toBe(15);
+        expect(timed.report[0].reason).toBe(WebIFC.FALLBACK_TIME);
+        expect(timed.report[0].operands).toBe(2);
+        expect(timed.report[0].milliseconds).toBeGreaterThan(timeLimitMs);
+    })
+    test('retained caches produce the same geometry as a full clear', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let sizes = (settings: LoaderSettings) => {
+            let id = ifcApi.OpenModel(exampleIFCData, settings);
+            let result: string[] = [];
+            ifcApi.StreamAllMeshes(id, (mesh: FlatMesh) => {
+                for (let i = 0; i < mesh.geometries.size(); i++) {
+                    let placed = mesh.geometries.get(i);
+                    let geometry = ifcApi.GetGeometry(id, placed.geometryExpressID);
+                    result.push(`${mesh.expressID}:${geometry.GetVertexDataSize()}:${geometry.GetIndexDataSize()}:${placed.flatTransformation.map((v: number) => v.toFixed(6)).join(',')}`);
+                }
+            });
+            ifcApi.CloseModel(id);
+            return result;
+        };
+        // with no budget mapped representations are evicted after every element and tessellated again
+        let cleared = sizes({ CACHE_RETENTION_BYTES: 0 });
+        expect(sizes({ CACHE_RETENTION_BYTES: 4096 })).toEqual(cleared);
+        expect(sizes({})).toEqual(cleared);
+    })
+    test('threaded generation produces the same meshes as the serial path', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let meshes = (threads: number) => {
+            let id = ifcApi.OpenModel(exampleIFCData, { GEOMETRY_THREADS: threads });
+            let result: string[] = [];
+            // the second pass starts from the mapped geometry the workers of the first one shared
+            for (let pass = 0; pass < 2; pass++) {
+                ifcApi.StreamAllMeshes(id, (mesh: FlatMesh) => {
+                    for (let i = 0; i < mesh.geometries.size(); i++) {
+                        let placed = mesh.geometries.get(i);
+                        let geometry = ifcApi.GetGeometry(id, placed.geometryExpressID);
+                        let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+                        let indices = ifcApi.GetIndexArray(geometry.GetIndexData(), geometry.GetIndexDataSize());
+                        result.push(`${mesh.expressID}:${placed.geometryExpressID}:${Array.from(vertices).join(',')}:${Array.from(indices).join(',')}:${placed.flatTransformation.join(',')}`);
+                    }
+                });
+            }
+            ifcApi.CloseModel(id);
+            return result;
+        };
+        expect(meshes(4)).toEqual(meshes(1));
+    })
+    test('bounds can be queried from inside a threaded stream', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let id = ifcApi.OpenModel(exampleIFCData, { GEOMETRY_THREADS: 4 });
+        let ids = Array.from(ifcApi.GetPrioritizedElementIDs(id, WebIFC.STREAM_PRIORITY_SIZE));
+        let expected = ifcApi.GetElementBounds(id, ids);
+        let calls = 0;
+        // the pool threads are all held by the stream, the nested loop has to run on the calling thread
+        ifcApi.StreamAllMeshes(id, () => {
+            if (calls++ < 3) expect(ifcApi.GetElementBounds(id, ids)).toEqual(expected);
+        });
+        expect(calls).toBeGreaterThan(0);
+        ifcApi.CloseModel(id);
+    })
+    test('chord tolerance derives circle segments from the radius', () => {
+        const radii = [0.01, 1, 10];
+        let lines = [
+            "#7=IFCCARTESIANPOINT((0.,0.));",
+            "#8=IFCAXIS2PLACEMENT2D(#7,$);",
+            "#9=IFCDIRECTION((0.,0.,1.));",
+            "#10=IFCLOCALPLACEMENT($,#2);"
+        ];
+        radii.forEach((radius, i) => {
+            let id = 100 + i * 10;
+            lines.push(`#${id}=IFCCIRCLEPROFILEDEF(.AREA.,$,#8,${radius.toFixed(2)});`);
+            lines.push(`#${id + 1}=IFCEXTRUDEDAREASOLID(#${id},#2,#9,1.);`);
+            lines.push(`#${id + 2}=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#${id + 1}));`);
+            lines.push(`#${id + 3}=IFCPRODUCTDEFINITIONSHAPE($,$,(#${id + 2}));`);
+            lines.push(`#${id + 4}=IFCBUILDINGELEMENTPROXY('000000000000000000000${i}',$,'C',$,$,#10,#${id + 3},$,$);`);
+        });
+        const ifcData = stepModel(lines);
+        // an extruded circle has one distinct xy position per chord of its profile
+        let chords = (settings: LoaderSettings) => {
+            let id = ifcApi.OpenModel(ifcData, settings);
+            let result = radii.map((radius, i) => {
+                let mesh = ifcApi.GetFlatMesh(id, 100 + i * 10 + 4);
+                let geometry = ifcApi.GetGeometry(id, mesh.geometries.get(0).geometryExpressID);
+                let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+                let positions = new Set<string>();
+                for (let v = 0; v < vertices.length; v += 6) positions.add(`${vertices[v].toFixed(4)},${vertices[v + 1].toFixed(4)}`);
+                return positions.size;
+            });
+            ifcApi.CloseModel(id);
+            return result;
+        };
+        expect(chords({ CIRCLE_SEGMENTS: 12 })).toEqual([11, 11, 11]);
+        expect(chords({ CIRCLE_CHORD_TOLERANCE: 0.01, MAX_CIRCLE_SEGMENTS: 128 })).toEqual([4, 23, 71]);
+        expect(chords({ CIRCLE_CHORD_TOLERANCE: 0.01, MAX_CIRCLE_SEGMENTS: 32 })).toEqual([4, 23, 31]);
+    })
+    test('identical elements share one geometry when deduplicated', () => {
+        const ifcData = stepModel([
+            "#7=IFCCARTESIANPOINT((0.,0.));",
+            "#8=IFCAXIS2PLACEMENT2D(#7,$);",
+            "#9=IFCRECTANGLEPROFILEDEF(.AREA.,$,#8,2.,1.);",
+            "#10=IFCDIRECTION((0.,0.,1.));",
+            "#11=IFCEXTRUDEDAREASOLID(#9,#2,#10,3.);",
+            "#12=IFCEXTRUDEDAREASOLID(#9,#2,#10,3.);",
+            "#13=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#11));",
+            "#14=IFCSHAPEREPRESENTATION(#5,'Body','SweptSolid',(#12));",
+            "#15=IFCPRODUCTDEFINITIONSHAPE($,$,(#13));",
+            "#16=IFCPRODUCTDEFINITIONSHAPE($,$,(#14));",
+            "#17=IFCLOCALPLACEMENT($,#2);",
+            "#18=IFCCARTESIANPOINT((10.,0.,0.));",
+            "#19=IFCAXIS2PLACEMENT3D(#18,$,$);",
+            "#20=IFCLOCALPLACEMENT($,#19);",
+            "#21=IFCBUILDINGELEMENTPROXY('0000000000000000000002',$,'A',$,$,#17,#15,$,$);",
+            "#22=IFCBUILDINGELEMENTPROXY('0000000000000000000003',$,'B',$,$,#20,#16,$,$);"
+        ]);
+        let dedupModelID = ifcApi.OpenModel(ifcData, { DEDUPLICATE_GEOMETRY: true });
+        let geometryIDs = new Map<number, number>();
+        ifcApi.StreamAllMeshes(dedupModelID, (mesh: FlatMesh) => {
+            expect(mesh.geometries.size()).toBe(1);
+            geometryIDs.set(mesh.expressID, mesh.geometries.get(0).geometryExpressID);
+        });
+        expect(geometryIDs.size).toBe(2);
+        expect(geometryIDs.get(21)).toBe(geometryIDs.get(22));
+        let geometry = ifcApi.GetGeometry(dedupModelID, geometryIDs.get(21)!);
+        expect(geometry.GetIndexDataSize()).toBeGreaterThan(0);
+        ifcApi.CloseModel(dedupModelID);
+    })
+    test('meshes read back from the geometry cache equal the generated ones', () => {
+        const exampleIFCData = fs.readFileSync(path.join(__dirname, '../ifcfiles/public/example.ifc'));
+        let cachePath = fs.mkdtempSync(path.join(os.tmpdir(), 'web-ifc-cache-'));
+        let cacheFiles = () => fs.readdirSync(cachePath).filter((name) => name.endsWith('.wgc'));
+        let meshes = () => {
+            let id = ifcApi.OpenModel(exampleIFCData, { GEOMETRY_CACHE_PATH: cachePath });
+            let result: string[] = [];
+            ifcApi.StreamAllMeshes(id, (mesh: FlatMesh) => {
+                for (let i = 0; i < mesh.geometries.size(); i++) {
+                    let placed = mesh.geometries.get(i);
+                    let geometry = ifcApi.GetGeometry(id, placed.geometryExpressID);
+                    let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+                    let indices = ifcApi.GetIndexArray(geometry.GetIndexData(), geometry.GetIndexDataSize());
+                    result.push(`${mesh.expressID}:${placed.geometryExpressID}:${placed.color.x},${placed.color.y},${placed.color.z},${placed.color.w}:${Array.from(vertices).join(',')}:${Array.from(indices).join(',')}:${placed.flatTransformation.join(',')}`);
+                }
+            });
+            // closing the model publishes the cache file
+            ifcApi.CloseModel(id);
+            return result;
+        };
+        try {
+            expect(cacheFiles().length).toBe(0);
+            let generated = meshes();
+            expect(generated.length).toBeGreaterThan(0);
+            expect(cacheFiles().length).toBe(1);
+            expect(meshes()).toEqual(generated);
+        } finally {
+            fs.rmSync(cachePath, { recursive: true, force: true });
+        }
+    })
+    test('quantized buffers decode to the float vertex data', () => {
+        let flatMesh = ifcApi.GetFlatMesh(modelID, geometries.get(expectedVertexAndIndexDatas.geometryIndex).expressID);
+        let geometry = ifcApi.GetGeometry(modelID, flatMesh.geometries.get(0).geometryExpressID);
+        let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+        let quantized = ifcApi.GetQuantizedArray(geometry.GetQuantizedVertexData(), geometry.GetQuantizedVertexDataSize());
+        let quantizedIndices = ifcApi.GetQuantizedArray(geometry.GetQuantizedIndexData(), geometry.GetQuantizedIndexDataSize());
+        let matrix = geometry.GetDequantizationMatrix();
+        expect(quantizedIndices.join(",")).toEqual(expectedVertexAndIndexDatas.indexDatas);
+        expect(quantized.length / 4).toBe(vertices.length / 6);
+        for (let i = 0; i < quantized.length / 4; i++) {
+            for (let axis = 0; axis < 3; axis++) {
+                let decoded = quantized[i * 4 + axis] * matrix[axis * 5] + matrix[12 + axis];
+                expect(Math.abs(decoded - vertices[i * 6 + axis])).toBeLessThanOrEqual(matrix[axis * 5]);
+            }
+        }
+    })
+    test('element bounds enclose the streamed mesh', () => {
+        let expressID = geometries.get(expectedVertexAndIndexDatas.geometryIndex).expressID;
+        let bounds = ifcApi.GetElementBounds(modelID, [expressID]);
+        expect(bounds.length).toBe(7);
+        expect(bounds[0]).toBe(expressID);
+        let flatMesh = ifcApi.GetFlatMesh(modelID, expressID);
+        for (let g = 0; g < flatMesh.geometries.size(); g++) {
+            let placed = flatMesh.geometries.get(g);
+            let geometry = ifcApi.GetGeometry(modelID, placed.geometryExpressID);
+            let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+            let m = placed.flatTransformation;
+            for (let i = 0; i < vertices.length; i += 6) {
+                for (let axis = 0; axis < 3; axis++) {
+                    let value = m[axis] * vertices[i] + m[4 + axis] * vertices[i + 1] + m[8 + axis] * vertices[i + 2] + m[12 + axis];
+                    expect(value).toBeGreaterThanOrEqual(bounds[1 + axis] - 1e-4);
+                    expect(value).toBeLessThanOrEqual(bounds[4 + axis] + 1e-4);
+                }
+            }
+        }
+    })
+    test('element index finds an element by box and by ray', () => {
+        let expressID = geometries.get(expectedVertexAndIndexDatas.geometryIndex).expressID;
+        let bounds = ifcApi.GetElementBounds(modelID, [expressID]);
+        expect(ifcApi.BuildElementIndex(modelID)).toBeGreaterThan(0);
+        let inBox = ifcApi.QueryElementsInBox(modelID, { x: bounds[1], y: bounds[2], z: bounds[3] }, { x: bounds[4], y: bounds[5], z: bounds[6] });
+        expect(Array.from(inBox)).toContain(expressID);
+        // aimed at the middle of one of its triangles from 1 cm in front of it, nothing else can be closer
+        let flatMesh = ifcApi.GetFlatMesh(modelID, expressID);
+        let placed = flatMesh.geometries.get(0);
+        let geometry = ifcApi.GetGeometry(modelID, placed.geometryExpressID);
+        let vertices = ifcApi.GetVertexArray(geometry.GetVertexData(), geometry.GetVertexDataSize());
+        let indices = ifcApi.GetIndexArray(geometry.GetIndexData(), geometry.GetIndexDataSize());
+        let m = placed.flatTransformation;
+        let corner = (k: number) => {
+            let v = indices[k] * 6;
+            return [0, 1, 2].map(axis => m[axis] * vertices[v] + m[4 + axis] * vertices[v + 1] + m[8 + axis] * vertices[v + 2] + m[12 + axis]);
+        };
+        let [a, b, c] = [corner(0), corner(1), corner(2)];
+        let e1 = [0, 1, 2].map(i => b[i] - a[i]);
+        let e2 = [0, 1, 2].map(i => c[i] - a[i]);
+        let n = [e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]];
+        let length = Math.hypot(n[0], n[1], n[2]);
+        n = n.map(v => v / length);
+        let centroid = [0, 1, 2].map(i => (a[i] + b[i] + c[i]) / 3);
+        let origin = { x: centroid[0] + n[0] * 0.01, y: centroid[1] + n[1] * 0.01, z: centroid[2] + n[2] * 0.01 };
+        let hit = ifcApi.RaycastElements(modelID, origin, { x: -n[0], y: -n[1], z: -n[2] });
+        expect(hit).not.toBeNull();
+        expect(hit!.expressID).toBe(expressID);
+        expect(hit!.distance).toBeCloseTo(0.01, 4);
+        // the second pick is answered from the retained triangles and must agree
+        let again = ifcApi.RaycastElements(modelID, origin, { x: -n[0], y: -n[1], z: -n[2] });
+        expect(again!.expressID).toBe(expressID);
+        expect(again!.distance).toBe(hit!.distance);
+    })
+    test('clashes within a model pair distinct elements', () => {
+        let clashes = ifcApi.DetectClashes(modelID, [], modelID, [], 0.001, 0.01);
+        for (let clash of clashes) {
+            expect(clash.expressIDA).not.toBe(clash.expressIDB);
+            if (clash.hard) expect(clash.penetration).toBeGreaterThan(0.001);
+            else expect(clash.distance).toBeLessThan(0.01);
+        }
+    })
+    test('budgeted streaming resumes from the cursor in priority order', () => {
+        let ids = ifcApi.GetPrioritizedElementIDs(modelID, WebIFC.STREAM_PRIORITY_SIZE);
+        let positions: number[] = [];
+        let cursor = 0;
+        let calls = 0;
+        while (cursor < ids.length) {
+            cursor = ifcApi.StreamMeshesBudgeted(modelID, ids, cursor, (mesh: FlatMesh, index: number) => {
+                expect(mesh.expressID).toBe(ids[index]);
+                positions.push(index);
+            }, 0, 1);
+            calls++;
+        }
+        expect(calls).toBeGreaterThan(1);
+        expect(positions.length).toBeGreaterThan(0);
+        for (let i = 1; i < positions.length; i++) expect(positions[i]).toBeGreaterThan(positions[i - 1]);
+    })
+    test('gltf export holds every streamed element', () => {
+        let gltfPieces: Uint8Array[] = [];
+        let binSize = 0;
+        let binPieces = 0;
+        expect(ifcApi.ExportGltf(modelID, (data: Uint8Array) => { gltfPieces.push(data); }, (data: Uint8Array) => {
+            expect(data.byteLength).toBeGreaterThan(0);
+            binSize += data.byteLength;
+            binPieces++;
+        }, [], "example.bin")).toBe(true);
+        expect(binPieces).toBeGreaterThan(0);
+        let gltf = JSON.parse(gltfPieces.map((piece) => new TextDecoder().decode(piece)).join(""));
+        expect(gltf.asset.version).toBe("2.0");
+        expect(gltf.buffers).toEqual([{ byteLength: binSize, uri: "example.bin" }]);
+        for (let bufferView of gltf.bufferViews) expect(bufferView.byteOffset + bufferView.byteLength).toBeLessThanOrEqual(binSize);
+        for (let accessor of gltf.accessors) expect(accessor.bufferView).toBeLessThan(gltf.bufferViews.length);
+        // instancing is optional, a loader without it still reads a valid core file
+        expect(gltf.extensionsRequired).toBeUndefined();
+        expect(gltf.extensionsUsed !== undefined).toBe(gltf.nodes.some((node: any) => node.extensions !== undefined));
+        let names = new Set<string>();
+        for (let node of gltf.nodes) {
+            expect(node.mesh).toBeLessThan(gltf.meshes.length);
+            if (node.name !== undefined) names.add(node.name);
+            if (node.extras !== undefined) for (let id of node.extras.expressIDs) names.add(String(id));
+            if (node.extensions !== undefined) for (let accessor of Object.values(node.extensions.EXT_mesh_gpu_instancing.attributes)) expect(gltf.accessors[accessor as number].count).toBe(node.extras.expressIDs.length);
+        }
+        let streamed = new Set<string>();
+        ifcApi.StreamAllMeshes(modelID, (mesh: FlatMesh) => { streamed.add(String(mesh.expressID)); });
+        expect(names).toEqual(streamed);
+    })
+    test('mesh batches cover the streamed elements and map triangles back to them', () => {
+        // polylines stay with the per element stream, every element with triangles has to be batched
+        let streamed = new Set<number>();
+        ifcApi.StreamAllMeshes(modelID, (mesh: FlatMesh) => {
+            for (let i = 0; i < mesh.geometries.size(); i++) {
+                if (ifcApi.GetGeometry(modelID, mesh.geometries.get(i).geometryExpressID).GetIndexDataSize() > 0) streamed.add(mesh.expressID);
+            }
+        });
+        let batched = new Set<number>();
+        let batches = 0;
+        ifcApi.StreamMeshBatches(modelID, (batch: MeshBatch) => {
+            batches++;
+            // only a single geometry may go over the cap
+            if (batch.vertexData.length / 6 > 1024) expect(batch.ranges.length).toBe(3);
+            let maxIndex = 0;
+            for (let index of batch.indexData) maxIndex = Math.max(maxIndex, index);
+            expect(maxIndex).toBeLessThan(batch.vertexData.length / 6);
+            for (let i = 0; i < batch.ranges.length; i += 3) {
+                expect(streamed.has(batch.ranges[i])).toBe(true);
+                batched.add(batch.ranges[i]);
+                expect(ifcApi.GetBatchExpressID(batch, batch.ranges[i + 1] / 3)).toBe(batch.ranges[i]);
+            }
+            expect(ifcApi.GetBatchExpressID(batch, batch.indexData.length / 3)).toBe(0);
+        }, [], 1024);
+        expect(batches).toBeGreaterThan(0);
+        expect(batched.size).toBeGreaterThan(0);
+        expect([...batched].sort((a, b) => a - b)).toEqual([...streamed].sort((a, b) => a - b));
+    })
+    test('a cancelled stream resumes where it stopped', () => {
+        let ids = ifcApi.GetPrioritizedElementIDs(modelID, WebIFC.STREAM_PRIORITY_SIZE);
+        let seen: number[] = [];
+        let cursor = ifcApi.StreamMeshesBudgeted(modelID, ids, 0, (mesh: FlatMesh, index: number) => {
+            seen.push(index);
+            ifcApi.CancelOperation(modelID);
+        });
+        expect(seen.length).toBe(1);
+        expect(cursor).toBe(seen[0] + 1);
+        cursor = ifcApi.StreamMeshesBudgeted(modelID, ids, cursor, (mesh: FlatMesh, index: number) => {
+            seen.push(index);
+        });
+        expect(cursor).toBe(ids.length);
+        for (let i = 1; i < seen.length; i++) expect(seen[i]).toBeGreaterThan(seen[i - 1]);
+    })
+    test('a cancel left over from an earlier operation does not cut short the next one', () => {
+        let ids = ifcApi.GetPrioritizedElementIDs(modelID, WebIFC.STREAM_PRIORITY_SIZE);
+        let clashes = ifcApi.DetectClashes(modelID, [], modelID, [], 0.001, 0.01);
+        ifcApi.CancelOperation(modelID);
+        expect(Array.from(ifcApi.GetPrioritizedElementIDs(modelID, WebIFC.STREAM_PRIORITY_SIZE))).toEqual(Array.from(ids));
+        ifcApi.CancelOperation(modelID);
+        expect(ifcApi.BuildElementIndex(modelID)).toBeGreaterThan(0);
+        ifcApi.CancelOperation(modelID);
+        expect(ifcApi.DetectClashes(modelID, [], modelID, [], 0.001, 0.01).length).toBe(clashes.length);
+    })
 });
 
 describe('WebIfcApi geometry transformation', () => {